@@ -18,6 +18,7 @@
 #include "detail/export.hpp"
 #include "log/core.hpp"
 #include "log/indent.hpp"
+#include "log/output_capture.hpp"
 
 #ifdef _WIN32
 #  include <wtypes.h>
@@ -35,12 +36,26 @@ namespace mettle {
 
   struct driver_options {
     std::optional<std::chrono::milliseconds> timeout;
+    std::optional<std::size_t> output_limit;
+    bool spill_output = false;
+    bool list = false;
+    bool fail_fast = false;
+    std::size_t max_failures = 0;
+    std::string shard_timing;
+    std::string history;
+    std::optional<isolation_level> isolation;
     filter_set filters;
   };
 
   METTLE_PUBLIC boost::program_options::options_description
   make_driver_options(driver_options &opts);
 
+  // Get the limits for capturing each test's output. When `child` is true,
+  // the output is reported to the `mettle` driver, which only sees what we send
+  // it: the head/tail limit still applies, but nothing is spilled to disk.
+  METTLE_PUBLIC log::capture_limit
+  output_capture_limit(const driver_options &opts, bool child);
+
   enum class color_option {
     never,
     automatic,
@@ -92,6 +107,14 @@ namespace mettle {
   validate(boost::any &v, const std::vector<std::string> &values,
            color_option*, int);
 
+  METTLE_PUBLIC void
+  validate(boost::any &v, const std::vector<std::string> &values,
+           isolation_level*, int);
+
+  METTLE_PUBLIC void
+  validate(boost::any &v, const std::vector<std::string> &values,
+           shard_filter*, int);
+
   METTLE_PUBLIC void
   validate(boost::any &v, const std::vector<std::string> &values,
            attr_filter_set*, int);
@@ -100,6 +123,10 @@ namespace mettle {
   validate(boost::any &v, const std::vector<std::string> &values,
            name_filter_set*, int);
 
+  METTLE_PUBLIC void
+  validate(boost::any &v, const std::vector<std::string> &values,
+           exact_name_filter*, int);
+
 } // namespace mettle
 
 // Put these in the boost namespace so that ADL picks them up (via the
@@ -0,0 +1,40 @@
+#ifndef INC_METTLE_DRIVER_FAILURE_LIMIT_HPP
+#define INC_METTLE_DRIVER_FAILURE_LIMIT_HPP
+
+#include <cstddef>
+
+namespace mettle {
+
+  // Counts how many tests have failed so far, so that we can stop running
+  // tests once there have been too many. A maximum of 0 means no limit.
+  class failure_limit {
+  public:
+    failure_limit(std::size_t max = 0) : max_(max) {}
+
+    void add(std::size_t count = 1) {
+      failures_ += count;
+    }
+
+    std::size_t failures() const {
+      return failures_;
+    }
+
+    std::size_t max() const {
+      return max_;
+    }
+
+    bool reached() const {
+      return max_ != 0 && failures_ >= max_;
+    }
+
+    explicit operator bool() const {
+      return max_ != 0;
+    }
+  private:
+    std::size_t max_;
+    std::size_t failures_ = 0;
+  };
+
+} // namespace mettle
+
+#endif
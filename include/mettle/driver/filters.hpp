@@ -4,7 +4,12 @@
 #include <cstdint>
 #include <functional>
 #include <initializer_list>
+#include <memory>
+#include <optional>
 #include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 #include "filters_core.hpp"
@@ -12,24 +17,67 @@
 
 namespace mettle {
 
-  class name_filter_set {
+  // A single pattern for filtering tests by name. Patterns are ECMAScript
+  // regexes, but simple ones (literal substrings, anchored prefixes and
+  // suffixes, and globs like `^suite.*test$`) are matched without going
+  // through `std::regex`.
+  class METTLE_PUBLIC name_filter {
   public:
-    using value_type = std::regex;
+    name_filter(std::string pattern);
+    name_filter(const char *pattern) : name_filter(std::string(pattern)) {}
+    name_filter(std::regex regex) : regex_(std::move(regex)) {}
+
+    bool operator ()(std::string_view name) const;
+
+    // Whether any name beginning with `prefix` could match this pattern. This
+    // is conservative: it only returns false for patterns anchored at the
+    // beginning that can't match.
+    bool may_match_prefix(std::string_view prefix) const;
+
+    // The source of this pattern, or an empty string if it was created from a
+    // `std::regex`.
+    const std::string & pattern() const {
+      return pattern_;
+    }
+
+    // Whether this pattern can be matched without using `std::regex`.
+    bool is_simple() const {
+      return !pieces_.empty();
+    }
+
+    const std::regex & regex() const {
+      return regex_;
+    }
+  private:
+    std::string pattern_;
+    std::regex regex_;
+    // For simple patterns, the literal strings separated by `.*`.
+    std::vector<std::string> pieces_;
+    bool anchor_begin_ = false, anchor_end_ = false;
+  };
+
+  class METTLE_PUBLIC name_filter_set {
+  public:
+    using value_type = name_filter;
     using container_type = std::vector<value_type>;
     using iterator = container_type::const_iterator;
 
     name_filter_set() = default;
     name_filter_set(std::initializer_list<value_type> i) : filters_(i) {}
 
-    METTLE_PUBLIC filter_result
-    operator ()(const test_name &name, const attributes &) const;
+    filter_result operator ()(const test_name &name, const attributes &) const;
+
+    // Whether any test in the suite `suites` could match these filters.
+    bool may_match(const suite_path &suites) const;
 
     void insert(const value_type &item) {
       filters_.push_back(item);
+      compiled_ = false;
     }
 
     void insert(value_type &&item) {
       filters_.push_back(std::move(item));
+      compiled_ = false;
     }
 
     bool empty() const {
@@ -48,37 +96,111 @@ namespace mettle {
       return filters_.end();
     }
   private:
+    // Combine all the patterns that need a real regex into a single one, so
+    // that we only have to search each name once. This happens the first time
+    // we filter a test, so that inserting each of N patterns doesn't rebuild
+    // the combined regex every time.
+    void compile() const;
+
     container_type filters_;
+    mutable bool compiled_ = false;
+    mutable std::vector<std::size_t> simple_, separate_;
+    mutable std::optional<std::regex> combined_;
   };
 
+  class attr_filter;
+
   struct attr_filter_item {
+    enum kind_type {
+      custom,
+      has_name,
+      has_value,
+      any_of
+    };
+
     std::string attribute;
     std::function<bool(const attr_instance *)> func;
+
+    // A description of what `func` does, so that `attr_filter` can compile it.
+    // Items with a `custom` kind are evaluated by calling `func` directly.
+    kind_type kind = custom;
+    bool negated = false;
+    std::string value = {};
+    std::shared_ptr<const std::vector<attr_filter>> alternatives = nullptr;
   };
 
   inline attr_filter_item
   has_attr(std::string name) {
     return {std::move(name), [](const attr_instance *attr) -> bool {
       return attr != nullptr;
-    }};
+    }, attr_filter_item::has_name};
   }
 
   inline attr_filter_item
   has_attr(std::string name, std::string value) {
-    auto f = [value = std::move(value)](const attr_instance *attr) -> bool {
+    auto f = [value](const attr_instance *attr) -> bool {
       return attr && attr->value.count(value);
     };
-    return {std::move(name), std::move(f)};
+    return {std::move(name), std::move(f), attr_filter_item::has_value, false,
+            std::move(value)};
   }
 
   inline attr_filter_item
   operator !(attr_filter_item filter) {
-    auto f = [func = std::move(filter.func)](
-      const attr_instance *attr
-    ) -> bool {
-      return !func(attr);
+    if(filter.func) {
+      filter.func = [func = std::move(filter.func)](
+        const attr_instance *attr
+      ) -> bool {
+        return !func(attr);
+      };
+    }
+    if(filter.kind != attr_filter_item::custom)
+      filter.negated = !filter.negated;
+    return filter;
+  }
+
+  namespace detail {
+    // A single node of a compiled attribute filter. Nodes are stored in
+    // prefix order, and `span` is the number of nodes in this node's subtree,
+    // so that we can skip over any children we don't need to evaluate.
+    struct attr_op {
+      enum kind_type : std::uint8_t {
+        has_name,
+        has_value,
+        call,
+        negate,
+        all,
+        any
+      };
+
+      kind_type kind;
+      std::uint8_t slot;
+      std::uint32_t index;
+      std::uint32_t span;
+    };
+
+    // An attribute filter compiled into a flat tree. Each attribute name the
+    // filter refers to is assigned a slot; when filtering a test, we find the
+    // test's attribute for every slot in a single pass, and then evaluate the
+    // tree without any further string lookups.
+    struct attr_program {
+      static constexpr std::size_t max_slots = 64;
+      using slot_array = const attr_instance * [max_slots];
+      using slot_mask = std::uint64_t;
+
+      // Evaluate the subtree at `op`, setting the bits in `used` for each slot
+      // that decided the result. For `any`, that's only the slots in the
+      // alternative that matched, so that attributes in other alternatives
+      // aren't considered explicitly shown.
+      bool eval(const attr_op *op, const slot_array &slots,
+                slot_mask &used) const;
+
+      // The names of each slot, in sorted order.
+      std::vector<std::string> names;
+      std::vector<std::string> values;
+      std::vector<std::function<bool(const attr_instance *)>> funcs;
+      std::vector<attr_op> ops;
     };
-    return {std::move(filter.attribute), std::move(f)};
   }
 
   class attr_filter {
@@ -87,18 +209,25 @@ namespace mettle {
     using container_type = std::vector<attr_filter_item>;
     using iterator = container_type::const_iterator;
 
-    attr_filter() = default;
-    attr_filter(std::initializer_list<value_type> i) : filters_(i) {}
+    attr_filter() {
+      compile();
+    }
+
+    attr_filter(std::initializer_list<value_type> i) : filters_(i) {
+      compile();
+    }
 
     METTLE_PUBLIC filter_result
     operator ()(const test_name &, const attributes &attrs) const;
 
     void insert(const value_type &item) {
       filters_.push_back(item);
+      compile();
     }
 
     void insert(value_type &&item) {
       filters_.push_back(std::move(item));
+      compile();
     }
 
     bool empty() const {
@@ -117,9 +246,22 @@ namespace mettle {
       return filters_.end();
     }
   private:
+    METTLE_PUBLIC void compile();
+
     container_type filters_;
+    detail::attr_program program_;
   };
 
+  // Match tests that match any of the `alternatives`. This is how groups like
+  // `(first|second)` in `--attr` are represented.
+  inline attr_filter_item
+  attr_any_of(std::vector<attr_filter> alternatives) {
+    return {"", nullptr, attr_filter_item::any_of, false, "",
+            std::make_shared<const std::vector<attr_filter>>(
+              std::move(alternatives)
+            )};
+  }
+
   class attr_filter_set {
   public:
     using value_type = attr_filter;
@@ -159,9 +301,73 @@ namespace mettle {
     container_type filters_;
   };
 
+  // A stable hash of a test's name, used to assign it to a shard. Unlike
+  // `std::hash`, this gives the same result on every platform and build.
+  METTLE_PUBLIC std::uint64_t stable_hash(std::string_view s);
+
+  // Selects one of `count` disjoint shards of the tests (numbered from 0). By
+  // default, tests are assigned by a hash of their full name; `assign` lets
+  // the caller pick the tests in this shard explicitly instead (see
+  // `balance_shards`).
+  class METTLE_PUBLIC shard_filter {
+  public:
+    shard_filter() = default;
+    shard_filter(std::size_t index, std::size_t count);
+
+    filter_result operator ()(const test_name &name, const attributes &) const;
+
+    void assign(std::vector<test_uid> tests);
+
+    explicit operator bool() const {
+      return count_ != 0;
+    }
+
+    std::size_t index() const {
+      return index_;
+    }
+
+    std::size_t count() const {
+      return count_;
+    }
+  private:
+    std::size_t index_ = 0, count_ = 0;
+    // Sorted IDs of the tests in this shard, if assigned explicitly.
+    std::shared_ptr<const std::vector<test_uid>> assigned_;
+  };
+
+  // Selects tests by their exact full names (e.g. the tests that failed last
+  // time), looking them up in a hash set rather than matching any patterns.
+  // An empty filter selects every test.
+  class METTLE_PUBLIC exact_name_filter {
+  public:
+    void insert(std::string full_name);
+
+    filter_result operator ()(const test_name &name, const attributes &) const;
+    bool may_match(const suite_path &suites) const;
+
+    bool empty() const {
+      return names_.empty();
+    }
+
+    std::size_t size() const {
+      return names_.size();
+    }
+
+    explicit operator bool() const {
+      return !names_.empty();
+    }
+  private:
+    std::unordered_set<std::string> names_;
+    // Every prefix of a name that could be the `suite_path::prefix()` of the
+    // suites containing it.
+    std::unordered_set<std::string> prefixes_;
+  };
+
   struct filter_set {
     name_filter_set by_name;
     attr_filter_set by_attr;
+    shard_filter shard = {};
+    exact_name_filter by_exact_name = {};
 
     filter_result
     operator ()(const test_name &name, const attributes &attrs) const {
@@ -169,11 +375,29 @@ namespace mettle {
       if(first.action == test_action::hide)
         return first;
 
+      if(by_exact_name) {
+        auto exact = by_exact_name(name, attrs);
+        if(exact.action == test_action::hide)
+          return exact;
+      }
+
+      if(shard) {
+        auto sharded = shard(name, attrs);
+        if(sharded.action == test_action::hide)
+          return sharded;
+      }
+
       auto second = by_attr(name, attrs);
       if(second.action == test_action::indeterminate)
         return first;
       return second;
     }
+
+    // Only name filters can rule out an entire suite, since the attributes
+    // of a suite's tests aren't known until it's built.
+    bool may_match(const suite_path &suites) const {
+      return by_name.may_match(suites) && by_exact_name.may_match(suites);
+    }
   };
 
 } // namespace mettle
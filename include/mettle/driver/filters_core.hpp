@@ -1,6 +1,9 @@
 #ifndef INC_METTLE_DRIVER_FILTERS_CORE_HPP
 #define INC_METTLE_DRIVER_FILTERS_CORE_HPP
 
+#include <type_traits>
+#include <utility>
+
 #include "../suite/attributes.hpp"
 #include "../detail/algorithm.hpp"
 #include "test_name.hpp"
@@ -22,6 +25,29 @@ namespace mettle {
     }
   };
 
+  namespace detail {
+    template<typename Filter, typename = std::void_t<>>
+    struct has_may_match : std::false_type {};
+
+    template<typename Filter>
+    struct has_may_match<Filter, std::void_t<
+      decltype(std::declval<const Filter &>().may_match(
+        std::declval<const suite_path &>()
+      ))
+    >> : std::true_type {};
+  }
+
+  // Check whether any test in the suite `suites` could pass `filter`, so that
+  // we can skip the suite entirely (without building it, if it's lazy). Filters
+  // that can't tell always say yes.
+  template<typename Filter>
+  inline bool may_match(const Filter &filter, const suite_path &suites) {
+    if constexpr(detail::has_may_match<Filter>::value)
+      return filter.may_match(suites);
+    else
+      return true;
+  }
+
   inline filter_result filter_by_attr(const attributes &attrs) {
     using namespace detail;
     for(const auto &attr : attrs) {
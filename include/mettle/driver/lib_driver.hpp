@@ -1,18 +1,26 @@
 #ifndef INC_METTLE_DRIVER_LIB_DRIVER_HPP
 #define INC_METTLE_DRIVER_LIB_DRIVER_HPP
 
-#include "detail/export.hpp"
+#include "test_module.hpp"
 #include "../suite/detail/all_suites.hpp"
 
-namespace mettle::detail {
+#ifdef METTLE_TEST_MODULE
 
-  METTLE_PUBLIC int
-  drive_tests(int argc, const char *argv[], const suites_list &suites);
+#ifdef _WIN32
+#  error "test modules are not supported on this platform"
+#endif
+
+extern "C" __attribute__((visibility("default")))
+const mettle::suites_list * mettle_test_module() {
+  return &mettle::detail::all_suites;
+}
 
-} // namespace mettle::detail
+#else
 
 int main(int argc, const char *argv[]) {
   return mettle::detail::drive_tests(argc, argv, mettle::detail::all_suites);
 }
 
 #endif
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef INC_METTLE_DRIVER_LIST_TESTS_HPP
+#define INC_METTLE_DRIVER_LIST_TESTS_HPP
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../suite/compiled_suite.hpp"
+#include "filters_core.hpp"
+#include "test_name.hpp"
+#include "detail/export.hpp"
+
+namespace mettle {
+
+  // A description of a test, as reported by `--list`. Unlike `attributes`,
+  // this holds only plain strings, so it can be passed between processes.
+  struct test_listing {
+    using attr_list = std::vector<
+      std::pair<std::string, std::vector<std::string>>
+    >;
+
+    test_name name;
+    attr_list attrs;
+    // Either `run` or `skip`; tests hidden by the filter aren't listed.
+    test_action action = test_action::run;
+    std::string message = {};
+    // The command for the test file this test is in, if known.
+    std::string file = {};
+  };
+
+  inline test_listing::attr_list to_attr_list(const attributes &attrs) {
+    test_listing::attr_list result;
+    result.reserve(attrs.size());
+    for(const auto &attr : attrs) {
+      result.emplace_back(
+        attr.attribute.name(),
+        std::vector<std::string>(attr.value.begin(), attr.value.end())
+      );
+    }
+    return result;
+  }
+
+  namespace detail {
+    template<typename Suites, typename Filter, typename Callback>
+    void list_tests_impl(const Suites &suites, const Filter &filter,
+                         Callback &callback, const suite_path &parent) {
+      for(const auto &suite : suites) {
+        auto path = parent.child(suite.name());
+        if(!may_match(filter, path))
+          continue;
+
+        for(const auto &test : suite.tests()) {
+          test_name name = {path, test.name, test.id};
+          auto result = filter(name, test.attrs);
+          if(result.action == test_action::indeterminate)
+            result = filter_by_attr(test.attrs);
+          if(result.action == test_action::hide)
+            continue;
+
+          callback(test_listing{
+            std::move(name), to_attr_list(test.attrs), result.action,
+            std::move(result.message)
+          });
+        }
+
+        list_tests_impl(suite.subsuites(), filter, callback, path);
+      }
+    }
+  }
+
+  // Call `callback` with each test in `suites` that isn't hidden by `filter`,
+  // in the order that `run_tests` would run them.
+  template<typename Suites, typename Filter, typename Callback>
+  void list_tests(const Suites &suites, const Filter &filter,
+                  Callback &&callback) {
+    detail::list_tests_impl(suites, filter, callback, suite_path());
+  }
+
+  // Write a test listing as a single line of JSON.
+  METTLE_PUBLIC void
+  write_listing_json(std::ostream &os, const test_listing &test);
+
+  // Write a test listing as a bencoded `listed_test` event, for the `mettle`
+  // driver to read.
+  METTLE_PUBLIC void
+  write_listing_event(std::ostream &os, const test_listing &test);
+
+} // namespace mettle
+
+#endif
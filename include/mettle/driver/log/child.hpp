@@ -2,88 +2,262 @@
 #define INC_METTLE_DRIVER_LOG_CHILD_HPP
 
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <ostream>
+#include <sstream>
 
 #include <bencode.hpp>
 
 #include "core.hpp"
+#include "protocol.hpp"
 
 namespace mettle::log {
 
+  // Controls how often `log::child` sends events to its parent. By default,
+  // each event is flushed as soon as it's logged; if `max_bytes` is set,
+  // events are buffered until that many bytes are pending, or until an event
+  // is logged `max_delay` or more after the last flush. There's no timer, so
+  // code that might block for a while with events pending (e.g. an async
+  // runner waiting on its tests) should call `flush()` first. The end of the
+  // run is always flushed immediately, and so are `started_test` events if
+  // `flush_started` is set, so that the parent knows which test was running
+  // if the process crashes. (When tests run asynchronously, `started_test` is
+  // only logged once the test's result is in, so there's nothing to gain by
+  // flushing it early.)
+  struct flush_policy {
+    std::size_t max_bytes = 0;
+    std::chrono::milliseconds max_delay = std::chrono::milliseconds(0);
+    bool flush_started = true;
+  };
+
   class child : public test_logger {
   public:
-    child(std::ostream &out) : out(out) {}
+    child(std::ostream &out, protocol proto = protocol::bencode,
+          flush_policy policy = {})
+      : out(out), proto(proto), policy(policy) {}
+
+    ~child() {
+      if(buffered())
+        flush();
+    }
 
     void started_run() override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        enc.begin(binary::event_tag::started_run);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "started_run"}
       });
-      out.flush();
+      sent();
     }
     void ended_run() override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        enc.begin(binary::event_tag::ended_run);
+        return send(true);
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "ended_run"}
       });
-      out.flush();
+      sent(true);
     }
 
     void started_suite(const std::vector<std::string> &suites) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(suites);
+        enc.begin(binary::event_tag::started_suite);
+        enc.write(suite_id);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "started_suite"},
         {"suites", wrap_suites(suites)}
       });
-      out.flush();
+      sent();
     }
     void ended_suite(const std::vector<std::string> &suites) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(suites);
+        enc.begin(binary::event_tag::ended_suite);
+        enc.write(suite_id);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "ended_suite"},
         {"suites", wrap_suites(suites)}
       });
-      out.flush();
+      sent();
     }
 
     void started_test(const test_name &test) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(test.suites);
+        enc.begin(binary::event_tag::started_test);
+        write_test(test, suite_id);
+        return send(policy.flush_started);
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "started_test"},
         {"test", wrap_test(test)}
       });
-      out.flush();
+      sent(policy.flush_started);
     }
 
     void passed_test(const test_name &test, const test_output &output,
                      test_duration duration) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(test.suites);
+        enc.begin(binary::event_tag::passed_test);
+        write_test(test, suite_id);
+        enc.write(duration);
+        enc.write(output);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "passed_test"},
         {"test", wrap_test(test)},
         {"duration", duration.count()},
         {"output", wrap_output(output)}
       });
-      out.flush();
+      sent();
     }
 
     void failed_test(const test_name &test, const std::string &message,
                      const test_output &output,
                      test_duration duration) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(test.suites);
+        enc.begin(binary::event_tag::failed_test);
+        write_test(test, suite_id);
+        enc.write(duration);
+        enc.write(std::string_view(message));
+        enc.write(output);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "failed_test"},
         {"test", wrap_test(test)},
         {"duration", duration.count()},
         {"message", message},
         {"output", wrap_output(output)}
       });
-      out.flush();
+      sent();
     }
 
     void skipped_test(const test_name &test,
                       const std::string &message) override {
-      bencode::encode(out, bencode::dict_view{
+      if(binary()) {
+        auto suite_id = intern(test.suites);
+        enc.begin(binary::event_tag::skipped_test);
+        write_test(test, suite_id);
+        enc.write(std::string_view(message));
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
         {"event", "skipped_test"},
         {"test", wrap_test(test)},
         {"message", message}
       });
+      sent();
+    }
+
+    void cancelled_test(const test_name &test) override {
+      if(binary()) {
+        auto suite_id = intern(test.suites);
+        enc.begin(binary::event_tag::cancelled_test);
+        write_test(test, suite_id);
+        return send();
+      }
+
+      bencode::encode(sink(), bencode::dict_view{
+        {"event", "cancelled_test"},
+        {"test", wrap_test(test)}
+      });
+      sent();
+    }
+
+    // Send any buffered events to the parent.
+    void flush() {
+      if(pending.tellp() > 0) {
+        out << pending.rdbuf();
+        pending.str("");
+      }
       out.flush();
     }
   private:
+    bool buffered() const {
+      return policy.max_bytes != 0;
+    }
+
+    bool binary() const {
+      return proto != protocol::bencode;
+    }
+
+    std::ostream & sink() {
+      return buffered() ? pending : out;
+    }
+
+    void send(bool force = false) {
+      enc.end(sink());
+      sent(force);
+    }
+
+    void sent(bool force = false) {
+      if(!buffered()) {
+        out.flush();
+        return;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if(force ||
+         static_cast<std::size_t>(pending.tellp()) >= policy.max_bytes ||
+         (policy.max_delay.count() && now - last_flush >= policy.max_delay)) {
+        flush();
+        last_flush = now;
+      }
+    }
+
+    // Get the index of a suite path, declaring it to the parent if this is the
+    // first time we've seen it. We remember each `suite_path` object we've
+    // seen so that most lookups are just a pointer comparison.
+    std::uint64_t intern(const suite_path &suites) {
+      auto i = path_ids.find(suites.identity());
+      if(i != path_ids.end())
+        return i->second;
+
+      auto id = intern(suites.get());
+      path_ids.emplace(suites.identity(), id);
+      seen_paths.push_back(suites);
+      return id;
+    }
+
+    std::uint64_t intern(const std::vector<std::string> &suites) {
+      auto i = suite_ids.emplace(suites, suite_ids.size());
+      if(i.second) {
+        enc.begin(binary::event_tag::declare_suite);
+        enc.write(i.first->second);
+        enc.write(suites);
+        enc.end(sink());
+      }
+      return i.first->second;
+    }
+
+    void write_test(const test_name &test, std::uint64_t suite_id) {
+      enc.write(static_cast<std::uint64_t>(test.id));
+      enc.write(suite_id);
+      enc.write(std::string_view(test.name));
+    }
+
     bencode::dict_view wrap_test(const test_name &test) {
       return bencode::dict_view{
         {"id", test.id},
@@ -107,6 +281,15 @@ namespace mettle::log {
     }
 
     std::ostream &out;
+    protocol proto;
+    flush_policy policy;
+    binary::encoder enc;
+    std::map<std::vector<std::string>, std::uint64_t> suite_ids;
+    std::map<const void *, std::uint64_t> path_ids;
+    std::vector<suite_path> seen_paths;
+    std::stringstream pending;
+    std::chrono::steady_clock::time_point last_flush =
+      std::chrono::steady_clock::now();
   };
 
 } // namespace mettle::log
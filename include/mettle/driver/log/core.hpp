@@ -2,6 +2,7 @@
 #define INC_METTLE_DRIVER_LOG_CORE_HPP
 
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -10,8 +11,14 @@
 
 namespace mettle::log {
 
+  class output_capture;
+
   struct test_output {
     std::string stdout_log, stderr_log;
+    // If part of a log was elided and spilled to disk, this holds the full
+    // captured output; see `stream_log()`.
+    std::shared_ptr<const output_capture> stdout_capture = nullptr,
+                                          stderr_capture = nullptr;
 
     bool empty() const {
       return stdout_log.empty() && stderr_log.empty();
@@ -44,6 +51,14 @@ namespace mettle::log {
                 const test_output &output, test_duration duration) = 0;
     virtual void
     skipped_test(const test_name &test, const std::string &message) = 0;
+
+    // A test that was started but then cancelled before it finished (e.g.
+    // because of `--max-failures`). Loggers that don't distinguish this from a
+    // skipped test needn't override it.
+    virtual void
+    cancelled_test(const test_name &test) {
+      skipped_test(test, "cancelled");
+    }
   };
 
   class METTLE_PUBLIC file_logger : public test_logger {
@@ -0,0 +1,56 @@
+#ifndef INC_METTLE_DRIVER_LOG_FAILURES_HPP
+#define INC_METTLE_DRIVER_LOG_FAILURES_HPP
+
+#include "core.hpp"
+#include "../test_failures.hpp"
+#include "../detail/export.hpp"
+
+// Ignore warnings from MSVC about DLL interfaces.
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(push)
+#  pragma warning(disable:4251)
+#endif
+
+namespace mettle::log {
+
+  // Records every failing test (and test file) into a `test_failures`,
+  // forwarding all events on to another logger.
+  class METTLE_PUBLIC failures : public file_logger {
+  public:
+    failures(test_failures &records, file_logger &log);
+
+    void started_run() override;
+    void ended_run() override;
+
+    void started_suite(const std::vector<std::string> &suites) override;
+    void ended_suite(const std::vector<std::string> &suites) override;
+
+    void started_test(const test_name &test) override;
+    void passed_test(const test_name &test, const test_output &output,
+                     test_duration duration) override;
+    void failed_test(const test_name &test, const std::string &message,
+                     const test_output &output,
+                     test_duration duration) override;
+    void skipped_test(const test_name &test,
+                      const std::string &message) override;
+    void cancelled_test(const test_name &test) override;
+
+    void started_file(const test_file &file) override;
+    void ended_file(const test_file &file) override;
+    void failed_file(const test_file &file,
+                     const std::string &message) override;
+  private:
+    test_failures &records_;
+    file_logger &log_;
+    // The file whose events we're currently receiving; empty when we're
+    // running the tests in this process.
+    std::string file_;
+  };
+
+} // namespace mettle::log
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(pop)
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef INC_METTLE_DRIVER_LOG_OUTPUT_CAPTURE_HPP
+#define INC_METTLE_DRIVER_LOG_OUTPUT_CAPTURE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "core.hpp"
+#include "../detail/export.hpp"
+
+namespace mettle::log {
+
+  struct capture_limit {
+    // The maximum number of bytes to keep in memory, or 0 for no limit.
+    std::size_t size = 0;
+    // Whether to write the elided part of the output to a temporary file.
+    bool spill = false;
+  };
+
+  // Captures one stream of a test's output. If a limit is set, only the first
+  // and last halves of the limit are kept in memory; the middle is either
+  // discarded or spilled to a temporary file so it can be streamed back later.
+  class METTLE_PUBLIC output_capture {
+  public:
+    explicit output_capture(capture_limit limit = {}) : limit_(limit) {}
+
+    void append(const char *data, std::size_t size);
+    void clear();
+
+    capture_limit limit() const {
+      return limit_;
+    }
+
+    // The total number of bytes captured, including anything elided.
+    std::size_t size() const {
+      return size_;
+    }
+
+    std::size_t elided() const;
+
+    bool spilled() const {
+      return bool(spill_);
+    }
+
+    // Get the captured output, with a marker in place of any elided bytes.
+    std::string str() const;
+
+    // Like `str()`, but resets the capture and avoids copying the output when
+    // possible.
+    std::string release();
+
+    // Write the entire captured output to `os`, reading back anything that was
+    // spilled to disk.
+    void stream(std::ostream &os) const;
+  private:
+    struct file_closer {
+      void operator ()(std::FILE *f) const {
+        std::fclose(f);
+      }
+    };
+
+    std::size_t head_limit() const {
+      return limit_.size / 2;
+    }
+
+    std::size_t tail_limit() const {
+      return limit_.size - head_limit();
+    }
+
+    void evict(std::size_t size);
+
+    capture_limit limit_;
+    std::size_t size_ = 0;
+    std::string head_, tail_;
+    std::unique_ptr<std::FILE, file_closer> spill_;
+  };
+
+  // Move the contents of a pair of captures into a `test_output`, resetting the
+  // captures so they can be reused for the next test.
+  METTLE_PUBLIC test_output
+  collect_output(output_capture &stdout_capture,
+                 output_capture &stderr_capture);
+
+  // Write a log from a `test_output` to `os`, including any spilled output.
+  inline void
+  stream_log(std::ostream &os, const std::string &log,
+             const std::shared_ptr<const output_capture> &capture) {
+    if(capture)
+      capture->stream(os);
+    else
+      os << log;
+  }
+
+} // namespace mettle::log
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef INC_METTLE_DRIVER_LOG_PROTOCOL_HPP
+#define INC_METTLE_DRIVER_LOG_PROTOCOL_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core.hpp"
+
+namespace mettle::log {
+
+  // The formats that `log::child` can use to send events to `log::pipe`. The
+  // parent passes the newest version it understands in the environment
+  // variable named by `protocol_env` (test binaries built against older
+  // versions of mettle would reject an unknown command-line option), and the
+  // child uses the newest version that they both support.
+  enum class protocol : unsigned {
+    bencode = 0,
+    binary_v1 = 1
+  };
+
+  constexpr protocol latest_protocol = protocol::binary_v1;
+  constexpr const char protocol_env[] = "METTLE_OUTPUT_PROTOCOL";
+
+  namespace binary {
+
+    // Every binary event starts with this byte (which can't start a bencoded
+    // value), followed by the length of the rest of the frame as a 32-bit
+    // little-endian integer. This lets the parent accept either format on the
+    // same stream.
+    constexpr unsigned char frame_marker = 0xb1;
+    constexpr std::size_t header_size = 5;
+
+    // The largest frame the parent will accept, so that a corrupt length can't
+    // make it allocate an arbitrary amount of memory.
+    constexpr std::uint32_t max_frame_size = 256 * 1024 * 1024;
+
+    enum class event_tag : std::uint8_t {
+      started_run,
+      ended_run,
+      started_suite,
+      ended_suite,
+      started_test,
+      passed_test,
+      failed_test,
+      skipped_test,
+      failed_file,
+      declare_suite,
+      cancelled_test
+    };
+
+    class protocol_error : public std::runtime_error {
+      using std::runtime_error::runtime_error;
+    };
+
+    // Builds binary frames. Integers are written as LEB128 varints and strings
+    // are prefixed by their length. Rather than sending the full list of parent
+    // suites with every event, each suite path is sent once in a
+    // `declare_suite` event, and later events refer to it by its index.
+    class encoder {
+    public:
+      void begin(event_tag tag) {
+        buf_.assign(header_size, '\0');
+        buf_[0] = static_cast<char>(frame_marker);
+        buf_.push_back(static_cast<char>(tag));
+      }
+
+      void write(std::uint64_t value) {
+        do {
+          unsigned char byte = value & 0x7f;
+          value >>= 7;
+          buf_.push_back(static_cast<char>(value ? byte | 0x80 : byte));
+        } while(value);
+      }
+
+      void write(std::string_view value) {
+        write(static_cast<std::uint64_t>(value.size()));
+        buf_.append(value.data(), value.size());
+      }
+
+      void write(const std::vector<std::string> &suites) {
+        write(static_cast<std::uint64_t>(suites.size()));
+        for(const auto &i : suites)
+          write(std::string_view(i));
+      }
+
+      void write(const test_output &output) {
+        write(std::string_view(output.stdout_log));
+        write(std::string_view(output.stderr_log));
+      }
+
+      void write(test_duration duration) {
+        write(static_cast<std::uint64_t>(duration.count()));
+      }
+
+      void end(std::ostream &out) {
+        auto length = static_cast<std::uint32_t>(buf_.size() - header_size);
+        for(std::size_t i = 0; i != 4; i++)
+          buf_[i + 1] = static_cast<char>((length >> (8 * i)) & 0xff);
+        out.write(buf_.data(), buf_.size());
+      }
+    private:
+      std::string buf_;
+    };
+
+    // Reads the fields of a binary frame in place, without copying anything.
+    class decoder {
+    public:
+      decoder(std::string_view frame)
+        : pos_(frame.data()), end_(frame.data() + frame.size()) {}
+
+      static std::uint32_t frame_length(const char *header) {
+        std::uint32_t length = 0;
+        for(std::size_t i = 0; i != 4; i++) {
+          length |= static_cast<std::uint32_t>(
+            static_cast<unsigned char>(header[i + 1])
+          ) << (8 * i);
+        }
+        if(length > max_frame_size)
+          throw protocol_error("event too large");
+        return length;
+      }
+
+      event_tag read_tag() {
+        check(1);
+        return static_cast<event_tag>(*pos_++);
+      }
+
+      std::uint64_t read_int() {
+        std::uint64_t value = 0;
+        for(unsigned shift = 0; shift < 64; shift += 7) {
+          check(1);
+          auto byte = static_cast<unsigned char>(*pos_++);
+          value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+          if(!(byte & 0x80))
+            return value;
+        }
+        throw protocol_error("invalid integer in event");
+      }
+
+      std::string_view read_string() {
+        auto size = read_int();
+        check(size);
+        std::string_view result(pos_, size);
+        pos_ += size;
+        return result;
+      }
+    private:
+      void check(std::uint64_t size) const {
+        if(size > static_cast<std::uint64_t>(end_ - pos_))
+          throw protocol_error("truncated event");
+      }
+
+      const char *pos_, *end_;
+    };
+
+  } // namespace binary
+
+} // namespace mettle::log
+
+#endif
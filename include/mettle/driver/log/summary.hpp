@@ -39,16 +39,21 @@ namespace mettle::log {
                      test_duration duration) override;
     void skipped_test(const test_name &test,
                       const std::string &message) override;
+    void cancelled_test(const test_name &test) override;
 
     void started_file(const test_file &file) override;
     void ended_file(const test_file &file) override;
     void failed_file(const test_file &file,
                      const std::string &message) override;
 
+    // Note that the run stopped early (e.g. because of `--max-failures`),
+    // leaving `unstarted_files` test files that never ran.
+    void stopped_early(std::size_t unstarted_files = 0);
+
     void summarize() const;
     bool good() const;
   private:
-    enum unpass_type { skip, fail, file_fail };
+    enum unpass_type { skip, fail, file_fail, cancel };
 
     struct failure {
       std::size_t run;
@@ -70,6 +75,7 @@ namespace mettle::log {
 
     void summarize_skip(const std::string &test,
                         const std::string &message) const;
+    void summarize_cancel(const std::string &test) const;
     void summarize_failure(const std::string &where,
                            const std::vector<failure> &failures) const;
     void log_output(const test_output &output, bool extra_newline) const;
@@ -80,7 +86,9 @@ namespace mettle::log {
     std::chrono::steady_clock::time_point start_time_;
 
     std::size_t total_ = 0, runs_ = 0;
-    std::size_t unpass_counts_[3] = {0};
+    std::size_t unpass_counts_[4] = {0};
+    bool stopped_early_ = false;
+    std::size_t unstarted_files_ = 0;
     std::map<test_uid, unpass> unpasses_;
   };
 
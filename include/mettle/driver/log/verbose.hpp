@@ -34,6 +34,7 @@ namespace mettle::log {
                      test_duration duration) override;
     void skipped_test(const test_name &test,
                       const std::string &message) override;
+    void cancelled_test(const test_name &test) override;
 
     void started_file(const test_file &file) override;
     void ended_file(const test_file &file) override;
@@ -0,0 +1,55 @@
+#ifndef INC_METTLE_DRIVER_POSIX_EVENT_LOOP_HPP
+#define INC_METTLE_DRIVER_POSIX_EVENT_LOOP_HPP
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include "subprocess.hpp"
+#include "../detail/export.hpp"
+
+namespace mettle::posix {
+
+  // Waits on the output pipes and exits of many child processes at once. Where
+  // possible, this uses epoll(7) and pidfds; otherwise, it falls back to poll(2)
+  // and a SIGCHLD self-pipe.
+  class METTLE_PUBLIC event_loop {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    // `sigchld_fd` should be the (non-blocking) read end of a pipe that's
+    // written to whenever we get a SIGCHLD. It's used to notice when children
+    // exit if pidfds aren't available.
+    event_loop() : event_loop(-1) {}
+    explicit event_loop(int sigchld_fd);
+    event_loop(const event_loop &) = delete;
+    event_loop & operator =(const event_loop &) = delete;
+    ~event_loop();
+
+    // Read from `r.fd` into `*r.dest` as data arrives. Once the fd reaches EOF,
+    // it's no longer watched and `r.fd` is negated, like with `read_into()`.
+    int watch(readfd &r);
+    int unwatch(readfd &r);
+
+    // Reap `pid` once it exits, storing its exit status in `status`.
+    int watch_child(pid_t pid, std::optional<int> &status);
+    int unwatch_child(pid_t pid);
+
+    // Wait until something happens (or `deadline` passes) and handle it.
+    // Returns the number of events handled, or -1 on error.
+    int wait(std::optional<clock::time_point> deadline = std::nullopt);
+
+    // Handle any events that are already pending without blocking.
+    int wait_nonblocking() {
+      return wait(clock::time_point::min());
+    }
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+  };
+
+} // namespace mettle::posix
+
+#endif
@@ -3,19 +3,27 @@
 
 #include <signal.h>
 
-#include <chrono>
 #include <string>
 #include <vector>
 
+#include "../log/output_capture.hpp"
+
 namespace mettle::posix {
 
   struct readfd {
     int fd;
     std::string *dest;
+    // If set, data is appended here instead of to `dest`.
+    log::output_capture *capture = nullptr;
+
+    void append(const char *data, std::size_t size) {
+      if(capture)
+        capture->append(data, size);
+      else
+        dest->append(data, size);
+    }
   };
 
-  void make_timeout_monitor(std::chrono::milliseconds timeout);
-
   int read_into(std::vector<readfd> &dests, const timespec *timeout,
                 const sigset_t *sigmask);
 
@@ -1,7 +1,16 @@
 #ifndef INC_METTLE_DRIVER_RUN_TESTS_HPP
 #define INC_METTLE_DRIVER_RUN_TESTS_HPP
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
 #include "../suite/compiled_suite.hpp"
+#include "failure_limit.hpp"
 #include "filters_core.hpp"
 #include "log/core.hpp"
 
@@ -11,6 +20,55 @@ namespace mettle {
     test_result(const test_info &, log::test_output &)
   >;
 
+  // A test runner that can have several tests in flight at once. `run` may
+  // block until there's room to start another test, and `done` may be called
+  // (from within `run` or `wait`) in any order.
+  class async_test_runner {
+  public:
+    using callback_type = std::function<void(
+      const test_result &, const log::test_output &, log::test_duration
+    )>;
+
+    virtual ~async_test_runner() {}
+
+    virtual void run(const test_name &name, const test_info &test,
+                     callback_type done) = 0;
+    virtual void wait() = 0;
+
+    // Stop as soon as possible: kill any tests that are running, calling
+    // `done` for each of them with a failing result, and don't start any more.
+    // Tests that haven't started yet are dropped without calling `done`. This
+    // may be called from within `done`.
+    virtual void cancel() {}
+
+    // Call `f` whenever we're about to block until a running test finishes,
+    // e.g. to send along any results that have been buffered so far.
+    void on_wait(std::function<void()> f) {
+      on_wait_ = std::move(f);
+    }
+  protected:
+    void waiting() const {
+      if(on_wait_)
+        on_wait_();
+    }
+  private:
+    std::function<void()> on_wait_;
+  };
+
+  // Estimates how long a test will take to run, e.g. from its past durations.
+  using duration_estimator = std::function<
+    log::test_duration(const test_name &)
+  >;
+
+  struct run_options {
+    // If set, tests are started longest first (with an async runner).
+    duration_estimator estimate = {};
+    // If set, stop running tests once this many have failed. Tests that were
+    // running at the time are logged via `cancelled_test`, and tests that
+    // hadn't started aren't logged at all.
+    failure_limit *limit = nullptr;
+  };
+
   namespace detail {
 
     class suite_stack {
@@ -20,6 +78,8 @@ namespace mettle {
       template<typename T>
       void push(T &&t) {
         queued_.push_back(std::forward<T>(t));
+        paths_.push_back(paths_.empty() ? suite_path({queued_.back()}) :
+                         paths_.back().child(queued_.back()));
       }
 
       void pop() {
@@ -27,6 +87,7 @@ namespace mettle {
           queued_.pop_back();
         else
           committed_.pop_back();
+        paths_.pop_back();
       }
 
       template<typename T>
@@ -44,10 +105,10 @@ namespace mettle {
         return committed_;
       }
 
-      value_type all() const {
-        value_type all = committed_;
-        all.insert(all.end(), queued_.begin(), queued_.end());
-        return all;
+      // Get the path of the innermost suite. This is shared by every test in
+      // the suite, so it's cheap to copy.
+      suite_path all() const {
+        return paths_.empty() ? suite_path() : paths_.back();
       }
 
       bool has_queued() const {
@@ -55,17 +116,318 @@ namespace mettle {
       }
     private:
       value_type committed_, queued_;
+      std::vector<suite_path> paths_;
     };
 
-    template<typename Suites, typename Filter>
+    // Holds onto logger events until every earlier test has finished, so that
+    // tests which finish out of order are still logged in their original
+    // order (and suites are properly nested). A test's `started_test` event is
+    // held until its result is known, so that tests which never start can be
+    // dropped without a trace (along with any suites left empty).
+    class ordered_logger : public log::test_logger {
+    public:
+      using event_type = std::function<void(log::test_logger &)>;
+
+      ordered_logger(log::test_logger &logger) : logger_(logger) {}
+
+      void started_run() override {
+        push(entry_kind::other, [](log::test_logger &l) { l.started_run(); });
+      }
+      void ended_run() override {
+        push(entry_kind::other, [](log::test_logger &l) { l.ended_run(); });
+      }
+
+      void started_suite(const std::vector<std::string> &suites) override {
+        push(entry_kind::started_suite, [suites](log::test_logger &l) {
+          l.started_suite(suites);
+        });
+      }
+      void ended_suite(const std::vector<std::string> &suites) override {
+        push(entry_kind::ended_suite, [suites](log::test_logger &l) {
+          l.ended_suite(suites);
+        });
+      }
+
+      void started_test(const test_name &test) override {
+        push(entry_kind::started_test, [test](log::test_logger &l) {
+          l.started_test(test);
+        });
+      }
+      void passed_test(const test_name &test, const log::test_output &output,
+                       log::test_duration duration) override {
+        push(entry_kind::other, [test, output, duration](log::test_logger &l) {
+          l.passed_test(test, output, duration);
+        });
+      }
+      void failed_test(const test_name &test, const std::string &message,
+                       const log::test_output &output,
+                       log::test_duration duration) override {
+        push(entry_kind::other, [test, message, output, duration](
+          log::test_logger &l
+        ) {
+          l.failed_test(test, message, output, duration);
+        });
+      }
+      void skipped_test(const test_name &test,
+                        const std::string &message) override {
+        push(entry_kind::other, [test, message](log::test_logger &l) {
+          l.skipped_test(test, message);
+        });
+      }
+
+      // Reserve a place in line for the result of the test that was just
+      // started, which isn't known yet.
+      std::size_t reserve() {
+        pending_.push_back({entry_kind::result, std::nullopt});
+        return first_ + pending_.size() - 1;
+      }
+
+      void fulfill(std::size_t slot, event_type event) {
+        assert(slot >= first_ && slot - first_ < pending_.size());
+        pending_[slot - first_].event = std::move(event);
+        flush();
+      }
+
+      // Forget every test whose result never arrived (i.e. tests that were
+      // never started), as though they'd never been run at all.
+      void drop_unfulfilled() {
+        for(std::size_t i = 0; i != pending_.size(); i++) {
+          if(pending_[i].kind == entry_kind::result && !pending_[i].event) {
+            pending_[i].kind = entry_kind::dropped;
+            if(i != 0 && pending_[i - 1].kind == entry_kind::started_test)
+              pending_[i - 1].kind = entry_kind::dropped;
+          }
+        }
+        flush();
+      }
+
+      bool empty() const {
+        return pending_.empty();
+      }
+    private:
+      enum class entry_kind {
+        other, started_suite, ended_suite, started_test, result, dropped
+      };
+
+      struct entry {
+        entry_kind kind;
+        std::optional<event_type> event;
+      };
+
+      enum class contents { unknown, empty, nonempty };
+
+      void push(entry_kind k, event_type event) {
+        pending_.push_back({k, std::move(event)});
+        flush();
+      }
+
+      bool waiting(const entry &e) const {
+        return e.kind == entry_kind::result && !e.event;
+      }
+
+      // Look through the suite starting at the front of the queue to see if
+      // anything in it will actually be logged. If so, return the index of
+      // the suite's `ended_suite` event.
+      contents suite_contents(std::size_t &end) const {
+        std::size_t depth = 0;
+        for(std::size_t i = 0; i != pending_.size(); i++) {
+          switch(pending_[i].kind) {
+          case entry_kind::started_suite:
+            depth++;
+            break;
+          case entry_kind::ended_suite:
+            if(--depth == 0) {
+              end = i;
+              return contents::empty;
+            }
+            break;
+          case entry_kind::started_test:
+          case entry_kind::dropped:
+            break;
+          default:
+            return waiting(pending_[i]) ? contents::unknown :
+                                          contents::nonempty;
+          }
+        }
+        return contents::unknown;
+      }
+
+      void flush() {
+        while(!pending_.empty()) {
+          auto &front = pending_.front();
+          std::size_t count = 1;
+          if(waiting(front)) {
+            return;
+          } else if(front.kind == entry_kind::started_test) {
+            if(pending_.size() == 1 || waiting(pending_[1]))
+              return;
+          } else if(front.kind == entry_kind::started_suite) {
+            std::size_t end;
+            auto c = suite_contents(end);
+            if(c == contents::unknown)
+              return;
+            if(c == contents::empty)
+              count = end + 1;
+          }
+
+          std::optional<event_type> event;
+          if(count == 1 && front.kind != entry_kind::dropped)
+            event = std::move(front.event);
+          pending_.erase(pending_.begin(), pending_.begin() + count);
+          first_ += count;
+          if(event)
+            (*event)(logger_);
+        }
+      }
+
+      log::test_logger &logger_;
+      std::deque<entry> pending_;
+      std::size_t first_ = 0;
+    };
+
+    class sync_run {
+    public:
+      sync_run(log::test_logger &logger, const test_runner &runner,
+               failure_limit &limit)
+        : logger_(logger), runner_(runner), limit_(limit) {}
+
+      bool stopped() const {
+        return limit_.reached();
+      }
+
+      void operator ()(const test_name &name, const test_info &test) const {
+        log::test_output output;
+
+        using namespace std::chrono;
+        auto then = steady_clock::now();
+        auto result = runner_(test, output);
+        auto now = steady_clock::now();
+        auto duration = duration_cast<log::test_duration>(now - then);
+
+        if(result.passed) {
+          logger_.passed_test(name, output, duration);
+        } else {
+          limit_.add();
+          logger_.failed_test(name, result.message, output, duration);
+        }
+      }
+    private:
+      log::test_logger &logger_;
+      const test_runner &runner_;
+      failure_limit &limit_;
+    };
+
+    class async_run {
+    public:
+      async_run(ordered_logger &logger, async_test_runner &runner,
+                failure_limit &limit)
+        : logger_(logger), runner_(runner), limit_(limit) {}
+
+      bool stopped() const {
+        return limit_.reached();
+      }
+
+      void operator ()(const test_name &name, const test_info &test) const {
+        start(logger_.reserve(), name, test);
+      }
+
+      void start(std::size_t slot, const test_name &name,
+                 const test_info &test) const {
+        // Once we've stopped, leave the slot empty; the test never started, so
+        // it'll be dropped.
+        if(limit_.reached())
+          return;
+
+        runner_.run(name, test, [&logger = logger_, &runner = runner_,
+                                 &limit = limit_, slot, name](
+          const test_result &result, const log::test_output &output,
+          log::test_duration duration
+        ) {
+          if(!result.passed) {
+            // Once we've stopped, any test that didn't pass was (most
+            // likely) killed by `cancel`, so don't count it as a failure.
+            if(limit.reached())
+              return cancel(logger, slot, name);
+
+            limit.add();
+            if(limit.reached())
+              runner.cancel();
+          }
+
+          logger.fulfill(slot, [name, result, output, duration](
+            log::test_logger &l
+          ) {
+            if(result.passed)
+              l.passed_test(name, output, duration);
+            else
+              l.failed_test(name, result.message, output, duration);
+          });
+        });
+      }
+    private:
+      static void cancel(ordered_logger &logger, std::size_t slot,
+                         const test_name &name) {
+        logger.fulfill(slot, [name](log::test_logger &l) {
+          l.cancelled_test(name);
+        });
+      }
+
+      ordered_logger &logger_;
+      async_test_runner &runner_;
+      failure_limit &limit_;
+    };
+
+    struct deferred_test {
+      std::size_t slot;
+      test_name name;
+      const test_info *test;
+      log::test_duration estimate;
+    };
+
+    // Rather than starting each test right away, reserve its place in the log
+    // and queue it up, so that the tests can be started in a different order
+    // once we know about all of them.
+    class deferred_run {
+    public:
+      deferred_run(ordered_logger &logger,
+                   const duration_estimator &estimate,
+                   std::vector<deferred_test> &queue)
+        : logger_(logger), estimate_(estimate), queue_(queue) {}
+
+      bool stopped() const {
+        return false;
+      }
+
+      void operator ()(const test_name &name, const test_info &test) const {
+        queue_.push_back({logger_.reserve(), name, &test, estimate_(name)});
+      }
+    private:
+      ordered_logger &logger_;
+      const duration_estimator &estimate_;
+      std::vector<deferred_test> &queue_;
+    };
+
+    template<typename Suites, typename Run, typename Filter>
     void run_tests_impl(
-      const Suites &suites, log::test_logger &logger, const test_runner &runner,
+      const Suites &suites, log::test_logger &logger, const Run &run,
       const Filter &filter, suite_stack &parents
     ) {
       for(const auto &suite : suites) {
+        // Once we've stopped, don't start any more tests (or build any more
+        // lazy suites).
+        if(run.stopped())
+          break;
+
         parents.push(suite.name());
+        if(!may_match(filter, parents.all())) {
+          parents.pop();
+          continue;
+        }
 
         for(const auto &test : suite.tests()) {
+          if(run.stopped())
+            break;
+
           const test_name name = {parents.all(), test.name, test.id};
           auto action = filter(name, test.attrs);
           if(action.action == test_action::indeterminate)
@@ -84,21 +446,10 @@ namespace mettle {
             continue;
           }
 
-          log::test_output output;
-
-          using namespace std::chrono;
-          auto then = steady_clock::now();
-          auto result = runner(test, output);
-          auto now = steady_clock::now();
-          auto duration = duration_cast<log::test_duration>(now - then);
-
-          if(result.passed)
-            logger.passed_test(name, output, duration);
-          else
-            logger.failed_test(name, result.message, output, duration);
+          run(name, test);
         }
 
-        run_tests_impl(suite.subsuites(), logger, runner, filter, parents);
+        run_tests_impl(suite.subsuites(), logger, run, filter, parents);
 
         if(!parents.has_queued())
           logger.ended_suite(parents.committed());
@@ -115,25 +466,81 @@ namespace mettle {
 
   template<typename Suites, typename Filter>
   void run_tests(const Suites &suites, log::test_logger &logger,
-                 const test_runner &runner, const Filter &filter) {
+                 const test_runner &runner, const Filter &filter,
+                 const run_options &options = {}) {
+    failure_limit no_limit;
+    auto &limit = options.limit ? *options.limit : no_limit;
+
     detail::suite_stack parents;
     logger.started_run();
-    detail::run_tests_impl(suites, logger, runner, filter, parents);
+    detail::run_tests_impl(suites, logger,
+                           detail::sync_run(logger, runner, limit), filter,
+                           parents);
     logger.ended_run();
   }
 
+  // Run tests with an async runner. If `options.estimate` is set, the tests
+  // that are expected to take the longest are started first so that a slow
+  // test doesn't hold up the end of the run. Either way, tests are logged in
+  // their original order.
+  template<typename Suites, typename Filter>
+  void run_tests(const Suites &suites, log::test_logger &logger,
+                 async_test_runner &runner, const Filter &filter,
+                 const run_options &options = {}) {
+    failure_limit no_limit;
+    auto &limit = options.limit ? *options.limit : no_limit;
+
+    detail::suite_stack parents;
+    detail::ordered_logger ordered(logger);
+    detail::async_run run(ordered, runner, limit);
+    ordered.started_run();
+
+    if(options.estimate) {
+      std::vector<detail::deferred_test> queue;
+      detail::run_tests_impl(
+        suites, ordered, detail::deferred_run(ordered, options.estimate, queue),
+        filter, parents
+      );
+
+      std::stable_sort(queue.begin(), queue.end(), [](auto &&a, auto &&b) {
+        return a.estimate > b.estimate;
+      });
+      for(const auto &i : queue)
+        run.start(i.slot, i.name, *i.test);
+    } else {
+      detail::run_tests_impl(suites, ordered, run, filter, parents);
+    }
+
+    runner.wait();
+    ordered.drop_unfulfilled();
+    ordered.ended_run();
+    assert(ordered.empty());
+  }
+
   template<typename Suites, typename Filter>
   inline void run_tests(const Suites &suites, log::test_logger &&logger,
                         const test_runner &runner, const Filter &filter) {
     run_tests(suites, logger, runner, filter);
   }
 
+  template<typename Suites, typename Filter>
+  inline void run_tests(const Suites &suites, log::test_logger &&logger,
+                        async_test_runner &runner, const Filter &filter) {
+    run_tests(suites, logger, runner, filter);
+  }
+
   template<typename Suites>
   inline void run_tests(const Suites &suites, log::test_logger &logger,
                         const test_runner &runner) {
     run_tests(suites, logger, runner, default_filter());
   }
 
+  template<typename Suites>
+  inline void run_tests(const Suites &suites, log::test_logger &logger,
+                        async_test_runner &runner) {
+    run_tests(suites, logger, runner, default_filter());
+  }
+
   template<typename Suites>
   inline void run_tests(const Suites &suites, log::test_logger &&logger,
                         const test_runner &runner) {
@@ -0,0 +1,110 @@
+#ifndef INC_METTLE_DRIVER_SHARD_HPP
+#define INC_METTLE_DRIVER_SHARD_HPP
+
+#include <chrono>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "filters.hpp"
+#include "detail/export.hpp"
+
+namespace mettle {
+
+  // How long each test is expected to take, keyed by its full name.
+  using test_timings = std::unordered_map<
+    std::string, std::chrono::milliseconds
+  >;
+
+  // Read test timings, one test per line, in the form `<milliseconds> <full
+  // name>`. Blank lines and lines starting with `#` are ignored. If this is a
+  // history file, use the timings of the tests from `test_file` (as named by
+  // the `mettle` driver).
+  METTLE_PUBLIC test_timings
+  read_test_timings(std::istream &is, const std::string &test_file = "");
+  METTLE_PUBLIC test_timings
+  read_test_timings(const std::string &file,
+                    const std::string &test_file = "");
+
+  struct weighted_test {
+    test_uid id;
+    std::uint64_t hash;
+    std::chrono::milliseconds duration;
+  };
+
+  // Assign each test to the shard with the least total duration so far,
+  // starting with the longest test, and return the tests in shard `index`.
+  // Every shard must see the same tests for the result to be consistent.
+  METTLE_PUBLIC std::vector<test_uid>
+  pick_shard(std::vector<weighted_test> tests, std::size_t index,
+             std::size_t count);
+
+  namespace detail {
+    template<typename Suites>
+    void collect_weighted_tests(
+      const Suites &suites, const filter_set &filter,
+      const test_timings &timings, std::vector<weighted_test> &tests,
+      std::vector<std::size_t> &unknown, const suite_path &parent
+    ) {
+      for(const auto &suite : suites) {
+        auto path = parent.child(suite.name());
+        if(!filter.may_match(path))
+          continue;
+
+        for(const auto &test : suite.tests()) {
+          test_name name = {path, test.name, test.id};
+          if(filter.by_name(name, test.attrs).action == test_action::hide ||
+             filter.by_exact_name(name, test.attrs).action ==
+               test_action::hide ||
+             filter.by_attr(name, test.attrs).action == test_action::hide)
+            continue;
+
+          auto full_name = name.full_name();
+          auto i = timings.find(full_name);
+          if(i == timings.end())
+            unknown.push_back(tests.size());
+          tests.push_back({
+            test.id, stable_hash(full_name),
+            i == timings.end() ? std::chrono::milliseconds(0) : i->second
+          });
+        }
+
+        collect_weighted_tests(suite.subsuites(), filter, timings, tests,
+                               unknown, path);
+      }
+    }
+  }
+
+  // Replace the hash-based assignment of `filter.shard` with one that gives
+  // each shard roughly the same total duration, according to `timings`. Tests
+  // with no timing are assumed to take the average time of the others.
+  template<typename Suites>
+  void balance_shards(filter_set &filter, const Suites &suites,
+                      const test_timings &timings) {
+    if(!filter.shard)
+      return;
+
+    std::vector<weighted_test> tests;
+    std::vector<std::size_t> unknown;
+    detail::collect_weighted_tests(suites, filter, timings, tests, unknown,
+                                   suite_path());
+
+    std::chrono::milliseconds total(0);
+    for(const auto &i : tests)
+      total += i.duration;
+    std::size_t known = tests.size() - unknown.size();
+    std::chrono::milliseconds average(1);
+    if(known)
+      average = total / static_cast<std::chrono::milliseconds::rep>(known);
+    for(auto i : unknown)
+      tests[i].duration = average;
+
+    filter.shard.assign(pick_shard(
+      std::move(tests), filter.shard.index(), filter.shard.count()
+    ));
+  }
+
+} // namespace mettle
+
+#endif
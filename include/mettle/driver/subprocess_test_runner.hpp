@@ -2,7 +2,10 @@
 #define INC_METTLE_DRIVER_SUBPROCESS_TEST_RUNNER_HPP
 
 #include <chrono>
+#include <map>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #ifdef _WIN32
 #  include <wtypes.h>
@@ -10,28 +13,157 @@
 
 #include <mettle/suite/compiled_suite.hpp>
 #include <mettle/driver/log/core.hpp>
+#include <mettle/driver/log/output_capture.hpp>
+#include <mettle/driver/run_tests.hpp>
 #include <mettle/driver/detail/export.hpp>
 
 namespace mettle {
 
+#ifndef _WIN32
+  namespace posix {
+    class event_loop;
+  }
+#endif
+
   class METTLE_PUBLIC subprocess_test_runner {
   public:
     using timeout_t = std::optional<std::chrono::milliseconds>;
 
-    subprocess_test_runner(timeout_t timeout = {}) : timeout_(timeout) {}
+    subprocess_test_runner(timeout_t timeout = {},
+                           log::capture_limit output_limit = {})
+      : timeout_(timeout), output_limit_(output_limit) {}
 
     template<class Rep, class Period>
-    subprocess_test_runner(std::chrono::duration<Rep, Period> timeout)
-      : timeout_(timeout) {}
+    subprocess_test_runner(std::chrono::duration<Rep, Period> timeout,
+                           log::capture_limit output_limit = {})
+      : timeout_(timeout), output_limit_(output_limit) {}
 
     test_result
     operator ()(const test_info &test, log::test_output &output) const;
   private:
     timeout_t timeout_;
+    log::capture_limit output_limit_;
   };
 
 #ifndef _WIN32
 
+  class METTLE_PUBLIC parallel_test_runner : public async_test_runner {
+  public:
+    using timeout_t = subprocess_test_runner::timeout_t;
+
+    parallel_test_runner(std::size_t jobs, timeout_t timeout = {},
+                         log::capture_limit output_limit = {});
+
+    template<class Rep, class Period>
+    parallel_test_runner(std::size_t jobs,
+                         std::chrono::duration<Rep, Period> timeout,
+                         log::capture_limit output_limit = {})
+      : parallel_test_runner(jobs, timeout_t(timeout), output_limit) {}
+
+    parallel_test_runner(const parallel_test_runner &) = delete;
+    parallel_test_runner & operator =(const parallel_test_runner &) = delete;
+    ~parallel_test_runner();
+
+    void run(const test_name &name, const test_info &test,
+             callback_type done) override;
+    void wait() override;
+    void cancel() override;
+  private:
+    struct running_test;
+    struct signal_state;
+
+    int wait_any();
+    void finish(running_test &test);
+    void abort_all(const test_result &result);
+
+    std::size_t jobs_;
+    timeout_t timeout_;
+    log::capture_limit output_limit_;
+    bool cancelled_ = false;
+    std::unique_ptr<signal_state> signals_;
+    std::unique_ptr<posix::event_loop> loop_;
+    std::vector<std::unique_ptr<running_test>> running_;
+  };
+
+  // Runs tests in a pool of long-lived worker subprocesses, sending each worker
+  // the index of the next test to run over a control pipe. Tests are grouped
+  // according to their isolation level (which can be overridden for a test or
+  // suite via the `isolation` attribute): each group gets its own worker, except
+  // for file-level isolation, whose tests can be spread across all the workers.
+  // Tests with no isolation are all run one at a time, in the order they were
+  // queued, by a single worker of their own (so that the timeout still applies
+  // to them). If a test crashes or times out, its worker is replaced and the
+  // rest of the group resumes on the new one.
+  class METTLE_PUBLIC worker_test_runner : public async_test_runner {
+  public:
+    using timeout_t = subprocess_test_runner::timeout_t;
+
+    worker_test_runner(std::size_t jobs = 1, timeout_t timeout = {},
+                       isolation_level isolation = isolation_level::file,
+                       log::capture_limit output_limit = {});
+
+    template<class Rep, class Period>
+    worker_test_runner(std::size_t jobs,
+                       std::chrono::duration<Rep, Period> timeout,
+                       isolation_level isolation = isolation_level::file,
+                       log::capture_limit output_limit = {})
+      : worker_test_runner(jobs, timeout_t(timeout), isolation,
+                           output_limit) {}
+
+    worker_test_runner(const worker_test_runner &) = delete;
+    worker_test_runner & operator =(const worker_test_runner &) = delete;
+    ~worker_test_runner();
+
+    void run(const test_name &name, const test_info &test,
+             callback_type done) override;
+    void wait() override;
+    void cancel() override;
+  private:
+    struct queued_test {
+      const test_info *test;
+      callback_type done;
+    };
+    struct test_group {
+      std::vector<std::size_t> tests;
+      std::size_t next = 0;
+      std::size_t workers = 0;
+      bool shared = false;
+
+      bool pending() const {
+        return next != tests.size();
+      }
+    };
+    struct worker;
+    struct signal_state;
+
+    std::optional<std::size_t> next_group();
+    int start_worker(std::unique_ptr<worker> &w, std::size_t group);
+    int send_test(worker &w);
+    int wait_any();
+    int read_results(worker &w);
+    void finish(worker &w, const test_result &result);
+    void stop_worker(std::unique_ptr<worker> &w, bool force);
+    // Stop every worker, failing the tests they were running with `result`.
+    // Tests still in the queue are failed too if `fail_queued` is set, and
+    // dropped otherwise.
+    void abort_all(const test_result &result, bool fail_queued = true);
+
+    std::size_t jobs_;
+    timeout_t timeout_;
+    isolation_level isolation_;
+    log::capture_limit output_limit_;
+    bool cancelled_ = false;
+    std::unique_ptr<signal_state> signals_;
+    std::unique_ptr<posix::event_loop> loop_;
+    std::vector<queued_test> queue_;
+    std::size_t pending_ = 0;
+    std::vector<test_group> groups_;
+    std::size_t first_group_ = 0;
+    std::map<std::vector<std::string>, std::size_t> suite_groups_;
+    std::optional<std::size_t> file_group_, none_group_;
+    std::vector<std::unique_ptr<worker>> workers_;
+  };
+
   using fd_type = int;
   int make_fd_private(int fd);
 
@@ -0,0 +1,82 @@
+#ifndef INC_METTLE_DRIVER_TEST_FAILURES_HPP
+#define INC_METTLE_DRIVER_TEST_FAILURES_HPP
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+
+#include "detail/export.hpp"
+
+// Ignore warnings from MSVC about DLL interfaces.
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(push)
+#  pragma warning(disable:4251)
+#endif
+
+namespace mettle {
+
+  // A record of which tests failed in a run, so that `--rerun-failed` can run
+  // just those tests again. Tests are grouped by the command line of the test
+  // file they came from (or the empty string for a standalone test binary)
+  // and identified by their full names.
+  class METTLE_PUBLIC test_failures {
+  public:
+    struct file_record {
+      // True if the file itself failed (e.g. it crashed), meaning that we
+      // don't know which of its tests would fail.
+      bool failed = false;
+      std::unordered_set<std::string> tests = {};
+    };
+
+    using map_type = std::map<std::string, file_record>;
+
+    // The first line of every failures file.
+    static constexpr char file_header[] = "# mettle test failures v1";
+
+    void add_test(const std::string &file, std::string name) {
+      files_[file].tests.insert(std::move(name));
+    }
+
+    void add_file(const std::string &file) {
+      files_[file].failed = true;
+    }
+
+    // Forget the failures for `file`, e.g. because we're about to run it
+    // again.
+    void erase(const std::string &file) {
+      files_.erase(file);
+    }
+
+    const file_record * find(const std::string &file) const {
+      auto i = files_.find(file);
+      return i == files_.end() ? nullptr : &i->second;
+    }
+
+    const map_type & files() const {
+      return files_;
+    }
+
+    bool empty() const {
+      return files_.empty();
+    }
+
+    void read(std::istream &is);
+    void write(std::ostream &os) const;
+
+    // Load a failures file; a missing file is treated as having no failures.
+    static test_failures load(const std::string &file);
+    // Save to a failures file, replacing it atomically.
+    void save(const std::string &file) const;
+  private:
+    map_type files_;
+  };
+
+} // namespace mettle
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(pop)
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef INC_METTLE_DRIVER_TEST_HISTORY_HPP
+#define INC_METTLE_DRIVER_TEST_HISTORY_HPP
+
+#include <chrono>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shard.hpp"
+#include "detail/export.hpp"
+
+// Ignore warnings from MSVC about DLL interfaces.
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(push)
+#  pragma warning(disable:4251)
+#endif
+
+namespace mettle {
+
+  // The recent history of a single test (or test file): its last few
+  // durations, and how often it's failed.
+  struct METTLE_PUBLIC test_record {
+    using duration = std::chrono::milliseconds;
+    static constexpr std::size_t max_samples = 16;
+
+    std::size_t runs = 0, failures = 0;
+    bool last_passed = true;
+    // The most recent durations, oldest first.
+    std::vector<duration> samples = {};
+
+    void add(duration d, bool passed);
+
+    // The mean of the recent durations.
+    duration mean() const;
+    // The `p`th percentile (0-100) of the recent durations.
+    duration percentile(double p) const;
+  };
+
+  // A persistent record of how long each test and test file took in previous
+  // runs. Like `test_failures`, tests are grouped by the command line of the
+  // test file they came from (or the empty string for a standalone test
+  // binary) and identified by their full names; files are keyed by their
+  // command line.
+  class METTLE_PUBLIC test_history {
+  public:
+    using duration = test_record::duration;
+    using map_type = std::unordered_map<std::string, test_record>;
+    using file_map_type = std::map<std::string, map_type>;
+
+    // The first line of every history file.
+    static constexpr char file_header[] = "# mettle test history v1";
+
+    void add_test(const std::string &file, const std::string &name,
+                  duration d, bool passed) {
+      tests_[file][name].add(d, passed);
+    }
+
+    void add_file(const std::string &command, duration d, bool passed) {
+      files_[command].add(d, passed);
+    }
+
+    const test_record *
+    find_test(const std::string &file, const std::string &name) const {
+      auto tests = find_tests(file);
+      return tests ? find(*tests, name) : nullptr;
+    }
+
+    // Get the records of all the tests in `file`, if there are any.
+    const map_type * find_tests(const std::string &file) const {
+      auto i = tests_.find(file);
+      return i == tests_.end() ? nullptr : &i->second;
+    }
+
+    const test_record * find_file(const std::string &command) const {
+      return find(files_, command);
+    }
+
+    const file_map_type & tests() const {
+      return tests_;
+    }
+
+    const map_type & files() const {
+      return files_;
+    }
+
+    bool empty() const {
+      return tests_.empty() && files_.empty();
+    }
+
+    // The mean duration of each test in `file`, for balancing shards.
+    test_timings timings(const std::string &file = "") const;
+
+    void read(std::istream &is);
+    void write(std::ostream &os) const;
+
+    // Load a history file; a missing file is treated as an empty history.
+    static test_history load(const std::string &file);
+    // Save to a history file, replacing it atomically.
+    void save(const std::string &file) const;
+  private:
+    static const test_record *
+    find(const map_type &map, const std::string &key) {
+      auto i = map.find(key);
+      return i == map.end() ? nullptr : &i->second;
+    }
+
+    file_map_type tests_;
+    map_type files_;
+  };
+
+  // Estimates how long a test in `file` will take from its history. Tests with
+  // no history are assumed to take as long as the average test in the file
+  // that has one, so that new tests are neither started first nor left to the
+  // very end.
+  class METTLE_PUBLIC history_estimator {
+  public:
+    history_estimator(const test_history &history,
+                      const std::string &file = "");
+
+    test_record::duration operator ()(const test_name &name) const;
+  private:
+    const test_history::map_type *tests_;
+    test_record::duration average_;
+  };
+
+} // namespace mettle
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(pop)
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef INC_METTLE_DRIVER_TEST_MODULE_HPP
+#define INC_METTLE_DRIVER_TEST_MODULE_HPP
+
+#include "detail/export.hpp"
+#include "../suite/compiled_suite.hpp"
+
+namespace mettle::detail {
+
+  METTLE_PUBLIC int
+  drive_tests(int argc, const char *argv[], const suites_list &suites);
+
+  // A test module is a shared library of test suites that the `mettle` driver
+  // loads directly instead of executing. It's built from the same sources as a
+  // test executable, but with `METTLE_TEST_MODULE` defined, which replaces
+  // `main()` with this entry point.
+  using test_module_entry = const suites_list * ();
+  inline constexpr char test_module_entry_name[] = "mettle_test_module";
+
+} // namespace mettle::detail
+
+#endif
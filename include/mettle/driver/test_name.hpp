@@ -1,7 +1,8 @@
 #ifndef INC_METTLE_DRIVER_TEST_NAME_HPP
 #define INC_METTLE_DRIVER_TEST_NAME_HPP
 
-#include <sstream>
+#include <initializer_list>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -9,17 +10,111 @@
 
 namespace mettle {
 
+  // An immutable, shared list of the suites a test belongs to. Copying a
+  // `suite_path` just bumps a reference count, so every test in a suite can
+  // share the same path.
+  class suite_path {
+  public:
+    using value_type = std::string;
+    using container_type = std::vector<std::string>;
+    using const_iterator = container_type::const_iterator;
+    using iterator = const_iterator;
+    using size_type = container_type::size_type;
+
+    suite_path() : path_(empty_path()) {}
+    suite_path(container_type suites)
+      : path_(std::make_shared<const node>(std::move(suites))) {}
+    suite_path(std::initializer_list<std::string> suites)
+      : suite_path(container_type(suites)) {}
+
+    // Make a new path for a subsuite of this one.
+    suite_path child(std::string name) const {
+      container_type suites = path_->suites;
+      suites.push_back(std::move(name));
+      return suite_path(std::move(suites));
+    }
+
+    const container_type & get() const {
+      return path_->suites;
+    }
+
+    operator const container_type &() const {
+      return path_->suites;
+    }
+
+    // The suite names joined with " > ", including a trailing separator (e.g.
+    // "suite > subsuite > "). This is built once per path so that tests'
+    // full names are cheap to construct.
+    const std::string & prefix() const {
+      return path_->prefix;
+    }
+
+    // Paths with the same identity are the same object, and so are equal.
+    // This is useful for interning paths.
+    const void * identity() const {
+      return path_.get();
+    }
+
+    const_iterator begin() const {
+      return path_->suites.begin();
+    }
+    const_iterator end() const {
+      return path_->suites.end();
+    }
+
+    size_type size() const {
+      return path_->suites.size();
+    }
+    bool empty() const {
+      return path_->suites.empty();
+    }
+
+    const std::string & operator [](size_type i) const {
+      return path_->suites[i];
+    }
+    const std::string & back() const {
+      return path_->suites.back();
+    }
+  private:
+    struct node {
+      node(container_type suites) : suites(std::move(suites)) {
+        for(const auto &i : this->suites)
+          prefix += i + " > ";
+      }
+
+      container_type suites;
+      std::string prefix;
+    };
+
+    static const std::shared_ptr<const node> & empty_path() {
+      static const auto empty = std::make_shared<const node>(container_type());
+      return empty;
+    }
+
+    std::shared_ptr<const node> path_;
+  };
+
+  inline bool operator ==(const suite_path &lhs, const suite_path &rhs) {
+    return lhs.identity() == rhs.identity() || lhs.get() == rhs.get();
+  }
+  inline bool operator !=(const suite_path &lhs, const suite_path &rhs) {
+    return !(lhs == rhs);
+  }
+  inline bool operator <(const suite_path &lhs, const suite_path &rhs) {
+    return lhs.get() < rhs.get();
+  }
+
   struct test_name {
-    std::vector<std::string> suites;
+    suite_path suites;
     std::string name;
     test_uid id;
 
     std::string full_name() const {
-      std::ostringstream ss;
-      for(const auto &i : suites)
-        ss << i << " > ";
-      ss << name;
-      return ss.str();
+      std::string result;
+      result.reserve(suites.prefix().size() + name.size());
+      result += suites.prefix();
+      result += name;
+      return result;
     }
   };
 
@@ -7,12 +7,22 @@
 #include <wtypes.h>
 
 #include "../detail/export.hpp"
+#include "../log/output_capture.hpp"
 
 namespace mettle::windows {
 
   struct readhandle {
     HANDLE handle;
     std::string *dest;
+    // If set, data is appended here instead of to `dest`.
+    log::output_capture *capture = nullptr;
+
+    void append(const char *data, std::size_t size) {
+      if(capture)
+        capture->append(data, size);
+      else
+        dest->append(data, size);
+    }
   };
 
   METTLE_PUBLIC HANDLE
@@ -45,6 +45,9 @@ namespace mettle {
   template<typename ...T>
   using suite = basic_suite<expectation_error, T...>;
 
+  template<typename ...T>
+  using lazy_suite = basic_lazy_suite<expectation_error, T...>;
+
 } // namespace mettle
 
 #endif
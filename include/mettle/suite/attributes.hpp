@@ -3,11 +3,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <initializer_list>
 #include <iterator>
+#include <memory>
+#include <optional>
 #include <set>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "detail/string_pool.hpp"
 
 namespace mettle {
 
@@ -20,13 +27,88 @@ namespace mettle {
 
   class attr_base;
 
+  // An immutable, sorted set of attribute values. The strings themselves are
+  // interned in a global pool that's never freed, so the views stay valid for
+  // the life of the program, and copies of the set share the same storage.
+  class attr_values {
+  public:
+    using value_type = std::string_view;
+    using container_type = std::vector<std::string_view>;
+    using iterator = container_type::const_iterator;
+    using const_iterator = iterator;
+
+    attr_values() = default;
+    attr_values(std::initializer_list<std::string_view> values)
+      : attr_values(container_type(values)) {}
+
+    explicit attr_values(container_type values) {
+      if(values.empty())
+        return;
+
+      auto &pool = detail::string_pool::global();
+      for(auto &i : values)
+        i = pool.intern(i);
+      std::sort(values.begin(), values.end());
+      values.erase(std::unique(values.begin(), values.end()), values.end());
+      values_ = std::make_shared<const container_type>(std::move(values));
+    }
+
+    // Convert to and from `std::set<std::string>`, the type attribute values
+    // used to have, so that existing `attr_base::compose()` overrides still
+    // work.
+    attr_values(const std::set<std::string> &values)
+      : attr_values(container_type(values.begin(), values.end())) {}
+
+    operator std::set<std::string>() const {
+      return std::set<std::string>(begin(), end());
+    }
+
+    iterator begin() const {
+      return get().begin();
+    }
+
+    iterator end() const {
+      return get().end();
+    }
+
+    std::size_t size() const {
+      return values_ ? values_->size() : 0;
+    }
+
+    bool empty() const {
+      return !values_;
+    }
+
+    std::size_t count(std::string_view value) const {
+      return std::binary_search(begin(), end(), value);
+    }
+
+    bool operator ==(const attr_values &rhs) const {
+      return values_ == rhs.values_ || get() == rhs.get();
+    }
+
+    bool operator !=(const attr_values &rhs) const {
+      return !(*this == rhs);
+    }
+  private:
+    const container_type & get() const {
+      static const container_type empty;
+      return values_ ? *values_ : empty;
+    }
+
+    std::shared_ptr<const container_type> values_;
+  };
+
   struct attr_instance {
-    using value_type = std::set<std::string>;
+    using value_type = attr_values;
 
     const attr_base &attribute;
     const value_type value;
   };
 
+  // The name of an attribute is stored once here; every `attr_instance` of it
+  // just refers back to its `attr_base`, so names don't need to be interned
+  // like values do.
   class attr_base {
   protected:
     attr_base(std::string name, test_action action = test_action::run)
@@ -65,12 +147,12 @@ namespace mettle {
       }
 
       bool
-      operator ()(const attr_instance &lhs, const std::string &rhs) const {
+      operator ()(const attr_instance &lhs, std::string_view rhs) const {
         return lhs.attribute.name() < rhs;
       }
 
       bool
-      operator ()(const std::string &lhs, const attr_instance &rhs) const {
+      operator ()(std::string_view lhs, const attr_instance &rhs) const {
         return lhs < rhs.attribute.name();
       }
     };
@@ -115,17 +197,115 @@ namespace mettle {
     const attr_instance
     compose(const attr_instance &lhs, const attr_instance &rhs) const override {
       assert(&lhs.attribute == this && &rhs.attribute == this);
-      attr_instance::value_type merged;
+      if(rhs.value.empty() || lhs.value == rhs.value)
+        return lhs;
+      if(lhs.value.empty())
+        return rhs;
+
+      attr_values::container_type merged;
       std::set_union(
         lhs.value.begin(), lhs.value.end(),
         rhs.value.begin(), rhs.value.end(),
-        std::inserter(merged, merged.begin())
+        std::back_inserter(merged)
       );
-      return attr_instance{*this, std::move(merged)};
+      return attr_instance{*this, attr_values(std::move(merged))};
     }
   };
 
-  using attributes = std::set<attr_instance, detail::attr_less>;
+  // An immutable list of attributes, sorted by name. Copies share the same
+  // storage, so a suite's attributes can be handed to each of its tests without
+  // allocating anything.
+  class attributes {
+  public:
+    using value_type = attr_instance;
+    using container_type = std::vector<attr_instance>;
+    using iterator = container_type::const_iterator;
+    using const_iterator = iterator;
+
+    attributes() = default;
+    attributes(std::initializer_list<attr_instance> attrs) {
+      // Like `std::set`, keep only the first instance of each attribute.
+      std::vector<const attr_instance *> sorted;
+      sorted.reserve(attrs.size());
+      for(const auto &i : attrs)
+        sorted.push_back(&i);
+      std::stable_sort(sorted.begin(), sorted.end(), [](auto *lhs, auto *rhs) {
+        return detail::attr_less()(*lhs, *rhs);
+      });
+
+      container_type result;
+      result.reserve(sorted.size());
+      for(auto *i : sorted) {
+        if(result.empty() || result.back().attribute.name() !=
+           i->attribute.name())
+          result.push_back(*i);
+      }
+      *this = attributes(std::move(result));
+    }
+
+    // Construct from a list that's already sorted by name, with no duplicates.
+    explicit attributes(container_type sorted_attrs) {
+      assert(std::is_sorted(sorted_attrs.begin(), sorted_attrs.end(),
+                            detail::attr_less()));
+      if(!sorted_attrs.empty()) {
+        attrs_ = std::make_shared<const container_type>(
+          std::move(sorted_attrs)
+        );
+      }
+    }
+
+    iterator begin() const {
+      return get().begin();
+    }
+
+    iterator end() const {
+      return get().end();
+    }
+
+    std::size_t size() const {
+      return attrs_ ? attrs_->size() : 0;
+    }
+
+    bool empty() const {
+      return !attrs_;
+    }
+
+    iterator find(std::string_view name) const {
+      auto i = std::lower_bound(begin(), end(), name, detail::attr_less());
+      return i != end() && i->attribute.name() == name ? i : end();
+    }
+
+    std::size_t count(std::string_view name) const {
+      return find(name) != end();
+    }
+
+    // Whether these attributes share their storage with `rhs`.
+    bool shares(const attributes &rhs) const {
+      return attrs_ == rhs.attrs_;
+    }
+
+    std::pair<iterator, bool> insert(const attr_instance &attr) {
+      auto i = std::lower_bound(begin(), end(), attr, detail::attr_less());
+      if(i != end() && i->attribute.name() == attr.attribute.name())
+        return {i, false};
+
+      auto pos = i - begin();
+      container_type result;
+      result.reserve(size() + 1);
+      std::copy(begin(), i, std::back_inserter(result));
+      result.push_back(attr);
+      std::copy(i, end(), std::back_inserter(result));
+      *this = attributes(std::move(result));
+      return {begin() + pos, true};
+    }
+  private:
+    const container_type & get() const {
+      static const container_type empty;
+      return attrs_ ? *attrs_ : empty;
+    }
+
+    std::shared_ptr<const container_type> attrs_;
+  };
 
   namespace detail {
     template<typename Input1, typename Input2, typename Output,
@@ -156,19 +336,72 @@ namespace mettle {
 
   inline attributes
   unite(const attributes &lhs, const attributes &rhs) {
-    attributes all_attrs;
+    // Most tests have no attributes of their own, or are in suites without
+    // any, so just share the other side's storage when we can.
+    if(rhs.empty() || lhs.shares(rhs))
+      return lhs;
+    if(lhs.empty())
+      return rhs;
+
+    attributes::container_type all_attrs;
+    all_attrs.reserve(lhs.size() + rhs.size());
     detail::merge_union(
       lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
-      std::inserter(all_attrs, all_attrs.begin()), detail::attr_less(),
+      std::back_inserter(all_attrs), detail::attr_less(),
       [](const attr_instance &lhs, const attr_instance &rhs) {
         return unite(lhs, rhs);
       }
     );
-    return all_attrs;
+    return attributes(std::move(all_attrs));
   }
 
   inline bool_attr skip("skip", test_action::skip);
 
+  enum class isolation_level {
+    none,
+    test,
+    suite,
+    file
+  };
+
+  inline const char * isolation_name(isolation_level level) {
+    switch(level) {
+    case isolation_level::none:
+      return "none";
+    case isolation_level::test:
+      return "test";
+    case isolation_level::suite:
+      return "suite";
+    case isolation_level::file:
+      return "file";
+    default:
+      assert(false && "invalid isolation level");
+      return "";
+    }
+  }
+
+  inline std::optional<isolation_level>
+  parse_isolation(std::string_view name) {
+    for(auto level : {isolation_level::none, isolation_level::test,
+                      isolation_level::suite, isolation_level::file}) {
+      if(name == isolation_name(level))
+        return level;
+    }
+    return std::nullopt;
+  }
+
+  class isolation_attr : public attr_base {
+  public:
+    isolation_attr(std::string name)
+      : attr_base(std::move(name)) {}
+
+    attr_instance operator ()(isolation_level level) const {
+      return attr_instance{*this, {isolation_name(level)}};
+    }
+  };
+
+  inline isolation_attr isolation("isolation");
+
 } // namespace mettle
 
 #endif
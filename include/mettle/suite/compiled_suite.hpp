@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "attributes.hpp"
@@ -37,6 +38,12 @@ namespace mettle {
   public:
     using test_info = basic_test_info<Function>;
     using iterator = typename std::vector<test_info>::const_iterator;
+    using builder_type = std::function<compiled_suite()>;
+
+    // Create a suite whose tests and subsuites aren't built until they're
+    // first needed. `builder` should return a suite with the same name.
+    compiled_suite(std::string name, builder_type builder)
+      : name_(std::move(name)), builder_(std::move(builder)) {}
 
     template<typename String, typename Tests, typename Subsuites,
              typename Compile>
@@ -60,14 +67,15 @@ namespace mettle {
     template<typename Function2, typename Compile>
     compiled_suite(const compiled_suite<Function2> &suite,
                    const attributes &attrs, Compile &&compile)
-      : compiled_suite(suite.name_, suite.tests_, suite.subsuites_, attrs,
+      : compiled_suite(suite.name_, suite.tests(), suite.subsuites(), attrs,
                        std::forward<Compile>(compile)) {}
 
     template<typename Function2, typename Compile>
     compiled_suite(compiled_suite<Function2> &&suite,
                    const attributes &attrs, Compile &&compile)
-      : compiled_suite(std::move(suite.name_), std::move(suite.tests_),
-                       std::move(suite.subsuites_), attrs,
+      : compiled_suite(std::move(suite.name_),
+                       std::move(suite.expanded().tests_),
+                       std::move(suite.expanded().subsuites_), attrs,
                        std::forward<Compile>(compile)) {}
 
     const std::string & name() const {
@@ -75,16 +83,37 @@ namespace mettle {
     }
 
     const std::vector<test_info> & tests() const {
-      return tests_;
+      return expanded().tests_;
     }
 
     const std::vector<compiled_suite> & subsuites() const {
-      return subsuites_;
+      return expanded().subsuites_;
+    }
+
+    // Whether this suite's tests and subsuites have been built yet.
+    bool is_expanded() const {
+      return !builder_;
     }
   private:
+    const compiled_suite & expanded() const {
+      if(builder_) {
+        auto built = builder_();
+        tests_ = std::move(built.expanded().tests_);
+        subsuites_ = std::move(built.expanded().subsuites_);
+        builder_ = nullptr;
+      }
+      return *this;
+    }
+
+    compiled_suite & expanded() {
+      std::as_const(*this).expanded();
+      return *this;
+    }
+
     std::string name_;
-    std::vector<test_info> tests_;
-    std::vector<compiled_suite> subsuites_;
+    mutable std::vector<test_info> tests_;
+    mutable std::vector<compiled_suite> subsuites_;
+    mutable builder_type builder_;
   };
 
   using runnable_suite = compiled_suite<test_result()>;
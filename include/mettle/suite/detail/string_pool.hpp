@@ -0,0 +1,76 @@
+#ifndef INC_METTLE_SUITE_DETAIL_STRING_POOL_HPP
+#define INC_METTLE_SUITE_DETAIL_STRING_POOL_HPP
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace mettle::detail {
+
+  // Stores each distinct string once in a set of large chunks, returning a
+  // view that stays valid for the life of the program. This keeps attribute
+  // values from turning into millions of tiny heap allocations.
+  //
+  // Nothing is ever removed from the pool, so it should only hold strings from
+  // a bounded set, like the attribute values a test binary declares for its
+  // suites. Long-running processes like `mettle --serve` never intern anything
+  // themselves: test files are always run (or forked) in a child process, so
+  // whatever they intern is freed when the child exits.
+  class string_pool {
+  public:
+    static string_pool & global() {
+      // Leak the pool so that it outlives any static suites referring to it.
+      static string_pool *pool = new string_pool();
+      return *pool;
+    }
+
+    std::string_view intern(std::string_view s) {
+      std::lock_guard lock(mutex_);
+      auto i = index_.find(s);
+      if(i != index_.end())
+        return *i;
+
+      auto stored = store(s);
+      index_.insert(stored);
+      return stored;
+    }
+  private:
+    static constexpr std::size_t chunk_size = 4096;
+
+    std::string_view store(std::string_view s) {
+      if(s.empty())
+        return std::string_view();
+
+      char *dest;
+      if(s.size() > chunk_size / 4) {
+        // Big strings get their own chunk so we don't waste the current one.
+        chunks_.emplace_back(new char[s.size()]);
+        dest = chunks_.back().get();
+      } else {
+        if(s.size() > remaining_) {
+          chunks_.emplace_back(new char[chunk_size]);
+          next_ = chunks_.back().get();
+          remaining_ = chunk_size;
+        }
+        dest = next_;
+        next_ += s.size();
+        remaining_ -= s.size();
+      }
+
+      std::memcpy(dest, s.data(), s.size());
+      return std::string_view(dest, s.size());
+    }
+
+    std::mutex mutex_;
+    std::unordered_set<std::string_view> index_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char *next_ = nullptr;
+    std::size_t remaining_ = 0;
+  };
+
+} // namespace mettle::detail
+
+#endif
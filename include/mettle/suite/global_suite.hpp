@@ -33,6 +33,54 @@ namespace mettle {
       : basic_suite(name, {}, std::forward<Args>(args)...) {}
   };
 
+  namespace detail {
+    template<typename Exception, typename ...Fixture, typename ...Args>
+    runnable_suite
+    make_lazy_suite(const std::string &name, const attributes &attrs,
+                    const Args &...args) {
+      return runnable_suite(name, [name, attrs, args...]() {
+        return make_basic_suite<Exception, Fixture...>(name, attrs, args...);
+      });
+    }
+  }
+
+  // Like `basic_suite`, but only records the suite's name (and a copy of its
+  // arguments) up front. The suite is built the first time the test driver
+  // needs to look inside it, so suites that get filtered out by name are never
+  // built at all. Since building is deferred, the arguments shouldn't refer to
+  // anything that won't outlive `main()`.
+  template<typename Exception, typename ...Fixture>
+  struct basic_lazy_suite {
+    template<typename ...Args>
+    basic_lazy_suite(suites_list &list, const std::string &name,
+                     const attributes &attrs, Args &&...args) {
+      if constexpr(sizeof...(Fixture) < 2) {
+        list.push_back(detail::make_lazy_suite<Exception, Fixture...>(
+          name, attrs, args...
+        ));
+      } else {
+        (list.push_back(detail::make_lazy_suite<Exception, Fixture>(
+          detail::annotate_type<Fixture>(name), attrs, args...
+        )), ...);
+      }
+    }
+
+    template<typename ...Args>
+    basic_lazy_suite(suites_list &list, const std::string &name,
+                     Args &&...args)
+      : basic_lazy_suite(list, name, {}, std::forward<Args>(args)...) {}
+
+    template<typename ...Args>
+    basic_lazy_suite(const std::string &name, const attributes &attrs,
+                     Args &&...args)
+      : basic_lazy_suite(detail::all_suites, name, attrs,
+                         std::forward<Args>(args)...) {}
+
+    template<typename ...Args>
+    basic_lazy_suite(const std::string &name, Args &&...args)
+      : basic_lazy_suite(name, {}, std::forward<Args>(args)...) {}
+  };
+
 } // namespace mettle
 
 #endif
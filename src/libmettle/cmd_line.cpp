@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
@@ -39,14 +40,42 @@ namespace mettle {
     options_description desc("Driver options");
     desc.add_options()
       ("timeout,t", value(&opts.timeout)->value_name("TIME"), "timeout in ms")
+      ("output-limit", value(&opts.output_limit)->value_name("BYTES"),
+       "maximum number of bytes of each test's stdout/stderr to keep")
+      ("spill-output", value(&opts.spill_output)->zero_tokens(),
+       "write output beyond --output-limit to a temporary file instead of "
+       "discarding it")
       ("test,T", value(&opts.filters.by_name)->value_name("REGEX"),
        "regex matching names of tests to run")
+      ("test-name", value(&opts.filters.by_exact_name)->value_name("NAME"),
+       "full name of a test to run (e.g. \"suite > subsuite > test\")")
       ("attr,a", value(&opts.filters.by_attr)->value_name("ATTR"),
        "attributes of tests to run")
+      ("shard", value(&opts.filters.shard)->value_name("I/N"),
+       "run only the Ith of N disjoint shards of the tests")
+      ("shard-timing", value(&opts.shard_timing)->value_name("FILE"),
+       "balance shards using the test durations in FILE")
+      ("history", value(&opts.history)->value_name("FILE"),
+       "record test durations in FILE, and use them to start the slowest "
+       "tests first")
+      ("list", value(&opts.list)->zero_tokens(),
+       "list the tests that would be run as JSON instead of running them")
+      ("isolation", value(&opts.isolation)->value_name("LEVEL"),
+       "how to isolate tests in subprocesses (one of: test, suite, file, "
+       "none; default: test)")
+      ("fail-fast", value(&opts.fail_fast)->zero_tokens(),
+       "stop after the first test fails (same as --max-failures=1)")
+      ("max-failures", value(&opts.max_failures)->value_name("N"),
+       "stop after N tests fail, cancelling any tests still running")
     ;
     return desc;
   }
 
+  log::capture_limit
+  output_capture_limit(const driver_options &opts, bool child) {
+    return {opts.output_limit.value_or(0), opts.spill_output && !child};
+  }
+
 // MSVC doesn't understand [[noreturn]], so just ignore the warning here.
 #if defined(_MSC_VER) && !defined(__clang__)
 #  pragma warning(push)
@@ -137,71 +166,95 @@ namespace mettle {
     return f;
   }
 
-  attr_filter parse_attr(const std::string &value) {
-    enum parse_state {
-      ITEM_START,
-      NAME_START,
-      NAME,
-      VALUE_START,
-      VALUE
-    };
+  namespace {
+    // Parses attribute filters. The grammar is:
+    //
+    //   alternatives := filter ('|' filter)*
+    //   filter       := item (',' item)*
+    //   item         := '!'? (name ('=' value)? | '(' alternatives ')')
+    class attr_parser {
+    public:
+      using iterator = std::string::const_iterator;
 
-    attr_filter result;
-    bool negated;
-    parse_state state = ITEM_START;
-    std::string::const_iterator i = value.begin(), start, name_start, name_end;
-    do {
-      switch(state) {
-      case ITEM_START:
-        if(i == value.end()) {
-          throw std::invalid_argument("unexpected end of string");
-        } else if(*i == '!') {
-          negated = true;
-          state = NAME_START;
-          break;
+      attr_parser(const std::string &value)
+        : i_(value.begin()), end_(value.end()) {}
+
+      attr_filter parse() {
+        auto alts = parse_alternatives();
+        if(i_ != end_)
+          throw std::invalid_argument(std::string("unexpected '") + *i_ + "'");
+        if(alts.size() == 1)
+          return std::move(alts.front());
+        return attr_filter{ attr_any_of(std::move(alts)) };
+      }
+    private:
+      std::vector<attr_filter> parse_alternatives() {
+        std::vector<attr_filter> alts;
+        alts.push_back(parse_filter());
+        while(i_ != end_ && *i_ == '|') {
+          ++i_;
+          alts.push_back(parse_filter());
         }
-        negated = false;
-        [[fallthrough]];
-      case NAME_START:
-        if(i == value.end())
+        return alts;
+      }
+
+      attr_filter parse_filter() {
+        attr_filter result;
+        result.insert(parse_item());
+        while(i_ != end_ && *i_ == ',') {
+          ++i_;
+          result.insert(parse_item());
+        }
+        return result;
+      }
+
+      attr_filter_item parse_item() {
+        bool negated = i_ != end_ && *i_ == '!';
+        if(negated)
+          ++i_;
+        if(i_ == end_)
           throw std::invalid_argument("unexpected end of string");
-        else if(*i == ',' || *i == '=')
-          throw std::invalid_argument("expected attribute name");
-        start = i;
-        state = NAME;
-        break;
-      case NAME:
-        if(i == value.end() || *i == ',') {
-          auto item = has_attr(std::string(start, i));
-          result.insert(negated ? !std::move(item) : std::move(item));
-          state = ITEM_START;
-        } else if(*i == '=') {
-          name_start = start;
-          name_end = i;
-          state = VALUE_START;
+
+        attr_filter_item item;
+        if(*i_ == '(') {
+          ++i_;
+          item = attr_any_of(parse_alternatives());
+          if(i_ == end_ || *i_ != ')')
+            throw std::invalid_argument("expected ')'");
+          ++i_;
+        } else {
+          std::string name = parse_token("=,|)");
+          if(name.empty())
+            throw std::invalid_argument("expected attribute name");
+
+          if(i_ != end_ && *i_ == '=') {
+            ++i_;
+            item = has_attr(std::move(name), parse_token(",|)"));
+          } else {
+            item = has_attr(std::move(name));
+          }
         }
-        break;
-      case VALUE_START:
-        start = i;
-        state = VALUE;
-        [[fallthrough]];
-      case VALUE:
-        if(i == value.end() || *i == ',') {
-          auto item = has_attr(
-            std::string(name_start, name_end),
-            std::string(start, i)
-          );
-          result.insert(negated ? !std::move(item) : std::move(item));
-          state = ITEM_START;
+        return negated ? !std::move(item) : item;
+      }
+
+      // Read a name or value up to one of `delims`. A backslash escapes the
+      // following character, so that e.g. `a\|b` is the literal name "a|b".
+      std::string parse_token(const char *delims) {
+        std::string result;
+        while(i_ != end_ && !std::strchr(delims, *i_)) {
+          if(*i_ == '\\' && ++i_ == end_)
+            throw std::invalid_argument("unexpected end of string");
+          result += *i_++;
         }
-        break;
-      default:
-        assert(false && "invalid parse state");
+        return result;
       }
-    } while(i++ != value.end());
 
-    assert(state == ITEM_START);
-    return result;
+      iterator i_, end_;
+    };
+  }
+
+  attr_filter parse_attr(const std::string &value) {
+    return attr_parser(value).parse();
   }
 
   void validate(boost::any &v, const std::vector<std::string> &values,
@@ -220,6 +273,38 @@ namespace mettle {
       boost::throw_exception(invalid_option_value(val));
   }
 
+  void validate(boost::any &v, const std::vector<std::string> &values,
+                isolation_level*, int) {
+    using namespace boost::program_options;
+    validators::check_first_occurrence(v);
+    const std::string &val = validators::get_single_string(values);
+
+    if(auto level = parse_isolation(val))
+      v = *level;
+    else
+      boost::throw_exception(invalid_option_value(val));
+  }
+
+  void validate(boost::any &v, const std::vector<std::string> &values,
+                shard_filter*, int) {
+    using namespace boost::program_options;
+    validators::check_first_occurrence(v);
+    const std::string &val = validators::get_single_string(values);
+
+    try {
+      auto slash = val.find('/');
+      if(slash == std::string::npos)
+        throw std::invalid_argument("expected I/N");
+      auto index = boost::lexical_cast<std::size_t>(val.substr(0, slash));
+      auto count = boost::lexical_cast<std::size_t>(val.substr(slash + 1));
+      if(index == 0)
+        throw std::invalid_argument("shards are numbered from 1");
+      v = shard_filter(index - 1, count);
+    } catch(...) {
+      boost::throw_exception(invalid_option_value(val));
+    }
+  }
+
   void validate(boost::any &v, const std::vector<std::string> &values,
                 attr_filter_set*, int) {
     using namespace boost::program_options;
@@ -245,13 +330,23 @@ namespace mettle {
     assert(filters != nullptr);
     for(const auto &i : values) {
       try {
-        filters->insert(std::regex(i));
+        filters->insert(name_filter(i));
       } catch(...) {
         boost::throw_exception(invalid_option_value(i));
       }
     }
   }
 
+  void validate(boost::any &v, const std::vector<std::string> &values,
+                exact_name_filter*, int) {
+    if(v.empty())
+      v = exact_name_filter();
+    exact_name_filter *filter = boost::any_cast<exact_name_filter>(&v);
+    assert(filter != nullptr);
+    for(const auto &i : values)
+      filter->insert(i);
+  }
+
 } // namespace mettle
 
 namespace boost {
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -9,9 +13,17 @@
 
 #include <mettle/driver/cmd_line.hpp>
 #include <mettle/driver/exit_code.hpp>
+#include <mettle/driver/failure_limit.hpp>
+#include <mettle/driver/list_tests.hpp>
 #include <mettle/driver/run_tests.hpp>
+#include <mettle/driver/shard.hpp>
 #include <mettle/driver/subprocess_test_runner.hpp>
+#include <mettle/driver/test_failures.hpp>
+#include <mettle/driver/test_history.hpp>
+#include <mettle/driver/test_module.hpp>
 #include <mettle/driver/log/child.hpp>
+#include <mettle/driver/log/failures.hpp>
+#include <mettle/driver/log/history.hpp>
 #include <mettle/driver/log/summary.hpp>
 #include <mettle/driver/log/term.hpp>
 #include <mettle/driver/detail/export.hpp>
@@ -22,13 +34,73 @@ namespace mettle {
   namespace {
     struct all_options : generic_options, driver_options, output_options {
       std::optional<fd_type> output_fd;
+      std::string history_key;
 #ifdef _WIN32
       std::optional<test_uid> test_id;
       std::optional<HANDLE> log_fd;
 #endif
       bool no_subproc = false;
+      std::size_t jobs = 1;
+      std::string failures;
+      bool rerun_failed = false;
     };
 
+    // Check whether any test that might run has an `isolation` attribute.
+    // Suites that the filter rules out are skipped so that we don't build any
+    // lazy suites unnecessarily.
+    template<typename Suites, typename Filter>
+    bool has_isolation_attr(const Suites &suites, const Filter &filter,
+                            const suite_path &parent = {}) {
+      for(const auto &suite : suites) {
+        auto path = parent.child(suite.name());
+        if(!may_match(filter, path))
+          continue;
+
+        for(const auto &test : suite.tests()) {
+          if(test.attrs.find(isolation.name()) != test.attrs.end())
+            return true;
+        }
+        if(has_isolation_attr(suite.subsuites(), filter, path))
+          return true;
+      }
+      return false;
+    }
+
+#ifdef _WIN32
+    // Each test runs in a new process that finds the test by its id, so every
+    // suite has to be built in the same order as it is there.
+    template<typename Suites>
+    void expand_suites(const Suites &suites) {
+      for(const auto &suite : suites)
+        expand_suites(suite.subsuites());
+    }
+#endif
+
+    constexpr std::size_t child_buffer_size = 64 * 1024;
+
+    // Get the newest event protocol that both we and our parent understand.
+    // The parent passes its version in the environment, so remove it again to
+    // keep anything our tests run from seeing it.
+    log::protocol negotiate_protocol() {
+      const char *value = std::getenv(log::protocol_env);
+      if(!value)
+        return log::protocol::bencode;
+
+      unsigned version = 0;
+      try {
+        version = std::stoul(value);
+      } catch(const std::exception &) {}
+#ifndef _WIN32
+      unsetenv(log::protocol_env);
+#else
+      _putenv_s(log::protocol_env, "");
+#endif
+
+      return static_cast<log::protocol>(std::min(
+        version, static_cast<unsigned>(log::latest_protocol)
+      ));
+    }
+
     void report_error(const std::string &program_name,
                       const std::string &message) {
       std::cerr << program_name << ": " << message << std::endl;
@@ -52,12 +124,20 @@ namespace mettle {
       driver.add_options()
         ("no-subproc", opts::value(&args.no_subproc)->zero_tokens(),
          "don't create a subprocess for each test")
+        ("jobs,j", opts::value(&args.jobs)->value_name("N"),
+         "number of tests to run in parallel")
+        ("failures", opts::value(&args.failures)->value_name("FILE"),
+         "record the names of failing tests in FILE")
+        ("rerun-failed", opts::value(&args.rerun_failed)->zero_tokens(),
+         "run only the tests recorded as failing in the --failures file")
       ;
 
       opts::options_description hidden("Hidden options");
       hidden.add_options()
         ("output-fd", opts::value(&args.output_fd),
          "pipe the results to this file descriptor")
+        ("history-key", opts::value(&args.history_key),
+         "command line to look up this file's tests by in history files")
 #ifdef _WIN32
         ("test-id", opts::value(&args.test_id), "internal id of a test to run")
         ("log-fd", opts::value(&args.log_fd), "HANDLE to log pipe")
@@ -107,18 +187,171 @@ namespace mettle {
       }
 #endif
 
-      test_runner runner;
-      if(args.no_subproc) {
+      test_history history;
+      if(!args.history.empty()) {
+        try {
+          history = test_history::load(args.history);
+        } catch(const std::exception &e) {
+          report_error(argv[0], args.history + ": " + e.what());
+          return exit_code::bad_args;
+        }
+      }
+
+      if(args.rerun_failed) {
+        if(args.failures.empty()) {
+          report_error(argv[0], "--rerun-failed requires --failures");
+          return exit_code::bad_args;
+        }
+
+        test_failures previous;
+        try {
+          previous = test_failures::load(args.failures);
+        } catch(const std::exception &e) {
+          report_error(argv[0], args.failures + ": " + e.what());
+          return exit_code::bad_args;
+        }
+
+        auto record = previous.find("");
+        if(!record || record->tests.empty()) {
+          std::cout << "no failed tests to rerun" << std::endl;
+          return exit_code::success;
+        }
+        for(const auto &i : record->tests)
+          args.filters.by_exact_name.insert(i);
+      }
+
+      if(!args.shard_timing.empty()) {
+        if(!args.filters.shard) {
+          report_error(argv[0], "--shard-timing requires --shard");
+          return exit_code::bad_args;
+        }
+        try {
+          balance_shards(args.filters, suites,
+                         read_test_timings(args.shard_timing,
+                                           args.history_key));
+        } catch(const std::exception &e) {
+          report_error(argv[0], e.what());
+          return exit_code::bad_args;
+        }
+      }
+
+      if(args.list) {
+        if(!args.output_fd) {
+          list_tests(suites, args.filters, [](const test_listing &test) {
+            write_listing_json(std::cout, test);
+          });
+          std::cout.flush();
+          return exit_code::success;
+        }
+
+        make_fd_private(*args.output_fd);
+        namespace io = boost::iostreams;
+        io::stream<io::file_descriptor_sink> fds;
+        fds.open(io::file_descriptor_sink(
+          *args.output_fd, io::never_close_handle
+        ), child_buffer_size);
+        list_tests(suites, args.filters, [&fds](const test_listing &test) {
+          write_listing_event(fds, test);
+        });
+        fds.flush();
+        return exit_code::success;
+      }
+
+      if(args.jobs == 0) {
+        report_error(argv[0], "--jobs must be at least 1");
+        return exit_code::bad_args;
+      }
+
+      if(args.no_subproc && args.isolation &&
+         *args.isolation != isolation_level::none) {
+        report_error(
+          argv[0], "--no-subproc and --isolation can't be used together"
+        );
+        return exit_code::bad_args;
+      }
+      auto level = args.no_subproc ? isolation_level::none :
+                   args.isolation.value_or(isolation_level::test);
+
+      if(level == isolation_level::none) {
         if(args.timeout) {
           report_error(
             argv[0], "--timeout requires running tests in subprocesses"
           );
           return exit_code::bad_args;
         }
+        if(args.jobs > 1) {
+          report_error(
+            argv[0], "--jobs requires running tests in subprocesses"
+          );
+          return exit_code::bad_args;
+        }
+      }
+
+      if(args.spill_output && !args.output_limit) {
+        report_error(argv[0], "--spill-output requires --output-limit");
+        return exit_code::bad_args;
+      }
+
+      if(args.fail_fast && args.max_failures) {
+        report_error(
+          argv[0], "--fail-fast and --max-failures can't be used together"
+        );
+        return exit_code::bad_args;
+      }
+      failure_limit limit(args.fail_fast ? 1 : args.max_failures);
+
+      auto output_limit = output_capture_limit(args, bool(args.output_fd));
+
+      test_runner runner;
+      std::unique_ptr<async_test_runner> async_runner;
+#ifndef _WIN32
+      // Explicitly asking for no isolation wins over any `isolation`
+      // attributes, so don't bother looking for them (and building lazy
+      // suites early) in that case.
+      if(level == isolation_level::none) {
+        runner = inline_test_runner;
+      } else if(level == isolation_level::suite ||
+                level == isolation_level::file ||
+                has_isolation_attr(suites, args.filters)) {
+        async_runner = std::make_unique<worker_test_runner>(
+          args.jobs, args.timeout, level, output_limit
+        );
+      } else if(args.jobs > 1) {
+        async_runner = std::make_unique<parallel_test_runner>(
+          args.jobs, args.timeout, output_limit
+        );
+      } else {
+        runner = subprocess_test_runner(args.timeout, output_limit);
+      }
+#else
+      if(level == isolation_level::suite || level == isolation_level::file) {
+        report_error(argv[0], "--isolation=" +
+                     std::string(isolation_name(level)) +
+                     " is not supported on this platform");
+        return exit_code::bad_args;
+      } else if(args.jobs > 1) {
+        report_error(argv[0], "--jobs is not supported on this platform");
+        return exit_code::bad_args;
+      } else if(level == isolation_level::none) {
         runner = inline_test_runner;
       } else {
-        runner = subprocess_test_runner(args.timeout);
+        expand_suites(suites);
+        runner = subprocess_test_runner(args.timeout, output_limit);
       }
+#endif
+
+      run_options options;
+      if(history.find_tests(args.history_key))
+        options.estimate = history_estimator(history, args.history_key);
+      if(limit)
+        options.limit = &limit;
+
+      auto run = [&](log::test_logger &logger) {
+        if(async_runner)
+          run_tests(suites, logger, *async_runner, args.filters, options);
+        else
+          run_tests(suites, logger, runner, args.filters, options);
+      };
 
       if(args.output_fd) {
         if(auto output_opt = has_option(output, vm)) {
@@ -130,15 +363,28 @@ namespace mettle {
 
         make_fd_private(*args.output_fd);
         namespace io = boost::iostreams;
-        io::stream<io::file_descriptor_sink> fds(
+        io::stream<io::file_descriptor_sink> fds;
+        fds.open(io::file_descriptor_sink(
           *args.output_fd, io::never_close_handle
-        );
-        log::child logger(fds);
-        run_tests(suites, logger, runner, args.filters);
+        ), child_buffer_size);
+        auto protocol = negotiate_protocol();
+
+        // Coalesce events into larger writes. When tests run one at a time,
+        // log::child still flushes before each test starts, so a crash can
+        // always be attributed; async runners only log `started_test` along
+        // with the result, so flushing it early would just add writes.
+        // Instead, they flush whatever results are ready before waiting on
+        // their running tests, so a slow test doesn't hold them back.
+        log::child logger(fds, protocol, {
+          child_buffer_size, std::chrono::milliseconds(100), !async_runner
+        });
+        if(async_runner)
+          async_runner->on_wait([&logger]() { logger.flush(); });
+        run(logger);
         return exit_code::success;
       }
 
-      if(args.no_subproc && args.show_terminal) {
+      if(level == isolation_level::none && args.show_terminal) {
         report_error(
           argv[0], "--show-terminal requires running tests in subprocesses"
         );
@@ -158,8 +404,26 @@ namespace mettle {
           out, factory.make(args.output, out, args), args.show_time,
           args.show_terminal
         );
-        for(std::size_t i = 0; i != args.runs; i++)
-          run_tests(suites, logger, runner, args.filters);
+        log::history recorder(history, logger);
+        log::file_logger &recorded = args.history.empty() ?
+          static_cast<log::file_logger &>(logger) : recorder;
+
+        test_failures failures;
+        log::failures failure_recorder(failures, recorded);
+        log::test_logger &target = args.failures.empty() ?
+          static_cast<log::test_logger &>(recorded) : failure_recorder;
+
+        for(std::size_t i = 0; i != args.runs && !limit.reached(); i++)
+          run(target);
+        if(limit.reached())
+          logger.stopped_early();
+
+        // When we're reporting to the mettle driver, it records the history
+        // and failures instead, so we only save them here.
+        if(!args.history.empty())
+          history.save(args.history);
+        if(!args.failures.empty())
+          failures.save(args.failures);
 
         logger.summarize();
         return logger.good() ? exit_code::success : exit_code::failure;
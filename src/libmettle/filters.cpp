@@ -1,26 +1,210 @@
 #include <mettle/driver/filters.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
 namespace mettle {
 
+  namespace detail {
+
+    bool attr_program::eval(const attr_op *op, const slot_array &slots,
+                            slot_mask &used) const {
+      switch(op->kind) {
+      case attr_op::has_name:
+        used |= slot_mask(1) << op->slot;
+        return slots[op->slot] != nullptr;
+      case attr_op::has_value:
+        used |= slot_mask(1) << op->slot;
+        return slots[op->slot] && slots[op->slot]->value.count(
+          values[op->index]
+        );
+      case attr_op::call:
+        used |= slot_mask(1) << op->slot;
+        return funcs[op->index](slots[op->slot]);
+      case attr_op::negate:
+        return !eval(op + 1, slots, used);
+      case attr_op::all:
+        for(auto *i = op + 1; i != op + op->span; i += i->span) {
+          if(!eval(i, slots, used))
+            return false;
+        }
+        return true;
+      case attr_op::any: {
+        // If an alternative matches, only its slots count; otherwise, every
+        // alternative took part in the result.
+        slot_mask tried = 0;
+        for(auto *i = op + 1; i != op + op->span; i += i->span) {
+          slot_mask alt = 0;
+          if(eval(i, slots, alt)) {
+            used |= alt;
+            return true;
+          }
+          tried |= alt;
+        }
+        used |= tried;
+        return false;
+      }
+      default:
+        assert(false && "invalid attr_op");
+        return false;
+      }
+    }
+
+    namespace {
+      class attr_compiler {
+      public:
+        attr_compiler(attr_program &program) : program_(program) {}
+
+        void collect_names(const attr_filter &filter) {
+          for(const auto &item : filter) {
+            if(item.kind == attr_filter_item::any_of) {
+              for(const auto &alt : *item.alternatives)
+                collect_names(alt);
+            } else {
+              program_.names.push_back(item.attribute);
+            }
+          }
+        }
+
+        void finish_names() {
+          auto &names = program_.names;
+          std::sort(names.begin(), names.end());
+          names.erase(std::unique(names.begin(), names.end()), names.end());
+          if(names.size() > attr_program::max_slots)
+            throw std::length_error("too many attributes in filter");
+        }
+
+        template<typename Iter>
+        void emit_all(Iter begin, Iter end) {
+          auto start = begin_op(attr_op::all);
+          for(; begin != end; ++begin)
+            emit_item(*begin);
+          end_op(start);
+        }
+
+        void emit_item(const attr_filter_item &item) {
+          std::size_t start = 0;
+          if(item.negated)
+            start = begin_op(attr_op::negate);
+
+          switch(item.kind) {
+          case attr_filter_item::has_name:
+            end_op(begin_op(attr_op::has_name, slot(item.attribute)));
+            break;
+          case attr_filter_item::has_value:
+            end_op(begin_op(attr_op::has_value, slot(item.attribute),
+                            program_.values.size()));
+            program_.values.push_back(item.value);
+            break;
+          case attr_filter_item::custom:
+            end_op(begin_op(attr_op::call, slot(item.attribute),
+                            program_.funcs.size()));
+            program_.funcs.push_back(item.func);
+            break;
+          case attr_filter_item::any_of: {
+            auto any = begin_op(attr_op::any);
+            for(const auto &alt : *item.alternatives)
+              emit_all(alt.begin(), alt.end());
+            end_op(any);
+            break;
+          }
+          default:
+            assert(false && "invalid attr_filter_item kind");
+          }
+
+          if(item.negated)
+            end_op(start);
+        }
+      private:
+        std::uint8_t slot(const std::string &name) const {
+          const auto &names = program_.names;
+          return static_cast<std::uint8_t>(
+            std::lower_bound(names.begin(), names.end(), name) - names.begin()
+          );
+        }
+
+        std::size_t begin_op(attr_op::kind_type kind, std::uint8_t slot = 0,
+                             std::size_t index = 0) {
+          program_.ops.push_back({kind, slot,
+                                  static_cast<std::uint32_t>(index), 0});
+          return program_.ops.size() - 1;
+        }
+
+        void end_op(std::size_t start) {
+          auto &ops = program_.ops;
+          ops[start].span = static_cast<std::uint32_t>(ops.size() - start);
+        }
+
+        attr_program &program_;
+      };
+    }
+
+  } // namespace detail
+
+  void attr_filter::compile() {
+    program_ = detail::attr_program();
+    detail::attr_compiler compiler(program_);
+    compiler.collect_names(*this);
+    compiler.finish_names();
+    compiler.emit_all(filters_.begin(), filters_.end());
+  }
+
   filter_result attr_filter::operator ()(const test_name &,
                                          const attributes &attrs) const {
     using namespace detail;
 
-    std::set<const attr_instance*> explicitly_shown;
-    for(const auto &f : filters_) {
-      auto i = attrs.find(f.attribute);
-      const attr_instance *attr = i == attrs.end() ? nullptr: &*i;
+    // Find the test's attribute for each slot with a single pass over both
+    // sorted lists. Along the way, remember the first skipped attribute that
+    // this filter doesn't mention, and which slots hold skipped attributes.
+    attr_program::slot_array slots;
+    attr_program::slot_mask skipped_slots = 0;
+    const attr_instance *skipped = nullptr;
+    const auto &names = program_.names;
+    std::size_t n = 0;
+    for(const auto &attr : attrs) {
+      const auto &name = attr.attribute.name();
+      while(n != names.size() && names[n] < name)
+        slots[n++] = nullptr;
+      bool skip = attr.attribute.action() == test_action::skip;
+      if(n != names.size() && names[n] == name) {
+        if(skip)
+          skipped_slots |= attr_program::slot_mask(1) << n;
+        slots[n++] = &attr;
+      } else if(!skipped && skip) {
+        skipped = &attr;
+      }
+    }
+    for(; n != names.size(); n++)
+      slots[n] = nullptr;
 
-      if(!f.func(attr))
+    attr_program::slot_mask shown = 0;
+    const auto &root = program_.ops.front();
+    for(auto *i = &root + 1; i != &root + root.span; i += i->span) {
+      if(!program_.eval(i, slots, shown)) {
+        auto *leaf = i;
+        while(leaf->kind == attr_op::negate)
+          leaf++;
+        const attr_instance *attr = leaf->kind < attr_op::negate ?
+          slots[leaf->slot] : nullptr;
         return {test_action::hide, attr ? stringify(joined(attr->value)) : ""};
-      else if(attr)
-        explicitly_shown.insert(attr);
+      }
     }
-    for(const auto &attr : attrs) {
-      if(attr.attribute.action() == test_action::skip &&
-         !explicitly_shown.count(&attr))
-        return {test_action::skip, stringify(joined(attr.value))};
+
+    // Skipped attributes in slots are only explicitly shown if they took part
+    // in matching the test. Since the slots and the attributes are both sorted
+    // by name, the lowest remaining slot is the first of these.
+    if(auto hidden = skipped_slots & ~shown) {
+      std::size_t slot = 0;
+      while(!(hidden & (attr_program::slot_mask(1) << slot)))
+        slot++;
+      if(!skipped || slots[slot] < skipped)
+        skipped = slots[slot];
     }
+
+    if(skipped)
+      return {test_action::skip, stringify(joined(skipped->value))};
     return test_action::run;
   }
 
@@ -55,16 +239,233 @@ namespace mettle {
     return result;
   }
 
+  namespace {
+    bool is_special(char c) {
+      return std::strchr("\\^$.|?*+()[]{}", c) != nullptr;
+    }
+
+    // Whether the character at `pos` is preceded by an odd number of
+    // backslashes (and is thus escaped).
+    bool is_escaped(const std::string &s, std::size_t pos) {
+      std::size_t n = 0;
+      while(pos > n && s[pos - n - 1] == '\\')
+        n++;
+      return n % 2 == 1;
+    }
+
+    // Try to split a regex into literal pieces separated by `.*`. Returns
+    // false if the regex uses anything fancier than that.
+    bool split_simple(const std::string &pattern, std::vector<std::string> &pieces,
+                      bool &anchor_begin, bool &anchor_end) {
+      std::size_t begin = 0, end = pattern.size();
+      anchor_begin = begin != end && pattern[begin] == '^';
+      if(anchor_begin)
+        begin++;
+      anchor_end = end > begin && pattern[end - 1] == '$' &&
+                   !is_escaped(pattern, end - 1);
+      if(anchor_end)
+        end--;
+
+      pieces.emplace_back();
+      for(std::size_t i = begin; i != end; i++) {
+        char c = pattern[i];
+        if(c == '\\') {
+          if(++i == end || !is_special(pattern[i]))
+            return false;
+          pieces.back() += pattern[i];
+        } else if(c == '.' && i + 1 != end && pattern[i + 1] == '*') {
+          pieces.emplace_back();
+          i++;
+        } else if(is_special(c)) {
+          return false;
+        } else {
+          pieces.back() += c;
+        }
+      }
+      return true;
+    }
+
+    // Whether `s` has a character that `.` won't match. For narrow strings,
+    // that's just '\n' and '\r'; multibyte separators like U+2028 are matched
+    // byte by byte.
+    bool has_line_terminator(std::string_view s) {
+      return s.find_first_of("\n\r") != std::string_view::npos;
+    }
+
+    bool has_backreference(const std::string &pattern) {
+      for(std::size_t i = 0; i + 1 < pattern.size(); i++) {
+        if(pattern[i] == '\\') {
+          if(std::isdigit(static_cast<unsigned char>(pattern[i + 1])))
+            return true;
+          i++;
+        }
+      }
+      return false;
+    }
+  }
+
+  name_filter::name_filter(std::string pattern)
+    : pattern_(std::move(pattern)), regex_(pattern_) {
+    if(!split_simple(pattern_, pieces_, anchor_begin_, anchor_end_))
+      pieces_.clear();
+  }
+
+  bool name_filter::operator ()(std::string_view name) const {
+    // `.` doesn't match line terminators, so let the regex handle those.
+    if(pieces_.empty() ||
+       (pieces_.size() > 1 && has_line_terminator(name)))
+      return std::regex_search(name.begin(), name.end(), regex_);
+
+    std::size_t pos = 0;
+    for(std::size_t i = 0; i != pieces_.size(); i++) {
+      std::string_view piece = pieces_[i];
+      bool first = i == 0, last = i == pieces_.size() - 1;
+
+      if(last && anchor_end_ && !(first && anchor_begin_)) {
+        return name.size() - pos >= piece.size() &&
+               name.substr(name.size() - piece.size()) == piece;
+      } else if(first && anchor_begin_) {
+        if(name.substr(0, piece.size()) != piece)
+          return false;
+        if(last && anchor_end_)
+          return name.size() == piece.size();
+        pos = piece.size();
+      } else {
+        auto found = name.find(piece, pos);
+        if(found == std::string_view::npos)
+          return false;
+        pos = found + piece.size();
+      }
+    }
+    return true;
+  }
+
+  bool name_filter::may_match_prefix(std::string_view prefix) const {
+    if(pieces_.empty() || !anchor_begin_)
+      return true;
+
+    // Both the prefix and the first piece of the pattern must be at the start
+    // of any matching name, so one of them must be a prefix of the other.
+    std::string_view first = pieces_.front();
+    auto n = std::min(first.size(), prefix.size());
+    return first.substr(0, n) == prefix.substr(0, n);
+  }
+
+  void name_filter_set::compile() const {
+    simple_.clear();
+    separate_.clear();
+    combined_.reset();
+
+    std::string combined;
+    for(std::size_t i = 0; i != filters_.size(); i++) {
+      const auto &f = filters_[i];
+      if(f.is_simple()) {
+        simple_.push_back(i);
+      } else if(f.pattern().empty() || has_backreference(f.pattern())) {
+        // We can't combine regexes whose source we don't know, or whose
+        // backreferences would be renumbered.
+        separate_.push_back(i);
+      } else {
+        if(!combined.empty())
+          combined += '|';
+        combined += "(?:" + f.pattern() + ")";
+      }
+    }
+
+    if(!combined.empty())
+      combined_.emplace(combined);
+    compiled_ = true;
+  }
+
+  bool name_filter_set::may_match(const suite_path &suites) const {
+    if(filters_.empty())
+      return true;
+
+    const auto &prefix = suites.prefix();
+    for(const auto &f : filters_) {
+      if(f.may_match_prefix(prefix))
+        return true;
+    }
+    return false;
+  }
+
   filter_result name_filter_set::operator ()(const test_name &name,
                                              const attributes &) const {
     if(filters_.empty())
       return test_action::indeterminate;
+    if(!compiled_)
+      compile();
 
-    for(const auto &f : filters_) {
-      if(std::regex_search(name.full_name(), f))
+    auto full_name = name.full_name();
+    for(auto i : simple_) {
+      if(filters_[i](full_name))
+        return test_action::run;
+    }
+    if(combined_ && std::regex_search(full_name, *combined_))
+      return test_action::run;
+    for(auto i : separate_) {
+      if(std::regex_search(full_name, filters_[i].regex()))
         return test_action::run;
     }
     return test_action::hide;
   }
 
+  std::uint64_t stable_hash(std::string_view s) {
+    // 64-bit FNV-1a.
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for(char c : s) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  shard_filter::shard_filter(std::size_t index, std::size_t count)
+    : index_(index), count_(count) {
+    if(count == 0)
+      throw std::invalid_argument("shard count must be at least 1");
+    if(index >= count)
+      throw std::invalid_argument("shard index out of range");
+  }
+
+  filter_result
+  shard_filter::operator ()(const test_name &name, const attributes &) const {
+    bool mine;
+    if(assigned_) {
+      mine = std::binary_search(assigned_->begin(), assigned_->end(), name.id);
+    } else {
+      mine = count_ == 0 || stable_hash(name.full_name()) % count_ == index_;
+    }
+    return mine ? test_action::indeterminate : test_action::hide;
+  }
+
+  void shard_filter::assign(std::vector<test_uid> tests) {
+    std::sort(tests.begin(), tests.end());
+    assigned_ = std::make_shared<const std::vector<test_uid>>(
+      std::move(tests)
+    );
+  }
+
+  void exact_name_filter::insert(std::string full_name) {
+    // We don't know which " > " separators belong to the suites and which
+    // (if any) are part of the test's own name, so allow for all of them.
+    constexpr std::string_view sep = " > ";
+    for(auto i = full_name.find(sep); i != std::string::npos;
+        i = full_name.find(sep, i + 1))
+      prefixes_.insert(full_name.substr(0, i + sep.size()));
+    names_.insert(std::move(full_name));
+  }
+
+  filter_result
+  exact_name_filter::operator ()(const test_name &name,
+                                 const attributes &) const {
+    if(names_.empty() || names_.count(name.full_name()))
+      return test_action::indeterminate;
+    return test_action::hide;
+  }
+
+  bool exact_name_filter::may_match(const suite_path &suites) const {
+    return names_.empty() || prefixes_.count(suites.prefix());
+  }
+
 } // namespace mettle
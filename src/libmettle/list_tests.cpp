@@ -0,0 +1,103 @@
+#include <mettle/driver/list_tests.hpp>
+
+#include <iomanip>
+
+#include <bencode.hpp>
+
+namespace mettle {
+
+  namespace {
+    class json_string {
+    public:
+      json_string(const std::string &s) : s_(s) {}
+
+      friend std::ostream &
+      operator <<(std::ostream &os, const json_string &str) {
+        os << '"';
+        for(char c : str.s_) {
+          switch(c) {
+          case '"':  os << "\\\""; break;
+          case '\\': os << "\\\\"; break;
+          case '\b': os << "\\b";  break;
+          case '\f': os << "\\f";  break;
+          case '\n': os << "\\n";  break;
+          case '\r': os << "\\r";  break;
+          case '\t': os << "\\t";  break;
+          default:
+            if(static_cast<unsigned char>(c) < 0x20) {
+              auto flags = os.flags();
+              os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                 << static_cast<int>(c);
+              os.flags(flags);
+            } else {
+              os << c;
+            }
+          }
+        }
+        return os << '"';
+      }
+    private:
+      const std::string &s_;
+    };
+
+    const char * action_name(test_action action) {
+      return action == test_action::skip ? "skip" : "run";
+    }
+  }
+
+  void write_listing_json(std::ostream &os, const test_listing &test) {
+    os << "{";
+    if(!test.file.empty())
+      os << "\"file\": " << json_string(test.file) << ", ";
+    os << "\"id\": " << test.name.id << ", \"suites\": [";
+    for(std::size_t i = 0; i != test.name.suites.size(); i++) {
+      if(i)
+        os << ", ";
+      os << json_string(test.name.suites[i]);
+    }
+    os << "], \"name\": " << json_string(test.name.name) << ", \"attrs\": {";
+    for(std::size_t i = 0; i != test.attrs.size(); i++) {
+      if(i)
+        os << ", ";
+      os << json_string(test.attrs[i].first) << ": [";
+      const auto &values = test.attrs[i].second;
+      for(std::size_t j = 0; j != values.size(); j++) {
+        if(j)
+          os << ", ";
+        os << json_string(values[j]);
+      }
+      os << "]";
+    }
+    os << "}, \"action\": \"" << action_name(test.action) << "\"";
+    if(test.action == test_action::skip)
+      os << ", \"message\": " << json_string(test.message);
+    os << "}\n";
+  }
+
+  void write_listing_event(std::ostream &os, const test_listing &test) {
+    bencode::list_view suites;
+    for(const auto &i : test.name.suites)
+      suites.push_back(i);
+
+    std::vector<bencode::list_view> values(test.attrs.size());
+    bencode::dict_view attrs;
+    for(std::size_t i = 0; i != test.attrs.size(); i++) {
+      for(const auto &v : test.attrs[i].second)
+        values[i].push_back(v);
+      attrs.emplace(test.attrs[i].first, values[i]);
+    }
+
+    bencode::encode(os, bencode::dict_view{
+      {"event", "listed_test"},
+      {"test", bencode::dict_view{
+        {"id", test.name.id},
+        {"suites", suites},
+        {"test", test.name.name}
+      }},
+      {"attrs", attrs},
+      {"action", action_name(test.action)},
+      {"message", test.message}
+    });
+  }
+
+} // namespace mettle
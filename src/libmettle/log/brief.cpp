@@ -37,6 +37,12 @@ namespace mettle::log {
          << std::flush;
   }
 
+  void brief::cancelled_test(const test_name &) {
+    using namespace term;
+    out_ << format(sgr::bold, fg(color::yellow)) << "-" << reset()
+         << std::flush;
+  }
+
   void brief::started_file(const test_file &) {}
   void brief::ended_file(const test_file &) {}
 
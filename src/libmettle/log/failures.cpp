@@ -0,0 +1,70 @@
+#include <mettle/driver/log/failures.hpp>
+
+namespace mettle::log {
+
+  failures::failures(test_failures &records, file_logger &log)
+    : records_(records), log_(log) {}
+
+  void failures::started_run() {
+    log_.started_run();
+  }
+
+  void failures::ended_run() {
+    log_.ended_run();
+  }
+
+  void failures::started_suite(const std::vector<std::string> &suites) {
+    log_.started_suite(suites);
+  }
+
+  void failures::ended_suite(const std::vector<std::string> &suites) {
+    log_.ended_suite(suites);
+  }
+
+  void failures::started_test(const test_name &test) {
+    log_.started_test(test);
+  }
+
+  void failures::passed_test(const test_name &test, const test_output &output,
+                             test_duration duration) {
+    log_.passed_test(test, output, duration);
+  }
+
+  void failures::failed_test(const test_name &test, const std::string &message,
+                             const test_output &output,
+                             test_duration duration) {
+    log_.failed_test(test, message, output, duration);
+
+    records_.add_test(file_, test.full_name());
+  }
+
+  void failures::skipped_test(const test_name &test,
+                              const std::string &message) {
+    log_.skipped_test(test, message);
+  }
+
+  void failures::cancelled_test(const test_name &test) {
+    // A cancelled test didn't get to finish, so we don't know whether it
+    // would have failed.
+    log_.cancelled_test(test);
+  }
+
+  void failures::started_file(const test_file &file) {
+    log_.started_file(file);
+    file_ = file.name;
+  }
+
+  void failures::ended_file(const test_file &file) {
+    log_.ended_file(file);
+    file_.clear();
+  }
+
+  void failures::failed_file(const test_file &file,
+                             const std::string &message) {
+    log_.failed_file(file, message);
+
+    records_.add_file(file.name);
+    file_.clear();
+  }
+
+} // namespace mettle::log
@@ -0,0 +1,68 @@
+#include <mettle/driver/log/history.hpp>
+
+namespace mettle::log {
+
+  history::history(test_history &records, file_logger &log)
+    : records_(records), log_(log) {}
+
+  void history::started_run() {
+    log_.started_run();
+  }
+
+  void history::ended_run() {
+    log_.ended_run();
+  }
+
+  void history::started_suite(const std::vector<std::string> &suites) {
+    log_.started_suite(suites);
+  }
+
+  void history::ended_suite(const std::vector<std::string> &suites) {
+    log_.ended_suite(suites);
+  }
+
+  void history::started_test(const test_name &test) {
+    log_.started_test(test);
+  }
+
+  void history::passed_test(const test_name &test, const test_output &output,
+                            test_duration duration) {
+    log_.passed_test(test, output, duration);
+
+    records_.add_test(file_, test.full_name(), duration, true);
+  }
+
+  void history::failed_test(const test_name &test, const std::string &message,
+                            const test_output &output, test_duration duration) {
+    log_.failed_test(test, message, output, duration);
+
+    records_.add_test(file_, test.full_name(), duration, false);
+  }
+
+  void history::skipped_test(const test_name &test,
+                             const std::string &message) {
+    log_.skipped_test(test, message);
+  }
+
+  void history::cancelled_test(const test_name &test) {
+    // A cancelled test didn't get to finish, so its duration means nothing.
+    log_.cancelled_test(test);
+  }
+
+  void history::started_file(const test_file &file) {
+    log_.started_file(file);
+    file_ = file.name;
+  }
+
+  void history::ended_file(const test_file &file) {
+    log_.ended_file(file);
+    file_.clear();
+  }
+
+  void history::failed_file(const test_file &file,
+                            const std::string &message) {
+    log_.failed_file(file, message);
+    file_.clear();
+  }
+
+} // namespace mettle::log
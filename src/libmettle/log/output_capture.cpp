@@ -0,0 +1,118 @@
+#include <mettle/driver/log/output_capture.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+namespace mettle::log {
+
+  void output_capture::append(const char *data, std::size_t size) {
+    size_ += size;
+    if(!limit_.size) {
+      head_.append(data, size);
+      return;
+    }
+
+    if(head_.size() < head_limit()) {
+      auto n = std::min(size, head_limit() - head_.size());
+      head_.append(data, n);
+      data += n;
+      size -= n;
+    }
+
+    // Let the tail grow to twice its limit before trimming it so that we don't
+    // shift its contents on every append.
+    tail_.append(data, size);
+    if(tail_.size() > 2 * tail_limit())
+      evict(tail_.size() - tail_limit());
+  }
+
+  void output_capture::evict(std::size_t size) {
+    if(limit_.spill && !spill_) {
+      spill_.reset(std::tmpfile());
+      if(!spill_)
+        limit_.spill = false;
+    }
+
+    if(spill_ && std::fwrite(tail_.data(), 1, size, spill_.get()) != size) {
+      // We can't hold onto the whole output after all, so just elide it.
+      spill_.reset();
+      limit_.spill = false;
+    }
+    tail_.erase(0, size);
+  }
+
+  void output_capture::clear() {
+    size_ = 0;
+    head_.clear();
+    tail_.clear();
+    spill_.reset();
+  }
+
+  std::size_t output_capture::elided() const {
+    if(!limit_.size)
+      return 0;
+    return size_ - head_.size() - std::min(tail_.size(), tail_limit());
+  }
+
+  std::string output_capture::str() const {
+    std::size_t n = elided();
+    if(n == 0)
+      return head_ + tail_;
+
+    std::ostringstream ss;
+    ss << head_ << "\n[... " << n << " bytes elided ...]\n"
+       << tail_.substr(tail_.size() - tail_limit());
+    return ss.str();
+  }
+
+  std::string output_capture::release() {
+    std::string result;
+    if(elided() == 0 && tail_.empty())
+      result = std::move(head_);
+    else
+      result = str();
+    clear();
+    return result;
+  }
+
+  void output_capture::stream(std::ostream &os) const {
+    if(!spill_) {
+      os << str();
+      return;
+    }
+
+    os << head_;
+
+    auto *f = spill_.get();
+    std::fflush(f);
+    std::rewind(f);
+    char buf[BUFSIZ];
+    std::size_t n;
+    while((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+      os.write(buf, n);
+    std::fseek(f, 0, SEEK_END);
+
+    os << tail_;
+  }
+
+  test_output collect_output(output_capture &stdout_capture,
+                             output_capture &stderr_capture) {
+    auto collect = [](output_capture &capture, std::string &log,
+                      std::shared_ptr<const output_capture> &full) {
+      if(capture.spilled()) {
+        log = capture.str();
+        auto limit = capture.limit();
+        full = std::make_shared<output_capture>(std::move(capture));
+        capture = output_capture(limit);
+      } else {
+        log = capture.release();
+      }
+    };
+
+    test_output output;
+    collect(stdout_capture, output.stdout_log, output.stdout_capture);
+    collect(stderr_capture, output.stderr_log, output.stderr_capture);
+    return output;
+  }
+
+} // namespace mettle::log
@@ -5,6 +5,7 @@
 
 #include <boost/io/ios_state.hpp>
 
+#include <mettle/driver/log/output_capture.hpp>
 #include <mettle/driver/log/term.hpp>
 
 namespace mettle::log {
@@ -63,6 +64,12 @@ namespace mettle::log {
     add_unpass(test.id, test.full_name(), skip).skip_message = message;
   }
 
+  void summary::cancelled_test(const test_name &test) {
+    if(log_) log_->cancelled_test(test);
+
+    add_unpass(test.id, test.full_name(), cancel);
+  }
+
   void summary::started_file(const test_file &file) {
     if(log_) log_->started_file(file);
   }
@@ -83,6 +90,11 @@ namespace mettle::log {
     );
   }
 
+  void summary::stopped_early(std::size_t unstarted_files) {
+    stopped_early_ = true;
+    unstarted_files_ += unstarted_files;
+  }
+
   void summary::summarize() const {
     assert(runs_ > 0 && "number of runs can't be zero");
 
@@ -90,7 +102,8 @@ namespace mettle::log {
       out_ << std::endl;
 
     using namespace term;
-    std::size_t passes = total_ - unpass_counts_[skip] - unpass_counts_[fail];
+    std::size_t passes = total_ - unpass_counts_[skip] - unpass_counts_[fail] -
+                         unpass_counts_[cancel];
     std::string test_str = total_ == 1 ? "test" : "tests";
 
     out_ << format(sgr::bold) << passes << "/" << total_ << " "
@@ -98,6 +111,8 @@ namespace mettle::log {
 
     if(unpass_counts_[skip])
       out_ << " (" << unpass_counts_[skip] << " skipped)";
+    if(unpass_counts_[cancel])
+      out_ << " (" << unpass_counts_[cancel] << " cancelled)";
 
     if(unpass_counts_[file_fail]) {
       std::string s = unpass_counts_[file_fail] > 1 ? "s" : "";
@@ -106,6 +121,16 @@ namespace mettle::log {
            << "]";
     }
 
+    if(stopped_early_) {
+      out_ << " [" << format(fg(color::yellow)) << "stopped early"
+           << format(fg(color::normal));
+      if(unstarted_files_) {
+        std::string s = unstarted_files_ > 1 ? "s" : "";
+        out_ << ", " << unstarted_files_ << " file" << s << " not run";
+      }
+      out_ << "]";
+    }
+
     if(show_time_) {
       using namespace std::chrono;
       auto elapsed = duration_cast<duration<float>>(
@@ -123,6 +148,8 @@ namespace mettle::log {
     for(const auto &i : unpasses_) {
       if(i.second.type == skip)
         summarize_skip(i.second.name, i.second.skip_message);
+      else if(i.second.type == cancel)
+        summarize_cancel(i.second.name);
       else
         summarize_failure(i.second.name, i.second.failures);
     }
@@ -134,7 +161,7 @@ namespace mettle::log {
 
   summary::unpass &
   summary::add_unpass(test_uid id, std::string name, unpass_type type) {
-    assert(type >= 0 && type < 3 && "invalid type value");
+    assert(type >= 0 && type < 4 && "invalid type value");
     auto [it, inserted] = unpasses_.emplace(id, unpass{std::move(name), type});
     if(inserted)
       unpass_counts_[type]++;
@@ -153,6 +180,13 @@ namespace mettle::log {
     }
   }
 
+  void summary::summarize_cancel(const std::string &test) const {
+    using namespace term;
+
+    out_ << test << " " << format(sgr::bold, fg(color::yellow)) << "CANCELLED"
+         << reset() << std::endl;
+  }
+
   void summary::summarize_failure(
     const std::string &where, const std::vector<failure> &failures
   ) const {
@@ -200,11 +234,15 @@ namespace mettle::log {
 
     if(!output.stdout_log.empty()) {
       out_ << format(fg(color::yellow), sgr::underline) << "stdout" << reset()
-           << ":" << std::endl << output.stdout_log << std::endl;
+           << ":" << std::endl;
+      stream_log(out_, output.stdout_log, output.stdout_capture);
+      out_ << std::endl;
     }
     if(!output.stderr_log.empty()) {
       out_ << format(fg(color::yellow), sgr::underline) << "stderr" << reset()
-           << ":" << std::endl << output.stderr_log << std::endl;
+           << ":" << std::endl;
+      stream_log(out_, output.stderr_log, output.stderr_capture);
+      out_ << std::endl;
     }
   }
 
@@ -2,6 +2,7 @@
 
 #include <cassert>
 
+#include <mettle/driver/log/output_capture.hpp>
 #include <mettle/driver/log/term.hpp>
 
 namespace mettle::log {
@@ -90,6 +91,12 @@ namespace mettle::log {
     }
   }
 
+  void verbose::cancelled_test(const test_name &) {
+    using namespace term;
+    out_ << format(sgr::bold, fg(color::yellow)) << "CANCELLED" << reset()
+         << std::endl;
+  }
+
   void verbose::started_file(const test_file &) {}
 
   void verbose::ended_file(const test_file &) {
@@ -140,11 +147,15 @@ namespace mettle::log {
 
     if(!output.stdout_log.empty()) {
       out_ << format(fg(color::yellow), sgr::underline) << "stdout" << reset()
-           << ":" << std::endl << output.stdout_log << std::endl;
+           << ":" << std::endl;
+      stream_log(out_, output.stdout_log, output.stdout_capture);
+      out_ << std::endl;
     }
     if(!output.stderr_log.empty()) {
       out_ << format(fg(color::yellow), sgr::underline) << "stderr" << reset()
-           << ":" << std::endl << output.stderr_log << std::endl;
+           << ":" << std::endl;
+      stream_log(out_, output.stderr_log, output.stderr_capture);
+      out_ << std::endl;
     }
   }
 
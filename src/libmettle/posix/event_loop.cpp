@@ -0,0 +1,283 @@
+#include <mettle/driver/posix/event_loop.hpp>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+namespace mettle::posix {
+
+  namespace {
+    constexpr std::size_t read_buffer_size = 64 * 1024;
+
+    int open_pidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+      return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+      (void)pid;
+      errno = ENOSYS;
+      return -1;
+#endif
+    }
+
+    int to_timeout_ms(
+      const std::optional<event_loop::clock::time_point> &deadline
+    ) {
+      using namespace std::chrono;
+      if(!deadline)
+        return -1;
+
+      auto now = event_loop::clock::now();
+      if(*deadline <= now)
+        return 0;
+      return static_cast<int>(ceil<milliseconds>(*deadline - now).count());
+    }
+  }
+
+  struct event_loop::impl {
+    enum class kind {
+      reader,
+      child,
+      sigchld
+    };
+
+    struct entry {
+      kind type;
+      // The fd we're waiting on: the reader's fd, the child's pidfd, or the
+      // SIGCHLD pipe. Children without a pidfd have an fd of -1.
+      int fd;
+      readfd *reader = nullptr;
+      pid_t pid = 0;
+      std::optional<int> *status = nullptr;
+    };
+
+    impl(int sigchld_fd) : buffer(read_buffer_size) {
+#ifdef __linux__
+      if((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        throw std::system_error(errno, std::system_category());
+#endif
+      if(sigchld_fd >= 0 && add({kind::sigchld, sigchld_fd}) < 0)
+        throw std::system_error(errno, std::system_category());
+    }
+
+    ~impl() {
+      for(auto &e : entries) {
+        if(e->type == kind::child && e->fd >= 0)
+          close(e->fd);
+      }
+#ifdef __linux__
+      close(epoll_fd);
+#endif
+    }
+
+    int add(entry e) {
+      auto owned = std::make_unique<entry>(e);
+#ifdef __linux__
+      if(owned->fd >= 0) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = owned.get();
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, owned->fd, &event) < 0)
+          return -1;
+      }
+#endif
+      entries.push_back(std::move(owned));
+      return 0;
+    }
+
+    void remove(const entry *e) {
+      auto i = std::find_if(entries.begin(), entries.end(),
+                            [e](const auto &j) { return j.get() == e; });
+      if(i == entries.end())
+        return;
+
+#ifdef __linux__
+      if(e->fd >= 0)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, e->fd, nullptr);
+#endif
+      if(e->type == kind::child && e->fd >= 0)
+        close(e->fd);
+      entries.erase(i);
+    }
+
+    template<typename Predicate>
+    entry * find(Predicate &&pred) {
+      auto i = std::find_if(entries.begin(), entries.end(),
+                            [&pred](const auto &e) { return pred(*e); });
+      return i == entries.end() ? nullptr : i->get();
+    }
+
+    int handle(entry &e) {
+      switch(e.type) {
+      case kind::reader: {
+        if(e.reader->fd < 0) {
+          // Someone else already read this fd to EOF.
+          remove(&e);
+          return 0;
+        }
+
+        ssize_t size;
+        if((size = read(e.fd, buffer.data(), buffer.size())) < 0)
+          return errno == EINTR || errno == EAGAIN ? 0 : -1;
+        if(size == 0) {
+          e.reader->fd = -e.reader->fd;
+          remove(&e);
+        } else {
+          e.reader->append(buffer.data(), size);
+        }
+        return 1;
+      }
+      case kind::child: {
+        int status;
+        pid_t pid;
+        if((pid = waitpid(e.pid, &status, WNOHANG)) < 0)
+          return -1;
+        if(pid == 0)
+          return 0;
+        *e.status = status;
+        remove(&e);
+        return 1;
+      }
+      case kind::sigchld: {
+        char buf[64];
+        while(read(e.fd, buf, sizeof(buf)) > 0) {}
+        return reap_children();
+      }
+      default:
+        assert(false && "invalid entry kind");
+        return -1;
+      }
+    }
+
+    // Check on any children we don't have a pidfd for.
+    int reap_children() {
+      std::vector<const entry *> reaped;
+      for(auto &e : entries) {
+        if(e->type != kind::child || e->fd >= 0)
+          continue;
+
+        int status;
+        pid_t pid;
+        if((pid = waitpid(e->pid, &status, WNOHANG)) < 0)
+          return -1;
+        if(pid != 0) {
+          *e->status = status;
+          reaped.push_back(e.get());
+        }
+      }
+
+      for(auto *e : reaped)
+        remove(e);
+      return static_cast<int>(reaped.size());
+    }
+
+    int wait(int timeout_ms) {
+      int handled = 0;
+
+#ifdef __linux__
+      epoll_event events[64];
+      int count;
+      if((count = epoll_wait(epoll_fd, events, 64, timeout_ms)) < 0)
+        return errno == EINTR ? 0 : -1;
+
+      for(int i = 0; i != count; i++) {
+        int rv;
+        if((rv = handle(*static_cast<entry *>(events[i].data.ptr))) < 0)
+          return rv;
+        handled += rv;
+      }
+#else
+      std::vector<pollfd> fds;
+      std::vector<entry *> watched;
+      for(auto &e : entries) {
+        if(e->fd >= 0) {
+          fds.push_back({e->fd, POLLIN, 0});
+          watched.push_back(e.get());
+        }
+      }
+
+      if(::poll(fds.data(), fds.size(), timeout_ms) < 0)
+        return errno == EINTR ? 0 : -1;
+
+      for(std::size_t i = 0; i != fds.size(); i++) {
+        if(fds[i].revents == 0)
+          continue;
+
+        int rv;
+        if((rv = handle(*watched[i])) < 0)
+          return rv;
+        handled += rv;
+      }
+#endif
+
+      return handled;
+    }
+
+#ifdef __linux__
+    int epoll_fd;
+#endif
+    std::vector<std::unique_ptr<entry>> entries;
+    std::vector<char> buffer;
+  };
+
+  event_loop::event_loop(int sigchld_fd)
+    : impl_(std::make_unique<impl>(sigchld_fd)) {}
+
+  event_loop::~event_loop() = default;
+
+  int event_loop::watch(readfd &r) {
+    return impl_->add({impl::kind::reader, r.fd, &r});
+  }
+
+  int event_loop::unwatch(readfd &r) {
+    impl_->remove(impl_->find([&r](const impl::entry &e) {
+      return e.reader == &r;
+    }));
+    return 0;
+  }
+
+  int event_loop::watch_child(pid_t pid, std::optional<int> &status) {
+    int pidfd = open_pidfd(pid);
+    if(pidfd < 0) {
+      // We'll have to rely on SIGCHLD instead, so make sure we haven't already
+      // missed it.
+      int child_status;
+      pid_t rv;
+      if((rv = waitpid(pid, &child_status, WNOHANG)) < 0)
+        return -1;
+      if(rv != 0) {
+        status = child_status;
+        return 0;
+      }
+    }
+
+    if(impl_->add({impl::kind::child, pidfd, nullptr, pid, &status}) < 0) {
+      if(pidfd >= 0)
+        close(pidfd);
+      return -1;
+    }
+    return 0;
+  }
+
+  int event_loop::unwatch_child(pid_t pid) {
+    impl_->remove(impl_->find([pid](const impl::entry &e) {
+      return e.type == impl::kind::child && e.pid == pid;
+    }));
+    return 0;
+  }
+
+  int event_loop::wait(std::optional<clock::time_point> deadline) {
+    return impl_->wait(to_timeout_ms(deadline));
+  }
+
+} // namespace mettle::posix
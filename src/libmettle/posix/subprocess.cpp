@@ -1,25 +1,25 @@
 #include <mettle/driver/posix/subprocess.hpp>
 
+#include <algorithm>
 #include <cassert>
-#include <initializer_list>
-#include <thread>
+#include <cerrno>
+#include <chrono>
+#include <vector>
 
 #include <pthread.h>
 #include <signal.h>
-#include <sys/select.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
-#include <mettle/driver/exit_code.hpp>
+#ifdef __linux__
+#  include <poll.h>
+#else
+#  include <sys/select.h>
+#endif
 
 namespace mettle::posix {
 
   namespace {
-    [[noreturn]] void monitor_failed(std::initializer_list<int> pids = {}) {
-      for(int pid : pids)
-        kill(pid, SIGKILL);
-      _exit(exit_code::fatal);
-    }
+    constexpr std::size_t read_buffer_size = 64 * 1024;
 
     inline int size_to_status(int size) {
       if(size < 0)
@@ -29,42 +29,39 @@ namespace mettle::posix {
       errno = EIO;
       return -1;
     }
-  }
 
-  void make_timeout_monitor(std::chrono::milliseconds timeout) {
-    pid_t timer_pid;
-    if((timer_pid = fork()) < 0)
-      monitor_failed();
-    if(timer_pid == 0) {
-      std::this_thread::sleep_for(timeout);
-      _exit(exit_code::timeout);
+    inline timespec to_timespec(std::chrono::nanoseconds time) {
+      auto secs = std::chrono::duration_cast<std::chrono::seconds>(time);
+      return { static_cast<time_t>(secs.count()),
+               static_cast<long>((time - secs).count()) };
     }
 
-    pid_t test_pid;
-    if((test_pid = fork()) < 0)
-      monitor_failed({timer_pid});
-    if(test_pid != 0) {
-      // Wait for the first child process (the timer or the test) to finish,
-      // then kill (and wait) for the other one. If the timer finishes first,
-      // kill the test's entire process group.
-      int status;
-      pid_t exited_pid;
-      if((exited_pid = wait(&status)) < 0)
-        monitor_failed({timer_pid, test_pid});
-      if(kill(exited_pid == test_pid ? timer_pid : test_pid, SIGKILL) < 0)
-        monitor_failed({timer_pid, test_pid});
-      wait(nullptr);
-
-      if(WIFEXITED(status))
-        _exit(WEXITSTATUS(status));
-      else // WIFSIGNALED
-        raise(WTERMSIG(status));
-    }
-  }
+    // Wait for any of `dests` to become readable, filling `ready` with the
+    // ones that are.
+    int wait_readable(std::vector<readfd> &dests, std::vector<readfd *> &ready,
+                      const timespec *timeout, const sigset_t *sigmask) {
+      ready.clear();
 
-  int read_into(std::vector<readfd> &dests, const timespec *timeout,
-                const sigset_t *sigmask) {
-    while(true) {
+#ifdef __linux__
+      // Unlike pselect(2), ppoll(2) isn't limited to fds below FD_SETSIZE.
+      std::vector<pollfd> fds;
+      std::vector<readfd *> watched;
+      for(auto &i : dests) {
+        if(i.fd >= 0) {
+          fds.push_back({i.fd, POLLIN, 0});
+          watched.push_back(&i);
+        }
+      }
+
+      int rv = ppoll(fds.data(), fds.size(), timeout, sigmask);
+      if(rv <= 0)
+        return rv;
+
+      for(std::size_t i = 0; i != fds.size(); i++) {
+        if(fds[i].revents)
+          ready.push_back(watched[i]);
+      }
+#else
       int maxfd = -1;
       fd_set fds;
       FD_ZERO(&fds);
@@ -74,25 +71,58 @@ namespace mettle::posix {
           FD_SET(i.fd, &fds);
         }
       }
-      if(maxfd < 0)
-        return 0;
 
       int rv = pselect(maxfd + 1, &fds, nullptr, nullptr, timeout, sigmask);
       if(rv <= 0)
         return rv;
 
       for(auto &i : dests) {
-        if(i.fd >= 0 && FD_ISSET(i.fd, &fds)) {
-          ssize_t size;
-          char buf[BUFSIZ];
-
-          if((size = read(i.fd, buf, sizeof(buf))) < 0)
-            return size;
-          if(size == 0)
-            i.fd = -i.fd;
-          else
-            i.dest->append(buf, size);
-        }
+        if(i.fd >= 0 && FD_ISSET(i.fd, &fds))
+          ready.push_back(&i);
+      }
+#endif
+
+      return rv;
+    }
+  }
+
+  int read_into(std::vector<readfd> &dests, const timespec *timeout,
+                const sigset_t *sigmask) {
+    // The timeout applies to the whole call, not just to each wait, so that a
+    // steady trickle of output can't keep us reading forever.
+    using namespace std::chrono;
+    steady_clock::time_point deadline;
+    if(timeout)
+      deadline = steady_clock::now() + seconds(timeout->tv_sec) +
+                 nanoseconds(timeout->tv_nsec);
+
+    static thread_local std::vector<char> buf(read_buffer_size);
+    std::vector<readfd *> ready;
+    while(true) {
+      if(std::none_of(dests.begin(), dests.end(),
+                      [](const readfd &i) { return i.fd >= 0; }))
+        return 0;
+
+      timespec remaining;
+      if(timeout) {
+        remaining = to_timespec(std::max(
+          deadline - steady_clock::now(), steady_clock::duration::zero()
+        ));
+      }
+
+      int rv = wait_readable(dests, ready, timeout ? &remaining : nullptr,
+                             sigmask);
+      if(rv <= 0)
+        return rv;
+
+      for(auto *i : ready) {
+        ssize_t size;
+        if((size = read(i->fd, buf.data(), buf.size())) < 0)
+          return size;
+        if(size == 0)
+          i->fd = -i->fd;
+        else
+          i->append(buf.data(), size);
       }
     }
   }
@@ -102,7 +132,11 @@ namespace mettle::posix {
   }
 
   int recv_pgid(int fd, int *pgid) {
-    return size_to_status( read(fd, pgid, sizeof(*pgid)) );
+    // Other tests may finish while we're waiting, so retry if their SIGCHLD
+    // interrupts us.
+    ssize_t size;
+    while((size = read(fd, pgid, sizeof(*pgid))) < 0 && errno == EINTR) {}
+    return size_to_status(size);
   }
 
 } // namespace mettle::posix
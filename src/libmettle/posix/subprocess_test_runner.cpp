@@ -1,13 +1,18 @@
 #include <mettle/driver/subprocess_test_runner.hpp>
 
 #include <fcntl.h>
-#include <poll.h>
 #include <signal.h>
+#include <sys/select.h>
 #include <sys/wait.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
+#include <system_error>
 
 #include <mettle/driver/exit_code.hpp>
+#include <mettle/driver/posix/event_loop.hpp>
 #include <mettle/driver/posix/scoped_pipe.hpp>
 #include <mettle/driver/posix/scoped_signal.hpp>
 #include <mettle/driver/posix/subprocess.hpp>
@@ -29,11 +34,14 @@ namespace mettle {
 
   namespace {
     pid_t test_pgid = 0;
+    std::vector<pid_t> running_pgids;
     struct sigaction old_sigint, old_sigquit;
 
     void sig_handler(int signum) {
-      assert(test_pgid != 0);
-      killpg(test_pgid, signum);
+      if(test_pgid)
+        killpg(test_pgid, signum);
+      for(pid_t pgid : running_pgids)
+        killpg(pgid, signum);
 
       // Restore the previous signal action and re-raise the signal.
       struct sigaction *old_act = signum == SIGINT ? &old_sigint : &old_sigquit;
@@ -43,6 +51,13 @@ namespace mettle {
 
     void sig_chld(int) {}
 
+    int chld_fd = -1;
+    void sig_chld_notify(int) {
+      int old_errno = errno;
+      [[maybe_unused]] auto rv = write(chld_fd, "", 1);
+      errno = old_errno;
+    }
+
     test_result parent_failed(const char *file, std::size_t line) {
       if(test_pgid)
         killpg(test_pgid, SIGKILL);
@@ -62,43 +77,30 @@ namespace mettle {
     void atfork_close_fd() {
       close(fd_to_close);
     }
-  }
-
-  test_result subprocess_test_runner::operator ()(
-    const test_info &test, log::test_output &output
-  ) const {
-    assert(test_pgid == 0);
-
-    scoped_pipe stdout_pipe, stderr_pipe, pgid_pipe, log_pipe;
-    if(stdout_pipe.open() < 0 ||
-       stderr_pipe.open() < 0 ||
-       pgid_pipe.open() < 0 ||
-       log_pipe.open(O_CLOEXEC) < 0)
-      return PARENT_FAILED();
-
-    fflush(nullptr);
-
-    scoped_sigprocmask mask;
-    if(mask.push(SIG_BLOCK, SIGCHLD) < 0 ||
-       mask.push(SIG_BLOCK, {SIGINT, SIGQUIT}) < 0)
-      return PARENT_FAILED();
 
-    pid_t pid;
-    if((pid = fork()) < 0)
-      return PARENT_FAILED();
+    struct test_pipes {
+      int open() {
+        if(stdout_pipe.open() < 0 ||
+           stderr_pipe.open() < 0 ||
+           pgid_pipe.open() < 0 ||
+           log_pipe.open(O_CLOEXEC) < 0)
+          return -1;
+        return 0;
+      }
 
-    if(pid == 0) {
-      if(mask.clear() < 0)
-        child_failed();
+      scoped_pipe stdout_pipe, stderr_pipe, pgid_pipe, log_pipe;
+    };
 
-      if(stdout_pipe.close_read() < 0 ||
-         stderr_pipe.close_read() < 0 ||
-         pgid_pipe.close_read() < 0 ||
-         log_pipe.close_read() < 0)
+    [[noreturn]] void
+    run_test_child(const test_info &test, test_pipes &pipes) {
+      if(pipes.stdout_pipe.close_read() < 0 ||
+         pipes.stderr_pipe.close_read() < 0 ||
+         pipes.pgid_pipe.close_read() < 0 ||
+         pipes.log_pipe.close_read() < 0)
         child_failed();
 
-      if(stdout_pipe.move_write(STDOUT_FILENO) < 0 ||
-         stderr_pipe.move_write(STDERR_FILENO) < 0)
+      if(pipes.stdout_pipe.move_write(STDOUT_FILENO) < 0 ||
+         pipes.stderr_pipe.move_write(STDERR_FILENO) < 0)
         child_failed();
 
       // Make a new process group so we can kill the test and all its children
@@ -106,33 +108,212 @@ namespace mettle {
       if(setpgid(0, 0) < 0)
         child_failed();
 
-      if(send_pgid(pgid_pipe.write_fd, getpgid(0)) < 0)
+      if(send_pgid(pipes.pgid_pipe.write_fd, getpgid(0)) < 0)
         child_failed();
 
-      if(pgid_pipe.close_write() < 0)
+      if(pipes.pgid_pipe.close_write() < 0)
         child_failed();
 
-      if(timeout_)
-        make_timeout_monitor(*timeout_);
-
       auto result = test.function();
-      if(write(log_pipe.write_fd, result.message.c_str(),
+      if(write(pipes.log_pipe.write_fd, result.message.c_str(),
                result.message.length()) < 0)
         child_failed();
 
       fflush(nullptr);
 
       EXIT_FUNC(result.passed ? exit_code::success : exit_code::failure);
-    } else {
+    }
+
+    int start_test_parent(test_pipes &pipes, pid_t *pgid) {
+      if(pipes.stdout_pipe.close_write() < 0 ||
+         pipes.stderr_pipe.close_write() < 0 ||
+         pipes.pgid_pipe.close_write() < 0 ||
+         pipes.log_pipe.close_write() < 0)
+        return -1;
+
+      return recv_pgid(pipes.pgid_pipe.read_fd, pgid);
+    }
+
+    test_result timeout_result(std::chrono::milliseconds timeout) {
+      std::ostringstream ss;
+      ss << "Timed out after " << timeout.count() << " ms";
+      return { false, ss.str() };
+    }
+
+    test_result cancelled_result() {
+      return { false, "Cancelled" };
+    }
+
+    test_result test_status_result(int status, std::string message) {
+      if(WIFEXITED(status)) {
+        return { WEXITSTATUS(status) == exit_code::success,
+                 std::move(message) };
+      } else { // WIFSIGNALED
+        return { false, strsignal(WTERMSIG(status)) };
+      }
+    }
+
+    struct runner_signals {
+      runner_signals() {
+        assert(chld_fd == -1);
+
+        if(chld_pipe.open(O_CLOEXEC) < 0 ||
+           fcntl(chld_pipe.read_fd, F_SETFL, O_NONBLOCK) < 0 ||
+           fcntl(chld_pipe.write_fd, F_SETFL, O_NONBLOCK) < 0)
+          throw std::system_error(errno, std::system_category());
+        chld_fd = chld_pipe.write_fd;
+
+        if(sigaction(SIGINT, nullptr, &old_sigint) < 0 ||
+           sigaction(SIGQUIT, nullptr, &old_sigquit) < 0 ||
+           sigint.open(SIGINT, sig_handler) < 0 ||
+           sigquit.open(SIGQUIT, sig_handler) < 0 ||
+           sigchld.open(SIGCHLD, sig_chld_notify) < 0)
+          throw std::system_error(errno, std::system_category());
+      }
+
+      ~runner_signals() {
+        chld_fd = -1;
+      }
+
+      // Restore the original signal handlers in a newly-forked child.
+      int close_child() {
+        if(sigint.close() < 0 ||
+           sigquit.close() < 0 ||
+           sigchld.close() < 0)
+          return -1;
+
+        // The child is free to make its own test runners, so forget about ours.
+        running_pgids.clear();
+        chld_fd = -1;
+        return 0;
+      }
+
+      // SIGCHLD writes to this pipe so that we can wait for it alongside the
+      // tests' output.
+      scoped_pipe chld_pipe;
       scoped_sigaction sigint, sigquit, sigchld;
+    };
 
-      if(stdout_pipe.close_write() < 0 ||
-         stderr_pipe.close_write() < 0 ||
-         pgid_pipe.close_write() < 0 ||
-         log_pipe.close_write() < 0)
-        return PARENT_FAILED();
+    int watch_all(event_loop &loop, std::vector<readfd> &dests, pid_t pid,
+                  std::optional<int> &status) {
+      for(auto &d : dests) {
+        if(loop.watch(d) < 0)
+          return -1;
+      }
+      return loop.watch_child(pid, status);
+    }
+
+    void unwatch_all(event_loop &loop, std::vector<readfd> &dests, pid_t pid) {
+      for(auto &d : dests)
+        loop.unwatch(d);
+      loop.unwatch_child(pid);
+    }
+
+    void forget_pgid(pid_t pgid) {
+      auto i = std::find(running_pgids.begin(), running_pgids.end(), pgid);
+      if(i != running_pgids.end())
+        running_pgids.erase(i);
+    }
+
+    int write_all(int fd, const void *buf, std::size_t size) {
+      auto data = static_cast<const char *>(buf);
+      while(size) {
+        ssize_t written = write(fd, data, size);
+        if(written < 0) {
+          if(errno == EINTR)
+            continue;
+          return -1;
+        }
+        data += written;
+        size -= written;
+      }
+      return 0;
+    }
+
+    // Wait for a child to exit, giving up once `deadline` (if any) passes.
+    // SIGCHLD should be blocked when calling this; it's unblocked only while
+    // we sleep, so that we can't miss it. Returns 1 if the child exited, 0 if
+    // we ran out of time, and -1 on error.
+    int wait_child(
+      pid_t pid, int &status,
+      std::optional<std::chrono::steady_clock::time_point> deadline
+    ) {
+      using namespace std::chrono;
+      sigset_t empty;
+      sigemptyset(&empty);
+      while(true) {
+        pid_t rv = waitpid(pid, &status, WNOHANG);
+        if(rv < 0 && errno != EINTR)
+          return -1;
+        if(rv == pid)
+          return 1;
+
+        timespec remaining, *timeout = nullptr;
+        if(deadline) {
+          auto left = *deadline - steady_clock::now();
+          if(left <= steady_clock::duration::zero())
+            return 0;
+          auto secs = duration_cast<seconds>(left);
+          remaining = { static_cast<time_t>(secs.count()), static_cast<long>(
+            duration_cast<nanoseconds>(left - secs).count()
+          ) };
+          timeout = &remaining;
+        }
+
+        if(pselect(0, nullptr, nullptr, nullptr, timeout, &empty) < 0 &&
+           errno != EINTR)
+          return -1;
+      }
+    }
+
+    ssize_t read_all(int fd, void *buf, std::size_t size) {
+      auto data = static_cast<char *>(buf);
+      std::size_t total = 0;
+      while(total != size) {
+        ssize_t got = read(fd, data + total, size - total);
+        if(got < 0) {
+          if(errno == EINTR)
+            continue;
+          return -1;
+        }
+        if(got == 0)
+          break;
+        total += got;
+      }
+      return total;
+    }
+  }
+
+  test_result subprocess_test_runner::operator ()(
+    const test_info &test, log::test_output &output
+  ) const {
+    assert(test_pgid == 0);
 
-      if(recv_pgid(pgid_pipe.read_fd, &test_pgid) < 0)
+    test_pipes pipes;
+    if(pipes.open() < 0)
+      return PARENT_FAILED();
+
+    fflush(nullptr);
+
+    scoped_sigprocmask mask;
+    if(mask.push(SIG_BLOCK, SIGCHLD) < 0 ||
+       mask.push(SIG_BLOCK, {SIGINT, SIGQUIT}) < 0)
+      return PARENT_FAILED();
+
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid;
+    if((pid = fork()) < 0)
+      return PARENT_FAILED();
+
+    if(pid == 0) {
+      if(mask.clear() < 0)
+        child_failed();
+      run_test_child(test, pipes);
+    } else {
+      scoped_sigaction sigint, sigquit, sigchld;
+
+      if(start_test_parent(pipes, &test_pgid) < 0)
         return PARENT_FAILED();
 
       if(sigaction(SIGINT, nullptr, &old_sigint) < 0 ||
@@ -148,27 +329,63 @@ namespace mettle {
         return PARENT_FAILED();
 
       std::string message;
+      log::output_capture stdout_capture(output_limit_),
+                          stderr_capture(output_limit_);
       std::vector<readfd> dests = {
-        {stdout_pipe.read_fd, &output.stdout_log},
-        {stderr_pipe.read_fd, &output.stderr_log},
-        {log_pipe.read_fd,    &message}
+        {pipes.stdout_pipe.read_fd, nullptr, &stdout_capture},
+        {pipes.stderr_pipe.read_fd, nullptr, &stderr_capture},
+        {pipes.log_pipe.read_fd,    &message}
       };
 
-      // Read from the piped stdout, stderr, and log. If we're interrupted
-      // (probably by SIGCHLD), do one last non-blocking read to get any data we
-      // might have missed.
+      // Read from the piped stdout, stderr, and log until the test exits or
+      // the timeout expires. If we're interrupted (probably by SIGCHLD), do
+      // one last non-blocking read to get any data we might have missed.
+      timespec remaining, *timeout = nullptr;
+      if(timeout_) {
+        using namespace std::chrono;
+        auto left = std::max(start + *timeout_ - steady_clock::now(),
+                             steady_clock::duration::zero());
+        auto secs = duration_cast<seconds>(left);
+        remaining = { static_cast<time_t>(secs.count()), static_cast<long>(
+          duration_cast<nanoseconds>(left - secs).count()
+        ) };
+        timeout = &remaining;
+      }
+
       sigset_t empty;
       sigemptyset(&empty);
-      if(read_into(dests, nullptr, &empty) < 0) {
+      bool timed_out = false;
+      if(read_into(dests, timeout, &empty) < 0) {
         if(errno != EINTR)
           return PARENT_FAILED();
         timespec timeout = {0, 0};
         if(read_into(dests, &timeout, nullptr) < 0)
           return PARENT_FAILED();
+      } else if(timeout && std::any_of(dests.begin(), dests.end(),
+                                       [](const readfd &d) {
+                                         return d.fd >= 0;
+                                       })) {
+        // We ran out of time before the test finished, so kill it.
+        killpg(test_pgid, SIGKILL);
+        timed_out = true;
       }
 
+      // The test might have closed its pipes without exiting, so keep to the
+      // deadline while waiting for it too.
       int status;
-      if(waitpid(pid, &status, 0) < 0)
+      if(!timed_out) {
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if(timeout_)
+          deadline = start + *timeout_;
+        int rv = wait_child(pid, status, deadline);
+        if(rv < 0)
+          return PARENT_FAILED();
+        if(rv == 0) {
+          killpg(test_pgid, SIGKILL);
+          timed_out = true;
+        }
+      }
+      if(timed_out && waitpid(pid, &status, 0) < 0)
         return PARENT_FAILED();
 
       // Make sure everything in the test's process group is dead. Don't worry
@@ -176,19 +393,669 @@ namespace mettle {
       killpg(test_pgid, SIGKILL);
       test_pgid = 0;
 
-      if(WIFEXITED(status)) {
-        int exit_status = WEXITSTATUS(status);
-        if(exit_status == exit_code::timeout) {
-          std::ostringstream ss;
-          ss << "Timed out after " << timeout_->count() << " ms";
-          return { false, ss.str() };
+      output = log::collect_output(stdout_capture, stderr_capture);
+      if(timed_out)
+        return timeout_result(*timeout_);
+      return test_status_result(status, std::move(message));
+    }
+  }
+
+  struct parallel_test_runner::running_test {
+    pid_t pid, pgid;
+    test_pipes pipes;
+    std::string message;
+    log::output_capture stdout_capture, stderr_capture;
+    log::test_output output;
+    std::vector<readfd> dests;
+    std::optional<int> status;
+    bool timed_out = false;
+    std::chrono::steady_clock::time_point start;
+    callback_type done;
+  };
+
+  struct parallel_test_runner::signal_state : runner_signals {};
+
+  parallel_test_runner::parallel_test_runner(std::size_t jobs,
+                                             timeout_t timeout,
+                                             log::capture_limit output_limit)
+    : jobs_(jobs), timeout_(timeout), output_limit_(output_limit),
+      signals_(std::make_unique<signal_state>()),
+      loop_(std::make_unique<event_loop>(signals_->chld_pipe.read_fd)) {
+    assert(jobs_ > 0);
+  }
+
+  parallel_test_runner::~parallel_test_runner() {
+    scoped_sigprocmask mask;
+    mask.push(SIG_BLOCK, {SIGINT, SIGQUIT});
+    for(auto &i : running_) {
+      killpg(i->pgid, SIGKILL);
+      waitpid(i->pid, nullptr, 0);
+    }
+    running_pgids.clear();
+  }
+
+  void parallel_test_runner::run(const test_name &, const test_info &test,
+                                 callback_type done) {
+    while(running_.size() >= jobs_) {
+      if(wait_any() < 0)
+        abort_all(PARENT_FAILED());
+      if(cancelled_)
+        abort_all(cancelled_result());
+    }
+    // Don't start any more tests once we've been cancelled.
+    if(cancelled_)
+      return;
+
+    auto t = std::make_unique<running_test>();
+    t->done = std::move(done);
+    if(t->pipes.open() < 0)
+      return t->done(PARENT_FAILED(), {}, {});
+
+    fflush(nullptr);
+
+    scoped_sigprocmask mask;
+    if(mask.push(SIG_BLOCK, {SIGINT, SIGQUIT}) < 0)
+      return t->done(PARENT_FAILED(), {}, {});
+
+    t->start = std::chrono::steady_clock::now();
+    if((t->pid = fork()) < 0)
+      return t->done(PARENT_FAILED(), {}, {});
+
+    if(t->pid == 0) {
+      if(signals_->close_child() < 0 || mask.clear() < 0)
+        child_failed();
+      run_test_child(test, t->pipes);
+    }
+
+    if(start_test_parent(t->pipes, &t->pgid) < 0) {
+      kill(t->pid, SIGKILL);
+      waitpid(t->pid, nullptr, 0);
+      return t->done(PARENT_FAILED(), {}, {});
+    }
+
+    t->stdout_capture = log::output_capture(output_limit_);
+    t->stderr_capture = log::output_capture(output_limit_);
+    t->dests = {
+      {t->pipes.stdout_pipe.read_fd, nullptr, &t->stdout_capture},
+      {t->pipes.stderr_pipe.read_fd, nullptr, &t->stderr_capture},
+      {t->pipes.log_pipe.read_fd,    &t->message}
+    };
+    if(watch_all(*loop_, t->dests, t->pid, t->status) < 0) {
+      unwatch_all(*loop_, t->dests, t->pid);
+      killpg(t->pgid, SIGKILL);
+      waitpid(t->pid, nullptr, 0);
+      return t->done(PARENT_FAILED(), {}, {});
+    }
+
+    running_pgids.push_back(t->pgid);
+    running_.push_back(std::move(t));
+  }
+
+  void parallel_test_runner::wait() {
+    while(!running_.empty()) {
+      if(wait_any() < 0)
+        abort_all(PARENT_FAILED());
+      if(cancelled_)
+        abort_all(cancelled_result());
+    }
+    cancelled_ = false;
+  }
+
+  void parallel_test_runner::cancel() {
+    // We might be inside `wait_any`, so just make a note of this; we'll kill
+    // the running tests once it returns.
+    cancelled_ = true;
+  }
+
+  int parallel_test_runner::wait_any() {
+    while(true) {
+      // Finish any tests that have exited. A test that closed all its pipes
+      // isn't necessarily done, so we keep watching it (and its deadline)
+      // until it actually exits.
+      bool finished = false;
+      for(auto i = running_.begin(); i != running_.end();) {
+        auto &t = **i;
+        if(t.status) {
+          auto done = std::move(*i);
+          i = running_.erase(i);
+          finish(*done);
+          finished = true;
         } else {
-          return { exit_status == exit_code::success, message };
+          ++i;
         }
-      } else { // WIFSIGNALED
-        return { false, strsignal(WTERMSIG(status)) };
+      }
+      if(finished)
+        return 0;
+
+      // Wake up when the earliest running test is due to time out.
+      std::optional<event_loop::clock::time_point> deadline;
+      if(timeout_) {
+        for(auto &t : running_) {
+          if(!t->timed_out && (!deadline || t->start + *timeout_ < *deadline))
+            deadline = t->start + *timeout_;
+        }
+      }
+
+      waiting();
+      if(loop_->wait(deadline) < 0)
+        return -1;
+
+      // Kill any tests that have run out of time; we'll see them exit shortly.
+      if(timeout_) {
+        auto now = event_loop::clock::now();
+        for(auto &t : running_) {
+          if(!t->timed_out && !t->status && now >= t->start + *timeout_) {
+            killpg(t->pgid, SIGKILL);
+            t->timed_out = true;
+          }
+        }
+      }
+    }
+  }
+
+  void parallel_test_runner::finish(running_test &t) {
+    unwatch_all(*loop_, t.dests, t.pid);
+
+    // Do one last non-blocking read to get any data we might have missed.
+    timespec timeout = {0, 0};
+    test_result result;
+    if(read_into(t.dests, &timeout, nullptr) < 0)
+      result = PARENT_FAILED();
+    else if(t.timed_out)
+      result = timeout_result(*timeout_);
+    else
+      result = test_status_result(*t.status, std::move(t.message));
+
+    // Make sure everything in the test's process group is dead. Don't worry
+    // about reaping.
+    {
+      scoped_sigprocmask mask;
+      mask.push(SIG_BLOCK, {SIGINT, SIGQUIT});
+      killpg(t.pgid, SIGKILL);
+      forget_pgid(t.pgid);
+    }
+
+    using namespace std::chrono;
+    auto duration = duration_cast<log::test_duration>(
+      steady_clock::now() - t.start
+    );
+    t.output = log::collect_output(t.stdout_capture, t.stderr_capture);
+    t.done(result, t.output, duration);
+  }
+
+  void parallel_test_runner::abort_all(const test_result &result) {
+    scoped_sigprocmask mask;
+    mask.push(SIG_BLOCK, {SIGINT, SIGQUIT});
+
+    auto running = std::move(running_);
+    running_.clear();
+    for(auto &t : running) {
+      unwatch_all(*loop_, t->dests, t->pid);
+      killpg(t->pgid, SIGKILL);
+      waitpid(t->pid, nullptr, 0);
+      forget_pgid(t->pgid);
+    }
+    for(auto &t : running) {
+      t->output = log::collect_output(t->stdout_capture, t->stderr_capture);
+      t->done(result, t->output, {});
+    }
+  }
+
+  namespace {
+    struct worker_result {
+      std::uint32_t passed;
+      std::uint32_t length;
+    };
+  }
+
+  struct worker_test_runner::worker {
+    // Close every pipe we're holding onto. New workers call this for their
+    // siblings so that they don't keep each others' control pipes open.
+    void close_pipes() {
+      for(auto *p : {&control_pipe, &stdout_pipe, &stderr_pipe, &pgid_pipe,
+                     &result_pipe}) {
+        p->close_read();
+        p->close_write();
+      }
+    }
+
+    pid_t pid, pgid;
+    scoped_pipe control_pipe, stdout_pipe, stderr_pipe, pgid_pipe, result_pipe;
+    std::vector<readfd> dests;
+    std::string results;
+    log::output_capture stdout_capture, stderr_capture;
+    std::optional<int> status;
+    std::size_t group;
+    std::optional<std::size_t> current;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  struct worker_test_runner::signal_state : runner_signals {
+    // Ignore SIGPIPE so that sending a test to a worker that just died fails
+    // with EPIPE instead of killing us.
+    scoped_sigaction sigpipe;
+  };
+
+  worker_test_runner::worker_test_runner(std::size_t jobs, timeout_t timeout,
+                                         isolation_level isolation,
+                                         log::capture_limit output_limit)
+    : jobs_(jobs), timeout_(timeout), isolation_(isolation),
+      output_limit_(output_limit),
+      signals_(std::make_unique<signal_state>()),
+      loop_(std::make_unique<event_loop>(signals_->chld_pipe.read_fd)) {
+    assert(jobs_ > 0);
+    if(signals_->sigpipe.open(SIGPIPE, SIG_IGN) < 0)
+      throw std::system_error(errno, std::system_category());
+  }
+
+  worker_test_runner::~worker_test_runner() {
+    for(auto &w : workers_)
+      stop_worker(w, true);
+  }
+
+  void worker_test_runner::run(const test_name &name, const test_info &test,
+                               callback_type done) {
+    if(cancelled_)
+      return;
+
+    auto level = isolation_;
+    auto attr = test.attrs.find(isolation.name());
+    if(attr != test.attrs.end() && !attr->value.empty()) {
+      auto value = *attr->value.begin();
+      if(auto parsed = parse_isolation(value)) {
+        level = *parsed;
+      } else {
+        // Don't quietly run the test at the wrong level if the attribute was
+        // misspelled.
+        return done({false, "invalid isolation level \"" +
+                            std::string(value) + "\""}, {}, {});
+      }
+    }
+
+    // Just queue the test up for now. We don't start any workers until we're
+    // waiting, so that every worker knows about every test in the queue.
+    std::size_t group;
+    switch(level) {
+    case isolation_level::none:
+      // Running these inline would start them ahead of the tests queued
+      // before them (and without a timeout), so give them a worker of their
+      // own that runs them in order.
+      if(!none_group_) {
+        none_group_ = groups_.size();
+        groups_.emplace_back();
+      }
+      group = *none_group_;
+      break;
+    case isolation_level::file:
+      if(!file_group_) {
+        file_group_ = groups_.size();
+        groups_.emplace_back().shared = true;
+      }
+      group = *file_group_;
+      break;
+    case isolation_level::suite: {
+      auto i = suite_groups_.emplace(name.suites, groups_.size());
+      if(i.second)
+        groups_.emplace_back();
+      group = i.first->second;
+      break;
+    }
+    default:
+      group = groups_.size();
+      groups_.emplace_back();
+      break;
+    }
+
+    groups_[group].tests.push_back(queue_.size());
+    queue_.push_back({&test, std::move(done)});
+    pending_++;
+  }
+
+  void worker_test_runner::wait() {
+    auto busy = [this]() {
+      return std::any_of(workers_.begin(), workers_.end(), [](auto &w) {
+        return w && w->current;
+      });
+    };
+
+    while(pending_ || busy()) {
+      if(cancelled_) {
+        abort_all(cancelled_result(), false);
+        break;
+      }
+
+      // Hand the next tests in line to any idle workers, starting new workers
+      // as needed.
+      for(std::size_t i = 0; i != jobs_ && pending_; i++) {
+        if(i == workers_.size())
+          workers_.emplace_back();
+        auto &w = workers_[i];
+        if(w && w->current)
+          continue;
+
+        // Once a worker's group is out of tests, retire it; the next group
+        // gets a fresh worker.
+        if(w && !groups_[w->group].pending())
+          stop_worker(w, false);
+
+        if(w && send_test(*w) < 0) {
+          if(errno != EPIPE) {
+            abort_all(PARENT_FAILED());
+            break;
+          }
+
+          // The worker died while it was idle, so replace it.
+          auto group = w->group;
+          stop_worker(w, true);
+          if(start_worker(w, group) < 0 || send_test(*w) < 0) {
+            abort_all(PARENT_FAILED());
+            break;
+          }
+        }
+
+        if(!w) {
+          auto group = next_group();
+          if(!group)
+            continue;
+          if(start_worker(w, *group) < 0 || send_test(*w) < 0) {
+            abort_all(PARENT_FAILED());
+            break;
+          }
+        }
+      }
+
+      if(busy() && wait_any() < 0)
+        abort_all(PARENT_FAILED());
+    }
+
+    for(auto &w : workers_)
+      stop_worker(w, false);
+    workers_.clear();
+    queue_.clear();
+    groups_.clear();
+    suite_groups_.clear();
+    cancelled_ = false;
+    file_group_.reset();
+    none_group_.reset();
+    first_group_ = 0;
+  }
+
+  void worker_test_runner::cancel() {
+    // As with `parallel_test_runner`, we might be in the middle of a
+    // callback, so we'll stop the workers the next time around the loop.
+    cancelled_ = true;
+  }
+
+  std::optional<std::size_t> worker_test_runner::next_group() {
+    // Every group before `first_group_` has already had all its tests handed
+    // out, so we only need to look at the groups after that.
+    while(first_group_ != groups_.size() && !groups_[first_group_].pending())
+      first_group_++;
+
+    for(std::size_t i = first_group_; i != groups_.size(); i++) {
+      auto &g = groups_[i];
+      if(g.pending() && (g.workers == 0 || g.shared))
+        return i;
+    }
+    return std::nullopt;
+  }
+
+  int worker_test_runner::start_worker(std::unique_ptr<worker> &w,
+                                       std::size_t group) {
+    w = std::make_unique<worker>();
+    w->group = group;
+    if(w->control_pipe.open() < 0 ||
+       w->stdout_pipe.open() < 0 ||
+       w->stderr_pipe.open() < 0 ||
+       w->pgid_pipe.open() < 0 ||
+       w->result_pipe.open() < 0)
+      return -1;
+
+    fflush(nullptr);
+
+    scoped_sigprocmask mask;
+    if(mask.push(SIG_BLOCK, {SIGINT, SIGQUIT}) < 0)
+      return -1;
+
+    if((w->pid = fork()) < 0)
+      return -1;
+
+    if(w->pid == 0) {
+      if(signals_->close_child() < 0 ||
+         signals_->sigpipe.close() < 0 ||
+         mask.clear() < 0)
+        child_failed();
+
+      for(auto &i : workers_) {
+        if(i && i != w)
+          i->close_pipes();
+      }
+
+      if(w->control_pipe.close_write() < 0 ||
+         w->stdout_pipe.close_read() < 0 ||
+         w->stderr_pipe.close_read() < 0 ||
+         w->pgid_pipe.close_read() < 0 ||
+         w->result_pipe.close_read() < 0)
+        child_failed();
+
+      if(w->stdout_pipe.move_write(STDOUT_FILENO) < 0 ||
+         w->stderr_pipe.move_write(STDERR_FILENO) < 0)
+        child_failed();
+
+      // Make a new process group so we can kill the worker and all its
+      // children as a group.
+      if(setpgid(0, 0) < 0)
+        child_failed();
+
+      if(send_pgid(w->pgid_pipe.write_fd, getpgid(0)) < 0)
+        child_failed();
+
+      if(w->pgid_pipe.close_write() < 0)
+        child_failed();
+
+      // Run each test we're sent until the parent closes the control pipe.
+      std::uint32_t index;
+      ssize_t size;
+      while((size = read_all(w->control_pipe.read_fd, &index,
+                             sizeof(index))) == sizeof(index)) {
+        auto result = queue_[index].test->function();
+        fflush(nullptr);
+
+        worker_result header = {
+          result.passed, static_cast<std::uint32_t>(result.message.length())
+        };
+        if(write_all(w->result_pipe.write_fd, &header, sizeof(header)) < 0 ||
+           write_all(w->result_pipe.write_fd, result.message.c_str(),
+                     result.message.length()) < 0)
+          child_failed();
+      }
+      if(size != 0)
+        child_failed();
+
+      fflush(nullptr);
+      EXIT_FUNC(exit_code::success);
+    }
+
+    if(w->control_pipe.close_read() < 0 ||
+       w->stdout_pipe.close_write() < 0 ||
+       w->stderr_pipe.close_write() < 0 ||
+       w->pgid_pipe.close_write() < 0 ||
+       w->result_pipe.close_write() < 0 ||
+       recv_pgid(w->pgid_pipe.read_fd, &w->pgid) < 0 ||
+       w->pgid_pipe.close_read() < 0) {
+      kill(w->pid, SIGKILL);
+      waitpid(w->pid, nullptr, 0);
+      w.reset();
+      return -1;
+    }
+
+    w->stdout_capture = log::output_capture(output_limit_);
+    w->stderr_capture = log::output_capture(output_limit_);
+    w->dests = {
+      {w->stdout_pipe.read_fd, nullptr, &w->stdout_capture},
+      {w->stderr_pipe.read_fd, nullptr, &w->stderr_capture},
+      {w->result_pipe.read_fd, &w->results}
+    };
+    if(watch_all(*loop_, w->dests, w->pid, w->status) < 0) {
+      unwatch_all(*loop_, w->dests, w->pid);
+      killpg(w->pgid, SIGKILL);
+      waitpid(w->pid, nullptr, 0);
+      w.reset();
+      return -1;
+    }
+
+    running_pgids.push_back(w->pgid);
+    groups_[group].workers++;
+    return 0;
+  }
+
+  int worker_test_runner::send_test(worker &w) {
+    auto &group = groups_[w.group];
+    std::uint32_t index = group.tests[group.next];
+    if(write_all(w.control_pipe.write_fd, &index, sizeof(index)) < 0)
+      return -1;
+
+    w.current = index;
+    group.next++;
+    pending_--;
+    w.stdout_capture.clear();
+    w.stderr_capture.clear();
+    w.start = std::chrono::steady_clock::now();
+    return 0;
+  }
+
+  int worker_test_runner::wait_any() {
+    using namespace std::chrono;
+
+    // Wake up when the earliest running test is due to time out.
+    std::optional<event_loop::clock::time_point> deadline;
+    if(timeout_) {
+      for(auto &w : workers_) {
+        if(w && w->current && (!deadline || w->start + *timeout_ < *deadline))
+          deadline = w->start + *timeout_;
+      }
+    }
+
+    waiting();
+    if(loop_->wait(deadline) < 0)
+      return -1;
+
+    auto now = steady_clock::now();
+    for(auto &w : workers_) {
+      if(!w)
+        continue;
+      if(read_results(*w) < 0)
+        return -1;
+
+      bool timed_out = !w->status && w->current && timeout_ &&
+                       now >= w->start + *timeout_;
+      if(timed_out)
+        killpg(w->pgid, SIGKILL);
+
+      // If the worker closed its pipes without exiting, keep watching it until
+      // it exits or times out. Once it's been killed, though, it'll be gone
+      // shortly, so just reap it now.
+      if(!w->status && timed_out) {
+        int status;
+        loop_->unwatch_child(w->pid);
+        if(waitpid(w->pid, &status, 0) < 0)
+          return -1;
+        w->status = status;
+      }
+
+      if(w->status) {
+        // The worker is dead. Do one last non-blocking read to get any data we
+        // might have missed, and then fail whatever test it was running.
+        timespec timeout = {0, 0};
+        if(read_into(w->dests, &timeout, nullptr) < 0 || read_results(*w) < 0)
+          return -1;
+
+        if(w->current) {
+          finish(*w, timed_out ? timeout_result(*timeout_) :
+                 test_status_result(*w->status, ""));
+        }
+        stop_worker(w, true);
+      }
+    }
+    return 0;
+  }
+
+  int worker_test_runner::read_results(worker &w) {
+    worker_result header;
+    while(w.current && w.results.size() >= sizeof(header)) {
+      std::memcpy(&header, w.results.data(), sizeof(header));
+      if(w.results.size() < sizeof(header) + header.length)
+        break;
+
+      // The worker wrote all of the test's output before sending its result,
+      // so pick up whatever's left in the pipes.
+      timespec timeout = {0, 0};
+      if(read_into(w.dests, &timeout, nullptr) < 0)
+        return -1;
+
+      std::string message = w.results.substr(sizeof(header), header.length);
+      w.results.erase(0, sizeof(header) + header.length);
+      finish(w, { header.passed != 0, std::move(message) });
+    }
+    return 0;
+  }
+
+  void worker_test_runner::finish(worker &w, const test_result &result) {
+    auto &test = queue_[*w.current];
+    w.current.reset();
+
+    using namespace std::chrono;
+    auto duration = duration_cast<log::test_duration>(
+      steady_clock::now() - w.start
+    );
+    auto output = log::collect_output(w.stdout_capture, w.stderr_capture);
+    test.done(result, output, duration);
+  }
+
+  void worker_test_runner::stop_worker(std::unique_ptr<worker> &w,
+                                       bool force) {
+    if(!w)
+      return;
+
+    unwatch_all(*loop_, w->dests, w->pid);
+    if(!w->status) {
+      if(force) {
+        killpg(w->pgid, SIGKILL);
+      } else {
+        // Closing the control pipe tells the worker to exit. Close our ends of
+        // its output pipes too, so it can't block trying to write to them.
+        w->control_pipe.close_write();
+        w->stdout_pipe.close_read();
+        w->stderr_pipe.close_read();
+        w->result_pipe.close_read();
+      }
+      waitpid(w->pid, nullptr, 0);
+    }
+
+    // Make sure everything in the worker's process group is dead. Don't worry
+    // about reaping.
+    scoped_sigprocmask mask;
+    mask.push(SIG_BLOCK, {SIGINT, SIGQUIT});
+    killpg(w->pgid, SIGKILL);
+    forget_pgid(w->pgid);
+    groups_[w->group].workers--;
+    w.reset();
+  }
+
+  void worker_test_runner::abort_all(const test_result &result,
+                                     bool fail_queued) {
+    for(auto &w : workers_) {
+      if(w && w->current)
+        finish(*w, result);
+      stop_worker(w, true);
+    }
+    for(auto &g : groups_) {
+      for(; g.pending(); g.next++) {
+        if(fail_queued)
+          queue_[g.tests[g.next]].done(result, {}, {});
       }
     }
+    pending_ = 0;
   }
 
   int make_fd_private(int fd) {
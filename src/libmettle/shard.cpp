@@ -0,0 +1,92 @@
+#include <mettle/driver/shard.hpp>
+#include <mettle/driver/test_history.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace mettle {
+
+  test_timings
+  read_test_timings(std::istream &is, const std::string &test_file) {
+    std::string line;
+
+    // History files from `--history` can be used as timing files too.
+    auto start = is.tellg();
+    if(std::getline(is, line) && line == test_history::file_header) {
+      is.seekg(start);
+      test_history history;
+      history.read(is);
+      return history.timings(test_file);
+    }
+    is.clear();
+    is.seekg(start);
+
+    test_timings timings;
+    for(std::size_t lineno = 1; std::getline(is, line); lineno++) {
+      if(!line.empty() && line.back() == '\r')
+        line.pop_back();
+      if(line.empty() || line[0] == '#')
+        continue;
+
+      std::size_t end;
+      unsigned long long ms;
+      try {
+        ms = std::stoull(line, &end);
+      } catch(...) {
+        end = 0;
+      }
+      if(end == 0 || end == line.size() || !std::isspace(
+        static_cast<unsigned char>(line[end])
+      )) {
+        std::ostringstream ss;
+        ss << "invalid timing on line " << lineno;
+        throw std::invalid_argument(ss.str());
+      }
+
+      timings[line.substr(end + 1)] = std::chrono::milliseconds(ms);
+    }
+    return timings;
+  }
+
+  test_timings
+  read_test_timings(const std::string &file, const std::string &test_file) {
+    std::ifstream is(file);
+    if(!is)
+      throw std::runtime_error("unable to open timing file \"" + file + "\"");
+    return read_test_timings(is, test_file);
+  }
+
+  std::vector<test_uid>
+  pick_shard(std::vector<weighted_test> tests, std::size_t index,
+             std::size_t count) {
+    // Sort by a key that doesn't depend on the order tests were defined in,
+    // so shards agree even if they see the tests in a different order.
+    std::sort(tests.begin(), tests.end(), [](const auto &a, const auto &b) {
+      if(a.duration != b.duration)
+        return a.duration > b.duration;
+      if(a.hash != b.hash)
+        return a.hash < b.hash;
+      return a.id < b.id;
+    });
+
+    // Break ties by the number of tests in each shard, so that lots of very
+    // short tests still get spread out.
+    std::vector<std::pair<std::chrono::milliseconds, std::size_t>> load(
+      count, {std::chrono::milliseconds(0), 0}
+    );
+    std::vector<test_uid> result;
+    for(const auto &test : tests) {
+      auto shard = std::min_element(load.begin(), load.end()) - load.begin();
+      load[shard].first += test.duration;
+      load[shard].second++;
+      if(static_cast<std::size_t>(shard) == index)
+        result.push_back(test.id);
+    }
+    return result;
+  }
+
+} // namespace mettle
@@ -0,0 +1,89 @@
+#include <mettle/driver/test_failures.hpp>
+#include "tsv.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace mettle {
+
+  void test_failures::read(std::istream &is) {
+    std::string line;
+    if(!std::getline(is, line))
+      return;
+    if(line != file_header)
+      throw std::invalid_argument("unrecognized failures file");
+
+    for(std::size_t lineno = 2; std::getline(is, line); lineno++) {
+      if(line.empty())
+        continue;
+
+      auto fields = detail::tsv_split(line, '\t');
+      if(fields[0] == "file" && fields.size() == 2) {
+        add_file(detail::tsv_unescape(fields[1]));
+      } else if(fields[0] == "test" && fields.size() == 3) {
+        add_test(detail::tsv_unescape(fields[1]),
+                 detail::tsv_unescape(fields[2]));
+      } else {
+        std::ostringstream ss;
+        ss << "invalid failures on line " << lineno;
+        throw std::invalid_argument(ss.str());
+      }
+    }
+  }
+
+  void test_failures::write(std::ostream &os) const {
+    os << file_header << '\n';
+    for(const auto &i : files_) {
+      auto file = detail::tsv_escape(i.first);
+      if(i.second.failed)
+        os << "file\t" << file << '\n';
+
+      // Sort the tests so that the file is stable from run to run.
+      std::vector<const std::string *> tests;
+      tests.reserve(i.second.tests.size());
+      for(const auto &j : i.second.tests)
+        tests.push_back(&j);
+      std::sort(tests.begin(), tests.end(), [](auto *a, auto *b) {
+        return *a < *b;
+      });
+      for(const auto *j : tests)
+        os << "test\t" << file << '\t' << detail::tsv_escape(*j) << '\n';
+    }
+  }
+
+  test_failures test_failures::load(const std::string &file) {
+    test_failures failures;
+    std::ifstream is(file);
+    if(is)
+      failures.read(is);
+    return failures;
+  }
+
+  void test_failures::save(const std::string &file) const {
+    std::string temp = file + ".tmp";
+    {
+      std::ofstream os(temp);
+      write(os);
+      if(!os.flush())
+        throw std::runtime_error("unable to write failures file \"" + file +
+                                 "\"");
+    }
+
+#ifdef _WIN32
+    // Windows won't rename a file over an existing one.
+    std::remove(file.c_str());
+#endif
+    if(std::rename(temp.c_str(), file.c_str()) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "unable to write failures file \"" + file +
+                              "\"");
+    }
+  }
+
+} // namespace mettle
@@ -0,0 +1,192 @@
+#include <mettle/driver/test_history.hpp>
+#include "tsv.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace mettle {
+
+  namespace {
+    void write_records(std::ostream &os, const std::string &prefix,
+                       const test_history::map_type &records) {
+      // Sort the records so that the file is stable from run to run.
+      std::vector<const test_history::map_type::value_type *> sorted;
+      sorted.reserve(records.size());
+      for(const auto &i : records)
+        sorted.push_back(&i);
+      std::sort(sorted.begin(), sorted.end(), [](auto *a, auto *b) {
+        return a->first < b->first;
+      });
+
+      for(const auto *i : sorted) {
+        const auto &record = i->second;
+        os << prefix << detail::tsv_escape(i->first) << '\t'
+           << record.runs << '\t' << record.failures << '\t'
+           << (record.last_passed ? "pass" : "fail") << '\t';
+        for(std::size_t j = 0; j != record.samples.size(); j++) {
+          if(j)
+            os << ',';
+          os << record.samples[j].count();
+        }
+        os << '\n';
+      }
+    }
+  }
+
+  void test_record::add(duration d, bool passed) {
+    runs++;
+    if(!passed)
+      failures++;
+    last_passed = passed;
+
+    if(samples.size() == max_samples)
+      samples.erase(samples.begin());
+    samples.push_back(d);
+  }
+
+  test_record::duration test_record::mean() const {
+    if(samples.empty())
+      return duration(0);
+
+    duration total(0);
+    for(auto i : samples)
+      total += i;
+    return total / static_cast<duration::rep>(samples.size());
+  }
+
+  test_record::duration test_record::percentile(double p) const {
+    if(samples.empty())
+      return duration(0);
+
+    // Use the nearest-rank method.
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = static_cast<std::size_t>(
+      std::ceil(p / 100 * static_cast<double>(sorted.size()))
+    );
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+  }
+
+  test_timings test_history::timings(const std::string &file) const {
+    test_timings result;
+    if(auto tests = find_tests(file)) {
+      for(const auto &i : *tests)
+        result.emplace(i.first, i.second.mean());
+    }
+    return result;
+  }
+
+  void test_history::read(std::istream &is) {
+    std::string line;
+    if(!std::getline(is, line))
+      return;
+    if(line != file_header)
+      throw std::invalid_argument("unrecognized history file");
+
+    for(std::size_t lineno = 2; std::getline(is, line); lineno++) {
+      if(line.empty())
+        continue;
+
+      auto fields = detail::tsv_split(line, '\t');
+      try {
+        // Test records have an extra field for the file they came from.
+        std::size_t key = fields[0] == "test" ? 2 : 1;
+        if((fields[0] != "test" && fields[0] != "file") ||
+           fields.size() != key + 5)
+          throw std::invalid_argument("wrong number of fields");
+
+        test_record record;
+        record.runs = std::stoul(fields[key + 1]);
+        record.failures = std::stoul(fields[key + 2]);
+        record.last_passed = fields[key + 3] == "pass";
+        if(!fields[key + 4].empty()) {
+          for(const auto &i : detail::tsv_split(fields[key + 4], ','))
+            record.samples.emplace_back(std::stoll(i));
+        }
+        if(record.samples.size() > test_record::max_samples) {
+          record.samples.erase(record.samples.begin(), record.samples.end() -
+                               test_record::max_samples);
+        }
+
+        auto &records = key == 2 ? tests_[detail::tsv_unescape(fields[1])] :
+                        files_;
+        records[detail::tsv_unescape(fields[key])] = std::move(record);
+      } catch(...) {
+        std::ostringstream ss;
+        ss << "invalid history on line " << lineno;
+        throw std::invalid_argument(ss.str());
+      }
+    }
+  }
+
+  void test_history::write(std::ostream &os) const {
+    os << file_header << '\n';
+    write_records(os, "file\t", files_);
+    for(const auto &i : tests_) {
+      write_records(os, "test\t" + detail::tsv_escape(i.first) + "\t",
+                    i.second);
+    }
+  }
+
+  test_history test_history::load(const std::string &file) {
+    test_history history;
+    std::ifstream is(file);
+    if(is)
+      history.read(is);
+    return history;
+  }
+
+  void test_history::save(const std::string &file) const {
+    std::string temp = file + ".tmp";
+    {
+      std::ofstream os(temp);
+      write(os);
+      if(!os.flush())
+        throw std::runtime_error("unable to write history file \"" + file +
+                                 "\"");
+    }
+
+#ifdef _WIN32
+    // Windows won't rename a file over an existing one.
+    std::remove(file.c_str());
+#endif
+    if(std::rename(temp.c_str(), file.c_str()) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "unable to write history file \"" + file + "\"");
+    }
+  }
+
+  history_estimator::history_estimator(const test_history &history,
+                                       const std::string &file)
+    : tests_(history.find_tests(file)), average_(1) {
+    if(!tests_)
+      return;
+
+    test_record::duration total(0);
+    std::size_t count = 0;
+    for(const auto &i : *tests_) {
+      if(!i.second.samples.empty()) {
+        total += i.second.mean();
+        count++;
+      }
+    }
+    if(count)
+      average_ = total / static_cast<test_record::duration::rep>(count);
+  }
+
+  test_record::duration
+  history_estimator::operator ()(const test_name &name) const {
+    if(!tests_)
+      return average_;
+    auto i = tests_->find(name.full_name());
+    auto record = i == tests_->end() ? nullptr : &i->second;
+    return record && !record->samples.empty() ? record->mean() : average_;
+  }
+
+} // namespace mettle
@@ -0,0 +1,58 @@
+#ifndef INC_METTLE_SRC_LIBMETTLE_TSV_HPP
+#define INC_METTLE_SRC_LIBMETTLE_TSV_HPP
+
+#include <string>
+#include <vector>
+
+// Helpers for the tab-separated files we keep between runs (e.g. the test
+// history).
+
+namespace mettle::detail {
+
+  inline std::string tsv_escape(const std::string &s) {
+    std::string result;
+    result.reserve(s.size());
+    for(char c : s) {
+      switch(c) {
+      case '\\': result += "\\\\"; break;
+      case '\t': result += "\\t";  break;
+      case '\n': result += "\\n";  break;
+      case '\r': result += "\\r";  break;
+      default:   result += c;
+      }
+    }
+    return result;
+  }
+
+  inline std::string tsv_unescape(const std::string &s) {
+    std::string result;
+    result.reserve(s.size());
+    for(std::size_t i = 0; i != s.size(); i++) {
+      if(s[i] != '\\' || i + 1 == s.size()) {
+        result += s[i];
+        continue;
+      }
+      switch(s[++i]) {
+      case 't': result += '\t'; break;
+      case 'n': result += '\n'; break;
+      case 'r': result += '\r'; break;
+      default:  result += s[i];
+      }
+    }
+    return result;
+  }
+
+  inline std::vector<std::string> tsv_split(const std::string &s, char delim) {
+    std::vector<std::string> result;
+    std::size_t start = 0, end;
+    while((end = s.find(delim, start)) != std::string::npos) {
+      result.push_back(s.substr(start, end - start));
+      start = end + 1;
+    }
+    result.push_back(s.substr(start));
+    return result;
+  }
+
+} // namespace mettle::detail
+
+#endif
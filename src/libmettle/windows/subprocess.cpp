@@ -79,7 +79,7 @@ namespace mettle::windows {
         }
       }
 
-      dests[i].dest->append(bufs[i], nread);
+      dests[i].append(bufs[i], nread);
       if(!ReadFile(dests[i].handle, bufs[i], sizeof(bufs[i]), &nread,
                    &overlapped[i])) {
         auto err = GetLastError();
@@ -94,9 +94,11 @@ namespace mettle {
       return METTLE_FAILED();
 
     std::string message;
+    log::output_capture stdout_capture(output_limit_),
+                        stderr_capture(output_limit_);
     std::vector<readhandle> dests = {
-      {stdout_pipe.read_handle, &output.stdout_log},
-      {stderr_pipe.read_handle, &output.stderr_log},
+      {stdout_pipe.read_handle, nullptr, &stdout_capture},
+      {stderr_pipe.read_handle, nullptr, &stderr_capture},
       {log_pipe.read_handle,    &message}
     };
     std::vector<HANDLE> interrupts = {proc_info.hProcess};
@@ -113,6 +115,7 @@ namespace mettle {
     // processes in the job.
     TerminateJobObject(job, 1);
 
+    output = log::collect_output(stdout_capture, stderr_capture);
     if(finished == timeout_event) {
       std::ostringstream ss;
       ss << "Timed out after " << timeout_->count() << " ms";
@@ -0,0 +1,112 @@
+#include "event_record.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <streambuf>
+
+#include <bencode.hpp>
+
+#include "run_test_files.hpp"
+
+namespace mettle {
+
+  namespace {
+    // Reads at most `size` bytes from another stream buffer. Like
+    // `recording_streambuf`, this is unbuffered, so it never reads past the
+    // end of what its reader asked for.
+    class limited_streambuf : public std::streambuf {
+    public:
+      limited_streambuf(std::streambuf *source, std::streamsize size)
+        : source_(source), left_(size) {}
+
+      // Skip over whatever's left, returning false if the source ran out
+      // first.
+      bool skip_rest() {
+        while(left_ && !traits_type::eq_int_type(uflow(), traits_type::eof()))
+          ;
+        return left_ == 0;
+      }
+    protected:
+      int_type underflow() override {
+        return left_ ? source_->sgetc() : traits_type::eof();
+      }
+
+      int_type uflow() override {
+        if(!left_)
+          return traits_type::eof();
+        auto c = source_->sbumpc();
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+          left_--;
+        return c;
+      }
+
+      std::streamsize xsgetn(char *s, std::streamsize n) override {
+        auto got = source_->sgetn(s, std::min(n, left_));
+        left_ -= got;
+        return got;
+      }
+    private:
+      std::streambuf *source_;
+      std::streamsize left_;
+    };
+  }
+
+  event_recorder::event_recorder(std::string file)
+    : file_(std::move(file)), os_(file_, std::ios::binary) {
+    if(!(os_ << file_header << '\n' << std::flush)) {
+      throw std::runtime_error("unable to write event record \"" + file_ +
+                               "\"");
+    }
+  }
+
+  void event_recorder::add(const std::string &file, const std::string &events,
+                           bool passed, const std::string &message) {
+    // Flush after every file, so that a run that gets interrupted still
+    // leaves a usable record of the files that finished.
+    bencode::encode(os_, bencode::dict_view{
+      {"file", file},
+      {"message", message},
+      {"passed", bencode::integer(passed)},
+      {"size", static_cast<bencode::integer>(events.size())}
+    });
+    if(!(os_ << events << std::flush)) {
+      throw std::runtime_error("unable to write event record \"" + file_ +
+                               "\"");
+    }
+  }
+
+  void replay_event_record(std::istream &is, log::file_logger &logger,
+                           detail::file_uid_maker &uid) {
+    std::string line;
+    if(!std::getline(is, line) || line != event_recorder::file_header)
+      throw std::invalid_argument("unrecognized event record");
+
+    while(is.peek() != EOF) {
+      std::string name;
+      file_result result;
+      bencode::integer size;
+      try {
+        auto tmp = bencode::decode(is, bencode::no_check_eof);
+        auto &data = boost::get<bencode::dict>(tmp);
+        name = std::move(boost::get<bencode::string>(data.at("file")));
+        result = {
+          boost::get<bencode::integer>(data.at("passed")) != 0,
+          std::move(boost::get<bencode::string>(data.at("message")))
+        };
+        size = boost::get<bencode::integer>(data.at("size"));
+      } catch(...) {
+        size = -1;
+      }
+      if(size < 0)
+        throw std::invalid_argument("invalid event record");
+      test_file file = {std::move(name), uid.make_file_uid()};
+
+      limited_streambuf buf(is.rdbuf(), size);
+      std::istream events(&buf);
+      replay_test_file(file, events, std::move(result), logger);
+      if(!buf.skip_rest())
+        throw std::invalid_argument("truncated event record");
+    }
+  }
+
+} // namespace mettle
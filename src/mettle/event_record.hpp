@@ -0,0 +1,41 @@
+#ifndef INC_METTLE_SRC_METTLE_EVENT_RECORD_HPP
+#define INC_METTLE_SRC_METTLE_EVENT_RECORD_HPP
+
+#include <fstream>
+#include <istream>
+#include <string>
+
+#include <mettle/test_uid.hpp>
+#include <mettle/driver/log/core.hpp>
+
+namespace mettle {
+
+  // Writes the raw event stream from each test file (the same stream that
+  // `log::pipe` reads) to a file as the file finishes, along with how it
+  // finished. Records from several runs (e.g. from different shards) can then
+  // be combined into a single report with `replay_event_record()`.
+  class event_recorder {
+  public:
+    // The first line of every event record.
+    static constexpr char file_header[] = "# mettle event record v1";
+
+    event_recorder(std::string file);
+    event_recorder(const event_recorder &) = delete;
+    event_recorder & operator =(const event_recorder &) = delete;
+
+    void add(const std::string &file, const std::string &events, bool passed,
+             const std::string &message);
+  private:
+    std::string file_;
+    std::ofstream os_;
+  };
+
+  // Replay each test file recorded in `is` into `logger`. Every file gets a
+  // new UID from `uid`, so tests from different records never collide. Events
+  // are read one at a time, so records of any size can be replayed.
+  void replay_event_record(std::istream &is, log::file_logger &logger,
+                           detail::file_uid_maker &uid);
+
+} // namespace mettle
+
+#endif
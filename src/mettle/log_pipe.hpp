@@ -2,10 +2,13 @@
 #define INC_METTLE_SRC_LOG_PIPE_HPP
 
 #include <istream>
+#include <string>
+#include <string_view>
 
 #include <bencode.hpp>
 
 #include <mettle/driver/log/core.hpp>
+#include <mettle/driver/log/protocol.hpp>
 
 namespace mettle::log {
 
@@ -15,6 +18,13 @@ namespace mettle::log {
       : logger_(logger), file_uid_(file_uid) {}
 
     void operator ()(std::istream &s) {
+      if(s.peek() == binary::frame_marker) {
+        // Suite declarations always precede the event that uses them, so keep
+        // going until we've read a real event.
+        while(!read_binary(s)) {}
+        return;
+      }
+
       auto tmp = bencode::decode(s, bencode::no_check_eof);
       auto &data = boost::get<bencode::dict>(tmp);
       auto &event = boost::get<bencode::string>(data.at("event"));
@@ -37,12 +47,103 @@ namespace mettle::log {
       } else if(event == "skipped_test") {
         logger_.skipped_test(read_test_name(data.at("test")),
                              read_string(data.at("message")));
+      } else if(event == "cancelled_test") {
+        logger_.cancelled_test(read_test_name(data.at("test")));
       } else if(event == "failed_file") {
         logger_.failed_file({read_string(data.at("file")), file_uid_},
                             read_string(data.at("message")));
       }
     }
   private:
+    bool read_binary(std::istream &s) {
+      char header[binary::header_size];
+      if(!s.read(header, sizeof(header)))
+        throw binary::protocol_error("truncated event");
+      frame_.resize(binary::decoder::frame_length(header));
+      if(!s.read(frame_.data(), frame_.size()))
+        throw binary::protocol_error("truncated event");
+
+      binary::decoder d(frame_);
+      switch(d.read_tag()) {
+      case binary::event_tag::declare_suite: {
+        auto id = d.read_int();
+        if(id != suites_.size())
+          throw binary::protocol_error("unexpected suite index");
+        suites_.emplace_back(read_suites(d));
+        return false;
+      }
+      case binary::event_tag::started_suite:
+        logger_.started_suite(read_suite_path(d));
+        break;
+      case binary::event_tag::ended_suite:
+        logger_.ended_suite(read_suite_path(d));
+        break;
+      case binary::event_tag::started_test:
+        logger_.started_test(read_test_name(d));
+        break;
+      case binary::event_tag::passed_test: {
+        auto test = read_test_name(d);
+        auto duration = log::test_duration(d.read_int());
+        logger_.passed_test(test, read_test_output(d), duration);
+        break;
+      }
+      case binary::event_tag::failed_test: {
+        auto test = read_test_name(d);
+        auto duration = log::test_duration(d.read_int());
+        auto message = d.read_string();
+        logger_.failed_test(test, std::string(message), read_test_output(d),
+                            duration);
+        break;
+      }
+      case binary::event_tag::skipped_test: {
+        auto test = read_test_name(d);
+        logger_.skipped_test(test, std::string(d.read_string()));
+        break;
+      }
+      case binary::event_tag::cancelled_test:
+        logger_.cancelled_test(read_test_name(d));
+        break;
+      case binary::event_tag::failed_file: {
+        auto file = d.read_string();
+        logger_.failed_file({std::string(file), file_uid_},
+                            std::string(d.read_string()));
+        break;
+      }
+      default:
+        // Ignore started_run, ended_run, and anything from a newer version of
+        // the protocol.
+        break;
+      }
+      return true;
+    }
+
+    std::vector<std::string> read_suites(binary::decoder &d) {
+      std::vector<std::string> result;
+      for(auto count = d.read_int(); count != 0; count--)
+        result.emplace_back(d.read_string());
+      return result;
+    }
+
+    const suite_path & read_suite_path(binary::decoder &d) {
+      auto id = d.read_int();
+      if(id >= suites_.size())
+        throw binary::protocol_error("unknown suite index");
+      return suites_[id];
+    }
+
+    test_name read_test_name(binary::decoder &d) {
+      test_uid id = file_uid_ + static_cast<test_uid>(d.read_int());
+      const auto &suites = read_suite_path(d);
+      return {suites, std::string(d.read_string()), id};
+    }
+
+    log::test_output read_test_output(binary::decoder &d) {
+      log::test_output output;
+      output.stdout_log = d.read_string();
+      output.stderr_log = d.read_string();
+      return output;
+    }
+
     std::vector<std::string> read_suites(bencode::data &suites) {
       std::vector<std::string> result;
       for(auto &&i : boost::get<bencode::list>(suites))
@@ -83,6 +184,8 @@ namespace mettle::log {
 
     log::file_logger &logger_;
     test_uid file_uid_;
+    std::string frame_;
+    std::vector<suite_path> suites_;
   };
 
 } // namespace mettle::log
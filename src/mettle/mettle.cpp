@@ -1,35 +1,380 @@
+#include <chrono>
+#include <csignal>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include <boost/program_options.hpp>
 
 #include <mettle/driver/cmd_line.hpp>
 #include <mettle/driver/exit_code.hpp>
+#include <mettle/driver/failure_limit.hpp>
+#include <mettle/driver/test_failures.hpp>
+#include <mettle/driver/log/failures.hpp>
+#include <mettle/driver/log/history.hpp>
 #include <mettle/driver/log/summary.hpp>
 #include <mettle/driver/log/term.hpp>
 
+#include "event_record.hpp"
 #include "run_test_files.hpp"
 
+#ifndef _WIN32
+#  include <signal.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  include "posix/run_test_file.hpp"
+#  include "posix/server.hpp"
+#endif
+#ifdef __linux__
+#  include "posix/file_watcher.hpp"
+#endif
+
+extern char **environ;
+
 namespace mettle {
 
   namespace {
     struct all_options : generic_options, driver_options, output_options {
       std::vector<test_command> files;
+      std::size_t jobs = 1;
+      std::string failures;
+      bool rerun_failed = false;
+      std::string cache;
+      std::vector<std::string> cache_env;
+      bool watch = false;
+      std::string serve;
+      std::string connect;
+      std::string record;
+    };
+
+    struct merge_options : generic_options, output_options {
+      std::vector<std::string> files;
     };
 
+    // How long to wait for test files to stop changing before rerunning them
+    // in `--watch` mode. Linking several files at once should only trigger
+    // one run.
+    constexpr std::chrono::milliseconds watch_quiet_time(250);
+
     const char program_name[] = "mettle";
     void report_error(const std::string &message) {
       std::cerr << program_name << ": " << message << std::endl;
     }
+
+    // Pick out the files with failures recorded in `previous`, restricting
+    // each to just the tests that failed. Files that failed outright (e.g.
+    // by crashing) are run in full, since we don't know which of their tests
+    // would fail.
+    std::vector<test_command>
+    failed_files(const std::vector<test_command> &files,
+                 const test_failures &previous) {
+      std::vector<test_command> result;
+      for(const auto &file : files) {
+        auto record = previous.find(file.command());
+        if(!record)
+          continue;
+
+        result.push_back(file);
+        if(!record->failed) {
+          std::vector<std::string> args;
+          for(const auto &i : record->tests) {
+            args.push_back("--test-name");
+            args.push_back(i);
+          }
+          result.back().add_args(args);
+        }
+      }
+      return result;
+    }
+
+    std::string absolute_path(const std::string &path) {
+#ifndef _WIN32
+      if(path.empty() || path[0] == '/')
+        return path;
+      char cwd[4096];
+      if(!getcwd(cwd, sizeof(cwd)))
+        return path;
+      return std::string(cwd) + "/" + path;
+#else
+      return path;
+#endif
+    }
+
+    // Identify the current version of a file on disk by its identity, size,
+    // and modification time.
+    std::string file_stamp(const std::string &path) {
+#ifndef _WIN32
+      struct stat st;
+      if(stat(path.c_str(), &st) == 0) {
+        std::ostringstream ss;
+        ss << st.st_dev << ':' << st.st_ino << ':' << st.st_size << ':'
+#ifdef __linux__
+           << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+#else
+           << st.st_mtime;
+#endif
+        return ss.str();
+      }
+#endif
+      return "";
+    }
+
+    // The state that a `--serve` server keeps warm between requests.
+    struct server_state {
+      struct history_entry {
+        test_history history;
+        // The stamp of the history file when we last loaded or saved it.
+        std::string stamp;
+      };
+
+      std::map<std::string, history_entry> histories;
+      std::map<std::pair<std::string, std::vector<std::string>>, result_cache>
+      caches;
+      // Test listings are cached in memory, keyed just like results are.
+      result_cache listings;
+
+      // Get the history in `file`, loading it again if something else (e.g. a
+      // local run of `mettle`) has changed it since we last saw it.
+      test_history & history(const std::string &file) {
+        auto [i, inserted] = histories.try_emplace(absolute_path(file));
+        auto stamp = file_stamp(file);
+        if(inserted || stamp != i->second.stamp)
+          i->second = {test_history::load(file), std::move(stamp)};
+        return i->second.history;
+      }
+
+      // Note that we've just saved the history in `file`, so that we don't
+      // reload our own changes.
+      void saved_history(const std::string &file) {
+        auto i = histories.find(absolute_path(file));
+        if(i != histories.end())
+          i->second.stamp = file_stamp(file);
+      }
+
+      result_cache & cache(const std::string &dir,
+                           const std::vector<std::string> &env) {
+        auto path = absolute_path(dir);
+        return caches.try_emplace({path, env}, path, env).first->second;
+      }
+    };
+
+#ifndef _WIN32
+    // Look for `--connect SOCKET` on the command line. We check this before
+    // parsing anything else so that the client does as little work as
+    // possible; the server parses the rest of the arguments for us.
+    std::optional<std::pair<std::string, posix::server_request>>
+    client_request(int argc, const char *argv[]) {
+      constexpr std::string_view option = "--connect";
+      std::optional<std::string> path;
+      posix::server_request request;
+      for(int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if(arg == "--") {
+          request.args.insert(request.args.end(), argv + i, argv + argc);
+          break;
+        } else if(arg == option && i + 1 < argc) {
+          path = argv[++i];
+        } else if(arg.substr(0, option.size() + 1) == "--connect=") {
+          path = std::string(arg.substr(option.size() + 1));
+        } else {
+          request.args.emplace_back(arg);
+        }
+      }
+      if(!path)
+        return std::nullopt;
+
+      char cwd[4096];
+      if(getcwd(cwd, sizeof(cwd)))
+        request.cwd = cwd;
+      for(char **i = environ; *i; i++)
+        request.env.emplace_back(*i);
+      return std::make_pair(std::move(*path), std::move(request));
+    }
+#endif
   }
 
 } // namespace mettle
 
+static int drive(int argc, const char *argv[],
+                 mettle::server_state *server = nullptr);
+
+#ifndef _WIN32
+namespace mettle {
+  namespace {
+    posix::server *running_server = nullptr;
+    pid_t server_pid;
+    volatile std::sig_atomic_t stop_signal = 0;
+
+    void stop_server(int signum) {
+      // Test modules run in a fork of the server, so they inherit this
+      // handler; they should just die like any other test file would.
+      if(getpid() != server_pid) {
+        signal(signum, SIG_DFL);
+        raise(signum);
+        return;
+      }
+
+      stop_signal = signum;
+      running_server->stop();
+    }
+  }
+}
+
+static int serve(const std::string &path) {
+  using namespace mettle;
+
+  server_state state;
+  {
+    posix::server listener(path);
+
+    // Finish the current request (if any), and then stop and clean up our
+    // socket when we're interrupted. Restart any system calls the request
+    // was making, and don't pass SIGINT on to the test files it's running
+    // (as the driver normally would), so that it's not cut short.
+    posix::forward_signals_to_files(false);
+    running_server = &listener;
+    server_pid = getpid();
+    struct sigaction act = {};
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = SA_RESTART;
+    act.sa_handler = stop_server;
+    sigaction(SIGINT, &act, nullptr);
+    sigaction(SIGTERM, &act, nullptr);
+
+    while(listener.handle_one([&state](const posix::server_request &request) {
+      std::vector<const char *> argv = {program_name};
+      for(const auto &i : request.args)
+        argv.push_back(i.c_str());
+      argv.push_back(nullptr);
+
+      return drive(static_cast<int>(argv.size() - 1), argv.data(), &state);
+    })) {}
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+  }
+
+  // Now that the socket is gone, exit the way the signal would have.
+  raise(stop_signal);
+  return exit_code::unknown_error;
+}
+#endif
+
+// `mettle merge RECORD...`: combine the event records from one or more runs
+// (e.g. on different shards) into a single report.
+static int merge(int argc, const char *argv[]) {
+  using namespace mettle;
+  namespace opts = boost::program_options;
+
+  auto factory = make_logger_factory();
+
+  merge_options args;
+  auto generic = make_generic_options(args);
+  auto output = make_output_options(args, factory);
+
+  opts::options_description hidden("Hidden options");
+  hidden.add_options()
+    ("input-file", opts::value(&args.files), "input file")
+  ;
+  opts::positional_options_description pos;
+  pos.add("input-file", -1);
+
+  try {
+    opts::options_description all;
+    all.add(generic).add(output).add(hidden);
+    opts::variables_map vm;
+    opts::store(opts::command_line_parser(argc, argv)
+                .options(all).positional(pos).run(), vm);
+    opts::notify(vm);
+  } catch(const std::exception &e) {
+    report_error(e.what());
+    return exit_code::bad_args;
+  }
+
+  if(args.show_help) {
+    opts::options_description displayed;
+    displayed.add(generic).add(output);
+    std::cout << "Usage: " << program_name << " merge [OPTION]... RECORD..."
+              << std::endl << std::endl << displayed << std::endl;
+    return exit_code::success;
+  } else if(args.show_version) {
+    std::cout << "mettle " << METTLE_VERSION << std::endl;
+    return exit_code::success;
+  }
+
+  if(args.files.empty()) {
+    report_error("no inputs specified");
+    return exit_code::no_inputs;
+  }
+
+  try {
+    term::enable(std::cout, color_enabled(args.color));
+    indenting_ostream out(std::cout);
+
+    log::summary logger(
+      out, factory.make(args.output, out, args), args.show_time,
+      args.show_terminal
+    );
+
+    // All the records share one set of file UIDs, so that test UIDs from
+    // different records don't collide.
+    detail::file_uid_maker uid;
+    logger.started_run();
+    for(const auto &file : args.files) {
+      std::ifstream is(file, std::ios::binary);
+      if(!is)
+        throw std::runtime_error("unable to open event record \"" + file +
+                                 "\"");
+      try {
+        replay_event_record(is, logger, uid);
+      } catch(const std::exception &e) {
+        throw std::invalid_argument(file + ": " + e.what());
+      }
+    }
+    logger.ended_run();
+
+    logger.summarize();
+    return logger.good() ? exit_code::success : exit_code::failure;
+  } catch(const std::out_of_range &e) {
+    report_error("unknown output format \"" + args.output + "\"");
+    return exit_code::bad_args;
+  } catch(const std::exception &e) {
+    report_error(e.what());
+    return exit_code::unknown_error;
+  }
+}
+
 int main(int argc, const char *argv[]) {
   using namespace mettle;
+
+#ifndef _WIN32
+  if(auto request = client_request(argc, argv)) {
+    try {
+      return posix::send_request(request->first, request->second,
+                                 STDOUT_FILENO, STDERR_FILENO);
+    } catch(const std::exception &e) {
+      report_error(e.what());
+      return exit_code::unknown_error;
+    }
+  }
+#endif
+
+  return drive(argc, argv);
+}
+
+static int drive(int argc, const char *argv[], mettle::server_state *server) {
+  using namespace mettle;
   namespace opts = boost::program_options;
 
+  if(argc > 1 && std::string_view(argv[1]) == "merge")
+    return merge(argc - 1, argv + 1);
+
   auto factory = make_logger_factory();
 
   all_options args;
@@ -37,6 +382,31 @@ int main(int argc, const char *argv[]) {
   auto driver = make_driver_options(args);
   auto output = make_output_options(args, factory);
 
+  // These options apply to the mettle driver itself, so we don't forward them
+  // to the test files.
+  opts::options_description file_opts("File options");
+  file_opts.add_options()
+    ("jobs,j", opts::value(&args.jobs)->value_name("N"),
+     "number of test files to run in parallel")
+    ("failures", opts::value(&args.failures)->value_name("FILE"),
+     "record the names of failing tests in FILE")
+    ("rerun-failed", opts::value(&args.rerun_failed)->zero_tokens(),
+     "run only the tests recorded as failing in the --failures file")
+    ("cache", opts::value(&args.cache)->value_name("DIR"),
+     "reuse the results of test files that passed and haven't changed since, "
+     "storing them in DIR")
+    ("cache-env", opts::value(&args.cache_env)->value_name("VAR"),
+     "treat test files as changed when the environment variable VAR changes")
+    ("watch", opts::value(&args.watch)->zero_tokens(),
+     "keep running, and rerun test files whenever they change")
+    ("serve", opts::value(&args.serve)->value_name("SOCKET"),
+     "keep running, and run tests for clients that connect to SOCKET")
+    ("connect", opts::value(&args.connect)->value_name("SOCKET"),
+     "ask the server listening on SOCKET to run the tests")
+    ("record", opts::value(&args.record)->value_name("FILE"),
+     "record the events from each test file in FILE, for `mettle merge`")
+  ;
+
   opts::options_description hidden("Hidden options");
   hidden.add_options()
     ("input-file", opts::value(&args.files), "input file")
@@ -47,7 +417,7 @@ int main(int argc, const char *argv[]) {
   std::vector<std::string> child_args;
   try {
     opts::options_description all;
-    all.add(generic).add(driver).add(output).add(hidden);
+    all.add(generic).add(driver).add(file_opts).add(output).add(hidden);
     auto parsed = opts::command_line_parser(argc, argv)
       .options(all).positional(pos).run();
 
@@ -62,7 +432,7 @@ int main(int argc, const char *argv[]) {
 
   if(args.show_help) {
     opts::options_description displayed;
-    displayed.add(generic).add(driver).add(output);
+    displayed.add(generic).add(driver).add(file_opts).add(output);
     std::cout << displayed << std::endl;
     return exit_code::success;
   } else if(args.show_version) {
@@ -70,6 +440,30 @@ int main(int argc, const char *argv[]) {
     return exit_code::success;
   }
 
+  if(!args.serve.empty() || !args.connect.empty()) {
+#ifndef _WIN32
+    // A client never sends --connect, so we'll only see it here if it's
+    // been nested in some odd way.
+    if(server) {
+      report_error("--serve and --connect can't be sent to a server");
+      return exit_code::bad_args;
+    }
+    if(!args.files.empty()) {
+      report_error("--serve doesn't take any test files");
+      return exit_code::bad_args;
+    }
+    try {
+      return serve(args.serve);
+    } catch(const std::exception &e) {
+      report_error(e.what());
+      return exit_code::unknown_error;
+    }
+#else
+    report_error("--serve and --connect are not supported on this platform");
+    return exit_code::bad_args;
+#endif
+  }
+
   if(args.files.empty()) {
     report_error("no inputs specified");
     return exit_code::no_inputs;
@@ -80,19 +474,179 @@ int main(int argc, const char *argv[]) {
     return exit_code::no_inputs;
   }
 
+  if(args.jobs == 0) {
+    report_error("--jobs must be at least 1");
+    return exit_code::bad_args;
+  }
+#ifdef _WIN32
+  if(args.jobs > 1) {
+    report_error("--jobs is not supported on this platform");
+    return exit_code::bad_args;
+  }
+#endif
+
+  if(args.fail_fast && args.max_failures) {
+    report_error("--fail-fast and --max-failures can't be used together");
+    return exit_code::bad_args;
+  }
+
+#ifndef __linux__
+  if(args.watch) {
+    report_error("--watch is not supported on this platform");
+    return exit_code::bad_args;
+  }
+#endif
+  if(args.watch && args.list) {
+    report_error("--watch and --list can't be used together");
+    return exit_code::bad_args;
+  }
+  if(args.watch && server) {
+    report_error("--watch can't be sent to a server");
+    return exit_code::bad_args;
+  }
+  if(!args.record.empty() && args.list) {
+    report_error("--record and --list can't be used together");
+    return exit_code::bad_args;
+  }
+
+  if(!args.cache_env.empty() && args.cache.empty()) {
+    report_error("--cache-env requires --cache");
+    return exit_code::bad_args;
+  }
+
+  if(args.rerun_failed) {
+    if(args.failures.empty()) {
+      report_error("--rerun-failed requires --failures");
+      return exit_code::bad_args;
+    }
+
+    try {
+      args.files = failed_files(args.files,
+                                test_failures::load(args.failures));
+    } catch(const std::exception &e) {
+      report_error(args.failures + ": " + e.what());
+      return exit_code::bad_args;
+    }
+    if(args.files.empty()) {
+      std::cout << "no failed tests to rerun" << std::endl;
+      return exit_code::success;
+    }
+  }
+
+  // Tests are recorded in history files under the command line of the file
+  // they came from, so tell each file what that is.
+  if(!args.history.empty() || !args.shard_timing.empty()) {
+    for(auto &file : args.files)
+      file.add_args({"--history-key", file.command()});
+  }
+
+  if(args.list) {
+    try {
+      bool good = true;
+      list_test_files(args.files, [](test_listing &&test) {
+        write_listing_json(std::cout, test);
+      }, [&good](const test_command &file, const std::string &message) {
+        report_error(file.command() + ": " + message);
+        good = false;
+      }, child_args, args.jobs, server ? &server->listings : nullptr);
+      return good ? exit_code::success : exit_code::failure;
+    } catch(const std::exception &e) {
+      report_error(e.what());
+      return exit_code::unknown_error;
+    }
+  }
+
   try {
     term::enable(std::cout, color_enabled(args.color));
     indenting_ostream out(std::cout);
 
-    log::summary logger(
-      out, factory.make(args.output, out, args), args.show_time,
-      args.show_terminal
-    );
-    for(std::size_t i = 0; i != args.runs; i++)
-      run_test_files(args.files, logger, child_args);
+    // The test files only read the history (to decide what order to run their
+    // tests in); we record and save it for them. A server keeps it in memory
+    // between runs.
+    test_history local_history;
+    if(!server && !args.history.empty())
+      local_history = test_history::load(args.history);
+    test_history &history = server && !args.history.empty() ?
+      server->history(args.history) : local_history;
 
-    logger.summarize();
-    return logger.good() ? exit_code::success : exit_code::failure;
+    test_failures failures;
+    std::optional<result_cache> local_cache;
+    result_cache *cache = nullptr;
+    if(server && !args.cache.empty())
+      cache = &server->cache(args.cache, args.cache_env);
+    else if(!args.cache.empty())
+      cache = &local_cache.emplace(args.cache, args.cache_env);
+
+    auto run = [&](const std::vector<test_command> &files) {
+      log::summary logger(
+        out, factory.make(args.output, out, args), args.show_time,
+        args.show_terminal
+      );
+
+      log::history recorder(history, logger);
+      log::file_logger &recorded = args.history.empty() ?
+        static_cast<log::file_logger &>(logger) : recorder;
+
+      // Forget any earlier failures of the files we're about to run (when
+      // watching for changes, we may have run them before).
+      for(const auto &file : files)
+        failures.erase(file.command());
+      log::failures failure_recorder(failures, recorded);
+      log::file_logger &target = args.failures.empty() ?
+        recorded : failure_recorder;
+
+      // Each test file stops itself after --max-failures failures too (since
+      // we forward the option to it), but we also stop starting new files once
+      // there have been that many failures across all of them.
+      failure_limit limit(args.fail_fast ? 1 : args.max_failures);
+      std::optional<event_recorder> events;
+      if(!args.record.empty())
+        events.emplace(args.record);
+      std::size_t unstarted = 0;
+      for(std::size_t i = 0; i != args.runs && !limit.reached(); i++) {
+        unstarted = run_test_files(
+          files, target, child_args, args.jobs,
+          args.history.empty() ? nullptr : &history, limit ? &limit : nullptr,
+          cache, events ? &*events : nullptr
+        );
+      }
+      if(limit.reached())
+        logger.stopped_early(unstarted);
+
+      if(!args.history.empty()) {
+        history.save(args.history);
+        if(server)
+          server->saved_history(args.history);
+      }
+      if(!args.failures.empty())
+        failures.save(args.failures);
+
+      logger.summarize();
+      return logger.good();
+    };
+
+#ifdef __linux__
+    if(args.watch) {
+      std::vector<std::string> executables;
+      for(const auto &file : args.files)
+        executables.push_back(find_executable(file.args().front()));
+      // Start watching before the first run, so that we don't miss any
+      // changes made while it's going.
+      posix::file_watcher watcher(executables);
+
+      run(args.files);
+      while(true) {
+        std::cout << std::endl << "Watching for changes..." << std::endl;
+        std::vector<test_command> changed;
+        for(auto i : watcher.wait(watch_quiet_time))
+          changed.push_back(args.files[i]);
+        std::cout << std::endl;
+        run(changed);
+      }
+    }
+#endif
+
+    return run(args.files) ? exit_code::success : exit_code::failure;
   } catch(const std::out_of_range &e) {
     report_error("unknown output format \"" + args.output + "\"");
     return exit_code::bad_args;
@@ -0,0 +1,109 @@
+#include "file_watcher.hpp"
+
+#ifdef __linux__
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+namespace mettle::posix {
+
+#ifdef __linux__
+
+  namespace {
+    constexpr std::uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                         IN_CREATE | IN_ATTRIB;
+
+    std::pair<std::string, std::string> split_path(const std::string &path) {
+      auto slash = path.rfind('/');
+      if(slash == std::string::npos)
+        return {".", path};
+      return {slash == 0 ? "/" : path.substr(0, slash), path.substr(slash + 1)};
+    }
+  }
+
+  file_watcher::file_watcher(const std::vector<std::string> &files)
+    : fd_(inotify_init1(IN_CLOEXEC | IN_NONBLOCK)), count_(files.size()) {
+    if(fd_ < 0)
+      throw std::system_error(errno, std::system_category());
+
+    for(std::size_t i = 0; i != files.size(); i++) {
+      auto [dir, name] = split_path(files[i]);
+      // Watching the same directory twice just gives us the same descriptor.
+      int wd = inotify_add_watch(fd_, dir.c_str(), watch_mask);
+      if(wd < 0) {
+        int err = errno;
+        close(fd_);
+        throw std::system_error(err, std::system_category(),
+                                "unable to watch \"" + dir + "\"");
+      }
+      files_.emplace(std::make_pair(wd, std::move(name)), i);
+    }
+  }
+
+  file_watcher::~file_watcher() {
+    close(fd_);
+  }
+
+  std::vector<std::size_t>
+  file_watcher::wait(std::chrono::milliseconds quiet) {
+    std::vector<bool> changed(count_);
+    bool any = false;
+    while(true) {
+      pollfd pfd = {fd_, POLLIN, 0};
+      int timeout = any ? static_cast<int>(quiet.count()) : -1;
+      int n = poll(&pfd, 1, timeout);
+      if(n < 0) {
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::system_category());
+      } else if(n == 0) {
+        // Things have settled down, so we're done.
+        break;
+      }
+
+      read_events(changed);
+      for(bool i : changed)
+        any = any || i;
+    }
+
+    std::vector<std::size_t> result;
+    for(std::size_t i = 0; i != changed.size(); i++) {
+      if(changed[i])
+        result.push_back(i);
+    }
+    return result;
+  }
+
+  void file_watcher::read_events(std::vector<bool> &changed) {
+    alignas(inotify_event) char buf[4096];
+    while(true) {
+      auto size = read(fd_, buf, sizeof(buf));
+      if(size < 0) {
+        if(errno == EAGAIN)
+          return;
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::system_category());
+      }
+
+      for(char *p = buf; p < buf + size;) {
+        auto *event = reinterpret_cast<inotify_event *>(p);
+        p += sizeof(inotify_event) + event->len;
+        if(!event->len)
+          continue;
+
+        auto range = files_.equal_range({event->wd, event->name});
+        for(auto i = range.first; i != range.second; ++i)
+          changed[i->second] = true;
+      }
+    }
+  }
+
+#endif
+
+} // namespace mettle::posix
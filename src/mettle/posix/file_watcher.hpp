@@ -0,0 +1,39 @@
+#ifndef INC_METTLE_SRC_POSIX_FILE_WATCHER_HPP
+#define INC_METTLE_SRC_POSIX_FILE_WATCHER_HPP
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mettle::posix {
+
+  // Watches a list of files for changes using inotify. Rather than watching
+  // the files themselves, this watches the directories they're in, since
+  // linkers often replace a file instead of writing to it in place. This is
+  // only available on Linux.
+  class file_watcher {
+  public:
+    file_watcher(const std::vector<std::string> &files);
+    file_watcher(const file_watcher &) = delete;
+    file_watcher & operator =(const file_watcher &) = delete;
+    ~file_watcher();
+
+    // Wait for any of the files to change, and then until none of them have
+    // changed for `quiet` (so that rebuilding several files at once is seen
+    // as one change). Returns the indices of the changed files, in order.
+    std::vector<std::size_t> wait(std::chrono::milliseconds quiet);
+  private:
+    // Read the pending events, adding any changed files to `changed`.
+    void read_events(std::vector<bool> &changed);
+
+    int fd_;
+    // The indices of the files we're watching, by watch descriptor and name.
+    std::multimap<std::pair<int, std::string>, std::size_t> files_;
+    std::size_t count_;
+  };
+
+} // namespace mettle::posix
+
+#endif
@@ -1,10 +1,18 @@
 #include "run_test_file.hpp"
 
 #include <signal.h>
+#include <spawn.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <sstream>
 
 #include <boost/iostreams/device/file_descriptor.hpp>
@@ -12,16 +20,76 @@
 
 #include <mettle/driver/exit_code.hpp>
 #include <mettle/driver/posix/scoped_pipe.hpp>
+#include <mettle/driver/posix/scoped_signal.hpp>
 
+#include "test_module.hpp"
 #include "../../err_string.hpp"
 
 // XXX: Use std::source_location instead when we're able.
 #define PARENT_FAILED() parent_failed(__FILE__, __LINE__)
 
+extern char **environ;
+
 namespace mettle::posix {
 
   namespace {
 
+    // Test files run in their own process groups so that we can kill
+    // everything they started, which means they don't get any signals from the
+    // terminal. Pass SIGINT and SIGQUIT on to them ourselves (unless told not
+    // to).
+    bool forwarding = true;
+    std::vector<pid_t> running_pgids;
+    struct sigaction old_sigint, old_sigquit;
+
+    void sig_handler(int signum) {
+      for(pid_t pgid : running_pgids)
+        killpg(pgid, signum);
+
+      // Restore the previous signal action and re-raise the signal.
+      struct sigaction *old_act = signum == SIGINT ? &old_sigint : &old_sigquit;
+      sigaction(signum, old_act, nullptr);
+      raise(signum);
+    }
+
+    int add_running_pgid(pid_t pgid) {
+      // Install the handlers the first time we start a file; after that, they
+      // just forward signals to whichever files happen to be running.
+      if(forwarding) {
+        static int installed = []() {
+          struct sigaction act;
+          sigemptyset(&act.sa_mask);
+          act.sa_flags = 0;
+          act.sa_handler = sig_handler;
+          if(sigaction(SIGINT, &act, &old_sigint) < 0 ||
+             sigaction(SIGQUIT, &act, &old_sigquit) < 0)
+            return -1;
+          return 0;
+        }();
+        if(installed < 0)
+          return -1;
+      }
+
+      scoped_sigprocmask mask;
+      if(mask.push(SIG_BLOCK, {SIGINT, SIGQUIT}) < 0)
+        return -1;
+      try {
+        running_pgids.push_back(pgid);
+      } catch(...) {
+        errno = ENOMEM;
+        return -1;
+      }
+      return 0;
+    }
+
+    void remove_running_pgid(pid_t pgid) {
+      scoped_sigprocmask mask;
+      mask.push(SIG_BLOCK, {SIGINT, SIGQUIT});
+      auto i = std::find(running_pgids.begin(), running_pgids.end(), pgid);
+      if(i != running_pgids.end())
+        running_pgids.erase(i);
+    }
+
     file_result parent_failed(const char *file, std::size_t line) {
       std::ostringstream ss;
       ss << "Fatal error at " << file << ":" << line << "\n"
@@ -29,10 +97,8 @@ namespace mettle::posix {
       return {false, ss.str()};
     }
 
-    [[noreturn]] void
-    child_failed(int fd, const std::string &file) {
-      auto err = err_string(errno);
-
+    bool write_failed_file(int fd, const std::string &file,
+                           const std::string &err) {
       try {
         namespace io = boost::iostreams;
         io::stream<io::file_descriptor_sink> stream(
@@ -43,13 +109,23 @@ namespace mettle::posix {
           {"file", file},
           {"message", err}
         });
-        stream.flush();
-        _exit(exit_code::success);
+        return bool(stream.flush());
       } catch(...) {
-        _exit(exit_code::fatal);
+        return false;
       }
     }
 
+    [[noreturn]] void
+    child_failed(int fd, const std::string &file, const std::string &err) {
+      _exit(write_failed_file(fd, file, err) ? exit_code::success :
+            exit_code::fatal);
+    }
+
+    [[noreturn]] void
+    child_failed(int fd, const std::string &file) {
+      child_failed(fd, file, err_string(errno));
+    }
+
     std::unique_ptr<char *[]>
     make_argv(const std::vector<std::string> &argv) {
       auto real_argv = std::make_unique<char *[]>(argv.size() + 1);
@@ -58,61 +134,198 @@ namespace mettle::posix {
       return real_argv;
     }
 
-  }
+    // Tell the file which event protocol we understand via its environment:
+    // test files built against older versions of mettle reject command-line
+    // options they don't know, but ignore unknown environment variables (and
+    // just send bencode).
+    std::string protocol_var() {
+      return std::string(log::protocol_env) + "=" +
+             std::to_string(static_cast<unsigned>(log::latest_protocol));
+    }
 
-  file_result run_test_file(std::vector<std::string> args, log::pipe &logger) {
-    posix::scoped_pipe message_pipe;
-    if(message_pipe.open() < 0)
-      return PARENT_FAILED();
+    std::vector<char *> make_envp(const std::string &protocol) {
+      std::size_t name_len = protocol.find('=') + 1;
+      std::vector<char *> envp;
+      for(char **i = environ; *i; i++) {
+        if(std::strncmp(*i, protocol.c_str(), name_len) != 0)
+          envp.push_back(*i);
+      }
+      envp.push_back(const_cast<char*>(protocol.c_str()));
+      envp.push_back(nullptr);
+      return envp;
+    }
 
-    rlimit lim;
-    if(getrlimit(RLIMIT_NOFILE, &lim) < 0)
-      return PARENT_FAILED();
-    int max_fd = lim.rlim_cur - 1;
+    // Kill a test file that we've given up on, along with anything else in its
+    // process group. If the file never started, there's nothing to do.
+    void kill_test_file(pid_t pid) {
+      if(pid > 0) {
+        killpg(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        remove_running_pgid(pid);
+      }
+    }
 
-    args.insert(args.end(), { "--output-fd", std::to_string(max_fd) });
-    auto argv = make_argv(args);
+    // Test modules have to run in a copy of this process, so fork and load
+    // the module in the child.
+    file_result
+    fork_test_module(const std::vector<std::string> &args,
+                     scoped_pipe &message_pipe, int max_fd, pid_t &pid) {
+      // The child will flush its own copies of any pending output when it
+      // exits, so flush it first.
+      std::fflush(nullptr);
 
-    pid_t pid;
-    if((pid = fork()) < 0)
-      return PARENT_FAILED();
+      if((pid = fork()) < 0)
+        return PARENT_FAILED();
 
-    if(pid == 0) {
-      if(message_pipe.close_read() < 0)
-        child_failed(message_pipe.write_fd, args[0]);
+      if(pid == 0) {
+        // We're not running any files from in here.
+        running_pgids.clear();
+        if(setpgid(0, 0) < 0)
+          child_failed(message_pipe.write_fd, args[0]);
 
-      if(message_pipe.write_fd != max_fd) {
-        if(dup2(message_pipe.write_fd, max_fd) < 0)
+        if(message_pipe.close_read() < 0)
           child_failed(message_pipe.write_fd, args[0]);
 
-        if(message_pipe.close_write() < 0)
+        if(message_pipe.write_fd != max_fd) {
+          if(dup2(message_pipe.write_fd, max_fd) < 0)
+            child_failed(message_pipe.write_fd, args[0]);
+
+          if(message_pipe.close_write() < 0)
+            child_failed(max_fd, args[0]);
+        }
+
+        auto protocol = protocol_var();
+        if(putenv(protocol.data()) != 0)
           child_failed(max_fd, args[0]);
+
+        int code;
+        try {
+          code = run_test_module(args);
+        } catch(const std::exception &e) {
+          child_failed(max_fd, args[0], e.what());
+        }
+
+        // Leave without running the driver's atexit handlers and static
+        // destructors, which belong to the parent (e.g. they could flush its
+        // buffered state or remove its files). Just flush our output first.
+        std::cout.flush();
+        std::cerr.flush();
+        std::clog.flush();
+        std::fflush(nullptr);
+        _exit(code);
       }
 
-      execvp(argv[0], argv.get());
-      child_failed(max_fd, args[0]);
-    } else {
-      if(message_pipe.close_write() < 0) {
-        kill(pid, SIGKILL);
+      // Set the child's process group here too, so that it's set before we
+      // could try to kill the group.
+      setpgid(pid, pid);
+      return {true, ""};
+    }
+
+    // Test executables are started with `posix_spawn`, which avoids copying
+    // our page tables (which grow with the results we're holding onto) only
+    // to throw them away when the child calls `exec`.
+    file_result
+    spawn_test_file(const std::vector<std::string> &args,
+                    scoped_pipe &message_pipe, int max_fd, pid_t &pid) {
+      posix_spawnattr_t attr;
+      if((errno = posix_spawnattr_init(&attr)) != 0)
         return PARENT_FAILED();
+      if((errno = posix_spawnattr_setflags(
+            &attr, POSIX_SPAWN_SETPGROUP
+          )) != 0 ||
+         (errno = posix_spawnattr_setpgroup(&attr, 0)) != 0) {
+        auto result = PARENT_FAILED();
+        posix_spawnattr_destroy(&attr);
+        return result;
       }
 
-      std::exception_ptr except;
-      try {
-        namespace io = boost::iostreams;
-        io::stream<io::file_descriptor_source> fds(
-          message_pipe.read_fd, io::never_close_handle
-        );
-        while(fds.peek() != EOF)
-          logger(fds);
-      } catch(...) {
-        except = std::current_exception();
+      posix_spawn_file_actions_t actions;
+      if((errno = posix_spawn_file_actions_init(&actions)) != 0) {
+        auto result = PARENT_FAILED();
+        posix_spawnattr_destroy(&attr);
+        return result;
+      }
+
+      if((errno = posix_spawn_file_actions_addclose(
+            &actions, message_pipe.read_fd
+          )) != 0 ||
+         (message_pipe.write_fd != max_fd && (
+           (errno = posix_spawn_file_actions_adddup2(
+              &actions, message_pipe.write_fd, max_fd
+            )) != 0 ||
+           (errno = posix_spawn_file_actions_addclose(
+              &actions, message_pipe.write_fd
+            )) != 0
+         ))) {
+        auto result = PARENT_FAILED();
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        return result;
+      }
+
+      auto argv = make_argv(args);
+      auto protocol = protocol_var();
+      auto envp = make_envp(protocol);
+      int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv.get(),
+                             envp.data());
+      posix_spawn_file_actions_destroy(&actions);
+      posix_spawnattr_destroy(&attr);
+
+      // If we couldn't start the file, report that in its event stream just
+      // like a forked child would if `exec` failed.
+      if(err != 0) {
+        pid = -1;
+        if(!write_failed_file(message_pipe.write_fd, args[0], err_string(err)))
+          return PARENT_FAILED();
       }
+      return {true, ""};
+    }
+
+    file_result
+    start_test_file(std::vector<std::string> args, scoped_pipe &message_pipe,
+                    pid_t &pid) {
+      pid = -1;
+      if(message_pipe.open() < 0)
+        return PARENT_FAILED();
 
-      int status;
-      if(waitpid(pid, &status, 0) < 0) {
-        kill(pid, SIGKILL);
+      rlimit lim;
+      if(getrlimit(RLIMIT_NOFILE, &lim) < 0)
         return PARENT_FAILED();
+      int max_fd = lim.rlim_cur - 1;
+
+      args.insert(args.end(), { "--output-fd", std::to_string(max_fd) });
+
+      auto result = is_test_module(args[0]) ?
+        fork_test_module(args, message_pipe, max_fd, pid) :
+        spawn_test_file(args, message_pipe, max_fd, pid);
+      if(!result.passed)
+        return result;
+
+      if(pid > 0 && add_running_pgid(pid) < 0) {
+        result = PARENT_FAILED();
+        kill_test_file(pid);
+        return result;
+      }
+
+      if(message_pipe.close_write() < 0) {
+        result = PARENT_FAILED();
+        kill_test_file(pid);
+        return result;
+      }
+      return {true, ""};
+    }
+
+    file_result wait_test_file(pid_t pid, std::exception_ptr except) {
+      // If the file never started, it's already reported that in its events,
+      // so treat it like a child that exited normally.
+      int status = 0;
+      if(pid > 0) {
+        if(waitpid(pid, &status, 0) < 0) {
+          auto result = PARENT_FAILED();
+          kill_test_file(pid);
+          return result;
+        }
+        remove_running_pgid(pid);
       }
 
       if(WIFEXITED(status)) {
@@ -134,6 +347,131 @@ namespace mettle::posix {
         return {false, strsignal(WTERMSIG(status))};
       }
     }
+
+  }
+
+  void forward_signals_to_files(bool forward) {
+    forwarding = forward;
+  }
+
+  file_result run_test_file(std::vector<std::string> args,
+                            const event_reader &read) {
+    scoped_pipe message_pipe;
+    pid_t pid;
+    auto result = start_test_file(std::move(args), message_pipe, pid);
+    if(!result.passed)
+      return result;
+
+    std::exception_ptr except;
+    try {
+      namespace io = boost::iostreams;
+      io::stream<io::file_descriptor_source> fds(
+        message_pipe.read_fd, io::never_close_handle
+      );
+      while(fds.peek() != EOF)
+        read(fds);
+    } catch(const file_cancelled &) {
+      kill_test_file(pid);
+      return cancelled_file();
+    } catch(...) {
+      except = std::current_exception();
+    }
+
+    return wait_test_file(pid, except);
+  }
+
+  struct parallel_file_runner::running_file {
+    pid_t pid;
+    scoped_pipe message_pipe;
+    std::string events;
+    readfd message = {-1, &events};
+    callback_type done;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  parallel_file_runner::parallel_file_runner(std::size_t jobs) : jobs_(jobs) {
+    assert(jobs_ > 0);
+  }
+
+  parallel_file_runner::~parallel_file_runner() {
+    for(auto &i : running_)
+      kill_test_file(i->pid);
+  }
+
+  void parallel_file_runner::run(std::vector<std::string> args,
+                                 callback_type done) {
+    wait_for_slot();
+
+    auto f = std::make_unique<running_file>();
+    f->start = std::chrono::steady_clock::now();
+    auto result = start_test_file(std::move(args), f->message_pipe, f->pid);
+    if(!result.passed)
+      return done("", result);
+
+    f->message.fd = f->message_pipe.read_fd;
+    if(loop_.watch(f->message) < 0) {
+      result = PARENT_FAILED();
+      kill_test_file(f->pid);
+      return done("", result);
+    }
+
+    f->done = std::move(done);
+    running_.push_back(std::move(f));
+  }
+
+  void parallel_file_runner::wait() {
+    while(!running_.empty())
+      wait_any();
+  }
+
+  void parallel_file_runner::wait_for_slot() {
+    while(running_.size() >= jobs_)
+      wait_any();
+  }
+
+  void parallel_file_runner::cancel() {
+    auto running = std::move(running_);
+    running_.clear();
+    for(auto &f : running) {
+      loop_.unwatch(f->message);
+      kill_test_file(f->pid);
+      auto result = cancelled_file();
+      result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - f->start
+      );
+      f->done("", result);
+    }
+  }
+
+  void parallel_file_runner::wait_any() {
+    if(loop_.wait() < 0) {
+      // We can't wait for any of the files, so give up on all of them.
+      auto result = PARENT_FAILED();
+      auto running = std::move(running_);
+      running_.clear();
+      for(auto &f : running) {
+        loop_.unwatch(f->message);
+        kill_test_file(f->pid);
+        f->done(std::move(f->events), result);
+      }
+      return;
+    }
+
+    for(std::size_t i = 0; i != running_.size();) {
+      // Once the file closes its end of the pipe, it's finished.
+      if(running_[i]->message.fd >= 0) {
+        i++;
+        continue;
+      }
+
+      auto done = std::move(running_[i]);
+      running_.erase(running_.begin() + i);
+      auto result = wait_test_file(done->pid, nullptr);
+      result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - done->start
+      );
+      done->done(std::move(done->events), result);
+    }
   }
 
 } // namespace mettle::posix
@@ -1,21 +1,75 @@
 #ifndef INC_METTLE_SRC_POSIX_RUN_TEST_FILE_HPP
 #define INC_METTLE_SRC_POSIX_RUN_TEST_FILE_HPP
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <mettle/driver/posix/event_loop.hpp>
+
 #include "../log_pipe.hpp"
 #include "../run_test_files.hpp"
 
 namespace mettle::posix {
 
-  file_result run_test_file(std::vector<std::string> args, log::pipe &logger);
+  // By default, the first test file we start installs handlers that pass any
+  // SIGINT or SIGQUIT we get on to the running test files (which are in their
+  // own process groups) before handling the signal as usual. Call this with
+  // `false` before starting any files to leave the signals to the caller.
+  void forward_signals_to_files(bool forward);
+
+  // Run a test file, passing the stream of events it sends back to `read`
+  // until the file closes it.
+  file_result run_test_file(std::vector<std::string> args,
+                            const event_reader &read);
+
+  inline file_result
+  run_test_file(std::vector<std::string> args, log::pipe &logger) {
+    return run_test_file(std::move(args), event_reader(std::ref(logger)));
+  }
 
   inline file_result
   run_test_file(std::vector<std::string> args, log::pipe &&logger) {
     return run_test_file(std::move(args), logger);
   }
 
+  // Runs several test files at once. Rather than decoding each file's events
+  // as they arrive, this buffers them and passes the raw event stream to `done`
+  // once the file finishes. Each file runs in its own process group.
+  class parallel_file_runner {
+  public:
+    using callback_type = std::function<
+      void(std::string &&events, const file_result &result)
+    >;
+
+    parallel_file_runner(std::size_t jobs);
+    parallel_file_runner(const parallel_file_runner &) = delete;
+    parallel_file_runner & operator =(const parallel_file_runner &) = delete;
+    ~parallel_file_runner();
+
+    void run(std::vector<std::string> args, callback_type done);
+    void wait();
+    // Wait until there's room to start another file without blocking.
+    void wait_for_slot();
+    // Wait until at least one file finishes.
+    void wait_any();
+    // Kill the process groups of all the running files, passing each one's
+    // `done` callback no events and a result of `cancelled_file()`. This must
+    // not be called from a callback.
+    void cancel();
+
+    bool empty() const {
+      return running_.empty();
+    }
+  private:
+    struct running_file;
+
+    std::size_t jobs_;
+    event_loop loop_;
+    std::vector<std::unique_ptr<running_file>> running_;
+  };
+
 } // namespace mettle::posix
 
 #endif
@@ -0,0 +1,427 @@
+#include "server.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <bencode.hpp>
+
+#include <mettle/driver/exit_code.hpp>
+
+extern char **environ;
+
+namespace mettle::posix {
+
+  namespace {
+    sockaddr_un make_address(const std::string &path) {
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      if(path.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("socket path \"" + path +
+                                    "\" is too long");
+      }
+      std::strcpy(addr.sun_path, path.c_str());
+      return addr;
+    }
+
+    // Make sure that the test files we run don't inherit our sockets.
+    void set_cloexec(int fd) {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    int make_socket() {
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if(fd < 0)
+        throw std::system_error(errno, std::system_category());
+      set_cloexec(fd);
+#ifdef SO_NOSIGPIPE
+      int on = 1;
+      setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+      return fd;
+    }
+
+    // Check that the process on the other end of a connection is running as
+    // the same user we are, since it gets to run commands as us.
+    bool same_user(int fd) {
+#ifdef SO_PEERCRED
+      ucred cred;
+      socklen_t len = sizeof(cred);
+      if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return false;
+      uid_t uid = cred.uid;
+#else
+      uid_t uid;
+      gid_t gid;
+      if(getpeereid(fd, &uid, &gid) < 0)
+        return false;
+#endif
+      return uid == geteuid();
+    }
+
+    // Send a whole buffer, without raising SIGPIPE if the other end is gone
+    // (e.g. because the client was interrupted).
+    bool send_all(int fd, const std::string &data) {
+#ifdef MSG_NOSIGNAL
+      constexpr int flags = MSG_NOSIGNAL;
+#else
+      constexpr int flags = 0;
+#endif
+      for(std::size_t sent = 0; sent != data.size();) {
+        auto n = send(fd, data.data() + sent, data.size() - sent, flags);
+        if(n < 0) {
+          if(errno == EINTR)
+            continue;
+          return false;
+        }
+        sent += static_cast<std::size_t>(n);
+      }
+      return true;
+    }
+
+    // Write a whole buffer to a file descriptor.
+    bool write_all(int fd, const std::string &data) {
+      for(std::size_t written = 0; written != data.size();) {
+        auto n = write(fd, data.data() + written, data.size() - written);
+        if(n < 0) {
+          if(errno == EINTR)
+            continue;
+          return false;
+        }
+        written += static_cast<std::size_t>(n);
+      }
+      return true;
+    }
+
+    // The client's stdout and stderr are passed to the server along with the
+    // first byte of the request, so that the tests (and anything they run) can
+    // write to them directly.
+    constexpr std::size_t passed_fds = 2;
+    constexpr int standard_fds[passed_fds] = {STDOUT_FILENO, STDERR_FILENO};
+    using control_buffer = union {
+      cmsghdr header;
+      char data[CMSG_SPACE(sizeof(int) * passed_fds)];
+    };
+
+    bool send_fds(int fd, const int (&fds)[passed_fds]) {
+      char byte = 0;
+      iovec iov = {&byte, 1};
+      control_buffer control = {};
+
+      msghdr msg = {};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control.data;
+      msg.msg_controllen = sizeof(control.data);
+
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+      std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+      ssize_t n;
+      while((n = sendmsg(fd, &msg, 0)) < 0 && errno == EINTR) {}
+      return n == 1;
+    }
+
+    bool receive_fds(int fd, int (&fds)[passed_fds]) {
+      char byte;
+      iovec iov = {&byte, 1};
+      control_buffer control;
+
+      msghdr msg = {};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control.data;
+      msg.msg_controllen = sizeof(control.data);
+
+      ssize_t n;
+      while((n = recvmsg(fd, &msg, 0)) < 0 && errno == EINTR) {}
+      if(n != 1)
+        return false;
+
+      // Take ownership of whatever we were sent before checking it, so that
+      // nothing leaks if the client sent the wrong number of descriptors.
+      std::vector<int> received;
+      for(auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+          cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+          continue;
+        std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for(std::size_t i = 0; i != count; i++) {
+          int passed;
+          std::memcpy(&passed, CMSG_DATA(cmsg) + i * sizeof(int),
+                      sizeof(int));
+          set_cloexec(passed);
+          received.push_back(passed);
+        }
+      }
+
+      if(received.size() != passed_fds || (msg.msg_flags & MSG_CTRUNC)) {
+        for(int i : received)
+          close(i);
+        return false;
+      }
+      std::copy(received.begin(), received.end(), fds);
+      return true;
+    }
+
+    std::vector<std::string> current_environment() {
+      std::vector<std::string> env;
+      for(char **i = environ; *i; i++)
+        env.emplace_back(*i);
+      return env;
+    }
+
+    void replace_environment(const std::vector<std::string> &env) {
+      for(const auto &i : current_environment())
+        unsetenv(i.substr(0, i.find('=')).c_str());
+      for(const auto &i : env) {
+        auto eq = i.find('=');
+        if(eq != std::string::npos && eq != 0)
+          setenv(i.substr(0, eq).c_str(), i.c_str() + eq + 1, 1);
+      }
+    }
+
+    std::string current_directory() {
+      std::string result(256, '\0');
+      while(!getcwd(result.data(), result.size())) {
+        if(errno != ERANGE)
+          throw std::system_error(errno, std::system_category());
+        result.resize(result.size() * 2);
+      }
+      result.resize(std::strlen(result.c_str()));
+      return result;
+    }
+
+    std::vector<std::string> read_strings(bencode::data &list) {
+      std::vector<std::string> result;
+      for(auto &&i : boost::get<bencode::list>(list))
+        result.push_back(std::move(boost::get<bencode::string>(i)));
+      return result;
+    }
+
+    // Switches to a request's directory, environment, and standard streams,
+    // restoring ours once we're done with it (even if the request fails).
+    // These are all process-wide, so requests must be handled one at a time,
+    // and nothing else in the server may run while one is in progress.
+    class request_scope {
+    public:
+      request_scope(const server_request &request, const int (&fds)[passed_fds])
+        : cwd_(current_directory()), env_(current_environment()) {
+        flush_all();
+        for(std::size_t i = 0; i != passed_fds; i++) {
+          saved_[i] = fcntl(standard_fds[i], F_DUPFD_CLOEXEC, 0);
+          if(saved_[i] < 0 || dup2(fds[i], standard_fds[i]) < 0) {
+            int e = errno;
+            restore();
+            throw std::system_error(e, std::system_category());
+          }
+        }
+
+        if(chdir(request.cwd.c_str()) < 0) {
+          int e = errno;
+          restore();
+          throw std::system_error(e, std::system_category(),
+                                  "unable to change to \"" + request.cwd +
+                                  "\"");
+        }
+        replace_environment(request.env);
+      }
+
+      ~request_scope() {
+        restore();
+      }
+    private:
+      static void flush_all() {
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+      }
+
+      void restore() {
+        flush_all();
+        for(std::size_t i = 0; i != passed_fds; i++) {
+          if(saved_[i] >= 0) {
+            dup2(saved_[i], standard_fds[i]);
+            close(saved_[i]);
+            saved_[i] = -1;
+          }
+        }
+        replace_environment(env_);
+        if(chdir(cwd_.c_str()) < 0) {
+          // There's nowhere sensible to go, so just stay put.
+        }
+      }
+
+      std::string cwd_;
+      std::vector<std::string> env_;
+      int saved_[passed_fds] = {-1, -1};
+    };
+  }
+
+  server::server(std::string path)
+    : path_(std::move(path)), fd_(-1), stop_fds_{-1, -1} {
+    auto addr = make_address(path_);
+    fd_ = make_socket();
+
+    // Replace a socket left behind by an earlier server, but don't steal one
+    // that's still in use.
+    int probe = make_socket();
+    bool in_use = connect(probe, reinterpret_cast<sockaddr *>(&addr),
+                          sizeof(addr)) == 0;
+    close(probe);
+    if(in_use) {
+      close(fd_);
+      throw std::runtime_error("a server is already listening on \"" + path_ +
+                               "\"");
+    }
+    unlink(path_.c_str());
+
+    // Only let our own user connect. Nobody can connect until we call
+    // `listen`, so there's no window where the socket is open to others.
+    if(bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+       chmod(path_.c_str(), 0600) < 0 || listen(fd_, 16) < 0) {
+      int err = errno;
+      close(fd_);
+      throw std::system_error(err, std::system_category(),
+                              "unable to listen on \"" + path_ + "\"");
+    }
+
+    // `stop()` writes to this pipe to wake us up while we wait for a request.
+    if(pipe(stop_fds_) < 0) {
+      int err = errno;
+      close(fd_);
+      unlink(path_.c_str());
+      throw std::system_error(err, std::system_category());
+    }
+    set_cloexec(stop_fds_[0]);
+    set_cloexec(stop_fds_[1]);
+    fcntl(stop_fds_[1], F_SETFL, O_NONBLOCK);
+  }
+
+  server::~server() {
+    close(fd_);
+    close(stop_fds_[0]);
+    close(stop_fds_[1]);
+    unlink(path_.c_str());
+  }
+
+  void server::stop() {
+    int old_errno = errno;
+    [[maybe_unused]] auto rv = write(stop_fds_[1], "", 1);
+    errno = old_errno;
+  }
+
+  bool server::handle_one(const request_handler &handle) {
+    int conn;
+    while(true) {
+      pollfd fds[] = {{fd_, POLLIN, 0}, {stop_fds_[0], POLLIN, 0}};
+      if(poll(fds, 2, -1) < 0) {
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::system_category());
+      }
+      // Leave the byte in the pipe, so that we stay stopped.
+      if(fds[1].revents)
+        return false;
+
+      if((conn = accept(fd_, nullptr, nullptr)) >= 0)
+        break;
+      if(errno != EINTR && errno != ECONNABORTED)
+        throw std::system_error(errno, std::system_category());
+    }
+    set_cloexec(conn);
+    if(!same_user(conn)) {
+      close(conn);
+      return true;
+    }
+
+    int client_fds[passed_fds];
+    if(!receive_fds(conn, client_fds)) {
+      close(conn);
+      return true;
+    }
+    struct fds_closer {
+      ~fds_closer() {
+        for(int i : fds)
+          close(i);
+      }
+      const int (&fds)[passed_fds];
+    } closer{client_fds};
+
+    namespace io = boost::iostreams;
+    io::stream<io::file_descriptor_source> in(conn, io::close_handle);
+
+    server_request request;
+    try {
+      auto tmp = bencode::decode(in, bencode::no_check_eof);
+      auto &data = boost::get<bencode::dict>(tmp);
+      request.args = read_strings(data.at("args"));
+      request.cwd = std::move(boost::get<bencode::string>(data.at("cwd")));
+      request.env = read_strings(data.at("env"));
+    } catch(...) {
+      // Ignore malformed requests; the client will see the connection close.
+      return true;
+    }
+
+    int code;
+    try {
+      request_scope scope(request, client_fds);
+      code = handle(request);
+    } catch(const std::exception &e) {
+      // By now, our own stderr is back in place, so write to the client's.
+      write_all(client_fds[1], std::string(e.what()) + "\n");
+      code = exit_code::unknown_error;
+    }
+    send_all(conn, bencode::encode(bencode::dict_view{{"exit", code}}));
+    return true;
+  }
+
+  int send_request(const std::string &path, const server_request &request,
+                   int out_fd, int err_fd) {
+    auto addr = make_address(path);
+    int fd = make_socket();
+    namespace io = boost::iostreams;
+    io::stream<io::file_descriptor_source> in(fd, io::close_handle);
+
+    if(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "unable to connect to \"" + path + "\"");
+    }
+
+    bencode::list_view args(request.args.begin(), request.args.end()),
+                       env(request.env.begin(), request.env.end());
+    if(!send_fds(fd, {out_fd, err_fd}) ||
+       !send_all(fd, bencode::encode(bencode::dict_view{
+         {"args", std::move(args)}, {"cwd", request.cwd},
+         {"env", std::move(env)}
+       }))) {
+      throw std::system_error(errno, std::system_category(),
+                              "unable to send request");
+    }
+
+    if(in.peek() != EOF) {
+      auto tmp = bencode::decode(in, bencode::no_check_eof);
+      auto &data = boost::get<bencode::dict>(tmp);
+      return static_cast<int>(boost::get<bencode::integer>(data.at("exit")));
+    }
+    throw std::runtime_error("server closed the connection");
+  }
+
+} // namespace mettle::posix
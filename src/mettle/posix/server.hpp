@@ -0,0 +1,63 @@
+#ifndef INC_METTLE_SRC_POSIX_SERVER_HPP
+#define INC_METTLE_SRC_POSIX_SERVER_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mettle::posix {
+
+  // A request for a `mettle` server to run the driver on a client's behalf.
+  struct server_request {
+    // The command-line arguments, not including the program name.
+    std::vector<std::string> args;
+    std::string cwd;
+    // The client's environment, as `NAME=value` strings.
+    std::vector<std::string> env;
+  };
+
+  using request_handler = std::function<int(const server_request &)>;
+
+  // Listens on a Unix-domain socket for requests, handling them one at a
+  // time. Only one server can use a socket at once; any stale socket file at
+  // `path` is replaced. The socket is only accessible to the current user,
+  // and connections from any other user are dropped.
+  class server {
+  public:
+    server(std::string path);
+    server(const server &) = delete;
+    server & operator =(const server &) = delete;
+    ~server();
+
+    // Wait for the next request and pass it to `handle`. While the handler
+    // runs, the current directory and environment are the client's, and file
+    // descriptors 1 and 2 are the client's stdout and stderr, so anything
+    // written to them (including by child processes) goes straight to the
+    // client. The handler's exit code is then sent back. Since this changes
+    // process-wide state, requests are handled serially: never call this
+    // from more than one thread at once, or while other threads depend on the
+    // directory, environment, or standard streams. All of these are restored
+    // afterwards, even if the request fails.
+    //
+    // Returns false without handling anything once `stop()` has been called.
+    bool handle_one(const request_handler &handle);
+
+    // Make any current or future call to `handle_one()` return false once it's
+    // done with the request it's handling, if any. This is safe to call from
+    // a signal handler.
+    void stop();
+  private:
+    std::string path_;
+    int fd_;
+    int stop_fds_[2];
+  };
+
+  // Send a request to the server listening on `path`, passing along `out_fd`
+  // and `err_fd` for the request's output to be written to. Returns the exit
+  // code of the request.
+  int send_request(const std::string &path, const server_request &request,
+                   int out_fd, int err_fd);
+
+} // namespace mettle::posix
+
+#endif
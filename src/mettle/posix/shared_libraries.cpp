@@ -0,0 +1,288 @@
+#include "shared_libraries.hpp"
+
+#ifdef __linux__
+#  include <elf.h>
+
+#  include <cstdint>
+#  include <cstdlib>
+#  include <cstring>
+#  include <deque>
+#  include <fstream>
+#  include <optional>
+#  include <set>
+#  include <stdexcept>
+
+#  include "../glob.hpp"
+#endif
+
+namespace mettle::posix {
+
+#ifdef __linux__
+
+  namespace {
+
+    // The parts of an ELF object's dynamic section that affect how its
+    // dependencies are found.
+    struct elf_info {
+      unsigned char elf_class;
+      std::uint16_t machine;
+      std::vector<std::string> needed;
+      std::optional<std::string> rpath, runpath;
+    };
+
+    template<typename T>
+    bool read_at(std::istream &is, std::uint64_t offset, T *value,
+                 std::size_t count = 1) {
+      is.seekg(static_cast<std::streamoff>(offset));
+      is.read(reinterpret_cast<char *>(value), sizeof(T) * count);
+      return bool(is);
+    }
+
+    template<typename Ehdr, typename Phdr, typename Dyn>
+    std::optional<elf_info>
+    read_elf(std::istream &is, const Ehdr &ehdr) {
+      elf_info info = {ehdr.e_ident[EI_CLASS], ehdr.e_machine, {}, {}, {}};
+      if(ehdr.e_phentsize != sizeof(Phdr))
+        return std::nullopt;
+
+      std::vector<Phdr> phdrs(ehdr.e_phnum);
+      if(!read_at(is, ehdr.e_phoff, phdrs.data(), phdrs.size()))
+        return std::nullopt;
+
+      // The dynamic section refers to the string table by its address, so
+      // find the segment it's loaded from to get its position in the file.
+      auto to_offset = [&phdrs](std::uint64_t addr)
+        -> std::optional<std::uint64_t> {
+        for(const auto &i : phdrs) {
+          if(i.p_type == PT_LOAD && addr >= i.p_vaddr &&
+             addr < i.p_vaddr + i.p_filesz)
+            return addr - i.p_vaddr + i.p_offset;
+        }
+        return std::nullopt;
+      };
+
+      for(const auto &i : phdrs) {
+        if(i.p_type != PT_DYNAMIC)
+          continue;
+
+        std::vector<Dyn> dyns(i.p_filesz / sizeof(Dyn));
+        if(!read_at(is, i.p_offset, dyns.data(), dyns.size()))
+          return std::nullopt;
+
+        std::uint64_t strtab = 0, strsz = 0;
+        std::vector<std::uint64_t> needed;
+        std::optional<std::uint64_t> rpath, runpath;
+        for(const auto &d : dyns) {
+          if(d.d_tag == DT_NULL)
+            break;
+          switch(d.d_tag) {
+          case DT_NEEDED:  needed.push_back(d.d_un.d_val); break;
+          case DT_STRTAB:  strtab = d.d_un.d_ptr;          break;
+          case DT_STRSZ:   strsz = d.d_un.d_val;           break;
+          case DT_RPATH:   rpath = d.d_un.d_val;           break;
+          case DT_RUNPATH: runpath = d.d_un.d_val;         break;
+          }
+        }
+
+        auto offset = to_offset(strtab);
+        if(!offset)
+          return std::nullopt;
+        std::string strings(strsz, '\0');
+        if(!read_at(is, *offset, strings.data(), strings.size()))
+          return std::nullopt;
+
+        auto get = [&strings](std::uint64_t i) {
+          return i < strings.size() ? std::string(strings.c_str() + i) :
+                                      std::string();
+        };
+        for(auto n : needed)
+          info.needed.push_back(get(n));
+        if(rpath)
+          info.rpath = get(*rpath);
+        if(runpath)
+          info.runpath = get(*runpath);
+        break;
+      }
+      return info;
+    }
+
+    std::optional<elf_info> read_elf(const std::string &file) {
+      std::ifstream is(file, std::ios::binary);
+      unsigned char ident[EI_NIDENT];
+      if(!is.read(reinterpret_cast<char *>(ident), sizeof(ident)) ||
+         std::memcmp(ident, ELFMAG, SELFMAG) != 0)
+        return std::nullopt;
+
+      // We only handle objects in our own byte order, since that's all we
+      // could run anyway.
+      if(ident[EI_DATA] != (__BYTE_ORDER == __LITTLE_ENDIAN ? ELFDATA2LSB :
+                                                             ELFDATA2MSB))
+        return std::nullopt;
+
+      if(ident[EI_CLASS] == ELFCLASS64) {
+        Elf64_Ehdr ehdr;
+        if(!read_at(is, 0, &ehdr))
+          return std::nullopt;
+        return read_elf<Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn>(is, ehdr);
+      } else if(ident[EI_CLASS] == ELFCLASS32) {
+        Elf32_Ehdr ehdr;
+        if(!read_at(is, 0, &ehdr))
+          return std::nullopt;
+        return read_elf<Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn>(is, ehdr);
+      }
+      return std::nullopt;
+    }
+
+    std::string dirname(const std::string &path) {
+      auto slash = path.rfind('/');
+      if(slash == std::string::npos)
+        return ".";
+      return slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    // Split a colon-separated search path, expanding `$ORIGIN` to the
+    // directory of the object it came from.
+    std::vector<std::string>
+    split_path(const std::string &path, const std::string &origin = "") {
+      std::vector<std::string> result;
+      std::size_t start = 0;
+      while(true) {
+        auto end = path.find_first_of(":;", start);
+        auto dir = path.substr(start, end - start);
+        for(const char *var : {"${ORIGIN}", "$ORIGIN"}) {
+          for(auto i = dir.find(var); i != std::string::npos;
+              i = dir.find(var, i + origin.size()))
+            dir.replace(i, std::strlen(var), origin);
+        }
+        if(!dir.empty())
+          result.push_back(std::move(dir));
+        if(end == std::string::npos)
+          break;
+        start = end + 1;
+      }
+      return result;
+    }
+
+    void read_ld_so_conf(const std::string &file,
+                         std::vector<std::string> &dirs, int depth = 0) {
+      if(depth > 8)
+        return;
+
+      std::ifstream is(file);
+      std::string line;
+      while(std::getline(is, line)) {
+        line = line.substr(0, line.find('#'));
+        auto start = line.find_first_not_of(" \t\r");
+        if(start == std::string::npos)
+          continue;
+        line = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+
+        if(line.compare(0, 8, "include ") == 0) {
+          auto pattern = line.substr(line.find_first_not_of(" \t", 8));
+          if(pattern[0] != '/')
+            pattern = dirname(file) + "/" + pattern;
+          try {
+            for(const char *i : glob(pattern))
+              read_ld_so_conf(i, dirs, depth + 1);
+          } catch(const std::runtime_error &) {
+            // No files match, so there's nothing to include.
+          }
+        } else {
+          dirs.push_back(line);
+        }
+      }
+    }
+
+    const std::vector<std::string> & system_dirs() {
+      static const std::vector<std::string> dirs = []() {
+        std::vector<std::string> dirs;
+        read_ld_so_conf("/etc/ld.so.conf", dirs);
+        for(const char *i : {"/lib64", "/usr/lib64", "/lib", "/usr/lib"})
+          dirs.push_back(i);
+        return dirs;
+      }();
+      return dirs;
+    }
+
+    // Find the library `name` needed by `object`, which was (possibly
+    // indirectly) loaded by `exe`.
+    std::optional<std::string>
+    find_library(const std::string &name, const std::string &object,
+                 const elf_info &info, const elf_info &exe,
+                 const std::string &exe_path) {
+      if(name.find('/') != std::string::npos)
+        return name;
+
+      std::vector<std::string> dirs;
+      if(!info.runpath) {
+        if(info.rpath) {
+          auto rpath = split_path(*info.rpath, dirname(object));
+          dirs.insert(dirs.end(), rpath.begin(), rpath.end());
+        }
+        if(!exe.runpath && exe.rpath && object != exe_path) {
+          auto rpath = split_path(*exe.rpath, dirname(exe_path));
+          dirs.insert(dirs.end(), rpath.begin(), rpath.end());
+        }
+      }
+      if(const char *env = std::getenv("LD_LIBRARY_PATH")) {
+        auto ld_path = split_path(env);
+        dirs.insert(dirs.end(), ld_path.begin(), ld_path.end());
+      }
+      if(info.runpath) {
+        auto runpath = split_path(*info.runpath, dirname(object));
+        dirs.insert(dirs.end(), runpath.begin(), runpath.end());
+      }
+      const auto &sys = system_dirs();
+      dirs.insert(dirs.end(), sys.begin(), sys.end());
+
+      for(const auto &dir : dirs) {
+        auto path = dir + "/" + name;
+        // Skip libraries for other architectures, just like the loader does.
+        auto lib = read_elf(path);
+        if(lib && lib->elf_class == exe.elf_class &&
+           lib->machine == exe.machine)
+          return path;
+      }
+      return std::nullopt;
+    }
+
+  }
+
+  std::vector<std::string> shared_libraries(const std::string &file) {
+    auto exe = read_elf(file);
+    if(!exe)
+      return {};
+
+    std::vector<std::string> result;
+    std::set<std::string> seen;
+    std::deque<std::pair<std::string, elf_info>> queue;
+    queue.emplace_back(file, *exe);
+    while(!queue.empty()) {
+      auto [object, info] = std::move(queue.front());
+      queue.pop_front();
+
+      for(const auto &name : info.needed) {
+        // The loader only loads each library once, no matter who needs it.
+        if(!seen.insert(name).second)
+          continue;
+
+        auto path = find_library(name, object, info, *exe, file);
+        if(!path)
+          continue;
+        result.push_back(*path);
+        if(auto lib = read_elf(*path))
+          queue.emplace_back(*path, std::move(*lib));
+      }
+    }
+    return result;
+  }
+
+#else
+
+  std::vector<std::string> shared_libraries(const std::string &) {
+    return {};
+  }
+
+#endif
+
+} // namespace mettle::posix
@@ -0,0 +1,19 @@
+#ifndef INC_METTLE_SRC_POSIX_SHARED_LIBRARIES_HPP
+#define INC_METTLE_SRC_POSIX_SHARED_LIBRARIES_HPP
+
+#include <string>
+#include <vector>
+
+namespace mettle::posix {
+
+  // Find the shared libraries that the executable `file` loads, directly or
+  // indirectly, resolving each `DT_NEEDED` entry the way the dynamic loader
+  // would (via `DT_RPATH`/`DT_RUNPATH`, `LD_LIBRARY_PATH`, `ld.so.conf` and
+  // the default directories). Libraries that can't be found are skipped, since
+  // the loader will complain about them soon enough. This is only implemented
+  // for ELF on Linux; elsewhere, it returns nothing.
+  std::vector<std::string> shared_libraries(const std::string &file);
+
+} // namespace mettle::posix
+
+#endif
@@ -0,0 +1,71 @@
+#include "test_module.hpp"
+
+#include <dlfcn.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+#include <mettle/driver/test_module.hpp>
+
+#include "../test_command.hpp"
+
+namespace mettle::posix {
+
+  namespace {
+    // The standard streams might be redirected by the time we load a module
+    // (e.g. to a `--serve` client), so remember where they originally
+    // pointed.
+    struct original_streams {
+      original_streams()
+        : out(std::cout.rdbuf()), err(std::cerr.rdbuf()),
+          log(std::clog.rdbuf()) {}
+
+      void restore() const {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+        std::clog.rdbuf(log);
+      }
+
+      std::streambuf *out, *err, *log;
+    };
+
+    const original_streams streams;
+  }
+
+  bool is_test_module(const std::string &file) {
+    for(std::string_view ext : {".so", ".dylib"}) {
+      if(file.size() > ext.size() &&
+         file.compare(file.size() - ext.size(), ext.size(), ext) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  int run_test_module(const std::vector<std::string> &args) {
+    // Find the module the same way `execvp` would find an executable, but
+    // don't let `dlopen` search the library path for it.
+    auto path = find_executable(args[0]);
+    if(path.find('/') == std::string::npos)
+      path = "./" + path;
+
+    void *module = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(!module)
+      throw std::runtime_error(dlerror());
+    auto entry = reinterpret_cast<detail::test_module_entry *>(
+      dlsym(module, detail::test_module_entry_name)
+    );
+    if(!entry)
+      throw std::runtime_error("\"" + args[0] + "\" is not a test module");
+
+    streams.restore();
+
+    std::vector<const char *> argv;
+    for(const auto &i : args)
+      argv.push_back(i.c_str());
+    argv.push_back(nullptr);
+    return detail::drive_tests(static_cast<int>(args.size()), argv.data(),
+                               *entry());
+  }
+
+} // namespace mettle::posix
@@ -0,0 +1,23 @@
+#ifndef INC_METTLE_SRC_POSIX_TEST_MODULE_HPP
+#define INC_METTLE_SRC_POSIX_TEST_MODULE_HPP
+
+#include <string>
+#include <vector>
+
+namespace mettle::posix {
+
+  // Check whether `file` names a test module (a shared library built with
+  // `METTLE_TEST_MODULE`) rather than a test executable.
+  bool is_test_module(const std::string &file);
+
+  // Load the test module named by `args[0]` into this process and run its
+  // tests, passing `args` to it as its command line, and return the exit code.
+  // This is meant to be called in a freshly-forked copy of the driver, which
+  // already has libmettle and its dependencies loaded and initialized, so the
+  // module's startup costs next to nothing. Throws if the module can't be
+  // loaded.
+  int run_test_module(const std::vector<std::string> &args);
+
+} // namespace mettle::posix
+
+#endif
@@ -0,0 +1,291 @@
+#include "result_cache.hpp"
+#include "test_command.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  include "posix/shared_libraries.hpp"
+#else
+#  include <direct.h>
+#  include <process.h>
+#endif
+
+namespace mettle {
+
+  namespace {
+    constexpr char file_header[] = "# mettle result cache v2";
+
+    // A SHA-256 hash, which is stable across platforms and builds. We use
+    // this for file contents and cache keys, so a collision would mean
+    // reporting stale results for a changed test file.
+    class sha256 {
+    public:
+      void update(const char *data, std::size_t size) {
+        size_ += size;
+        while(size) {
+          std::size_t n = std::min(size, sizeof(block_) - used_);
+          std::memcpy(block_ + used_, data, n);
+          used_ += n;
+          data += n;
+          size -= n;
+          if(used_ == sizeof(block_)) {
+            compress();
+            used_ = 0;
+          }
+        }
+      }
+
+      void update(const std::string &s) {
+        update(s.data(), s.size());
+      }
+
+      std::string hex() {
+        std::uint64_t bits = size_ * 8;
+        block_[used_++] = static_cast<unsigned char>(0x80);
+        if(used_ > 56) {
+          std::memset(block_ + used_, 0, sizeof(block_) - used_);
+          compress();
+          used_ = 0;
+        }
+        std::memset(block_ + used_, 0, 56 - used_);
+        for(int i = 0; i != 8; i++)
+          block_[63 - i] = static_cast<unsigned char>(bits >> (i * 8));
+        compress();
+        used_ = 0;
+
+        std::ostringstream ss;
+        for(auto i : state_)
+          ss << std::hex << std::setw(8) << std::setfill('0') << i;
+        return ss.str();
+      }
+    private:
+      static std::uint32_t rotr(std::uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+      }
+
+      void compress() {
+        static constexpr std::uint32_t k[64] = {
+          0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+          0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+          0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+          0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+          0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+          0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+          0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+          0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+          0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+          0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+          0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+          0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+          0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        std::uint32_t w[64];
+        for(int i = 0; i != 16; i++) {
+          w[i] = (std::uint32_t(block_[i * 4]) << 24) |
+                 (std::uint32_t(block_[i * 4 + 1]) << 16) |
+                 (std::uint32_t(block_[i * 4 + 2]) << 8) |
+                 std::uint32_t(block_[i * 4 + 3]);
+        }
+        for(int i = 16; i != 64; i++) {
+          auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+                    (w[i - 15] >> 3);
+          auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+          w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto v = state_;
+        for(int i = 0; i != 64; i++) {
+          auto s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+          auto ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+          auto t1 = v[7] + s1 + ch + k[i] + w[i];
+          auto s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+          auto maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+          auto t2 = s0 + maj;
+          v = {t1 + t2, v[0], v[1], v[2], v[3] + t1, v[4], v[5], v[6]};
+        }
+        for(int i = 0; i != 8; i++)
+          state_[i] += v[i];
+      }
+
+      std::array<std::uint32_t, 8> state_ = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+      };
+      unsigned char block_[64];
+      std::size_t used_ = 0;
+      std::uint64_t size_ = 0;
+    };
+
+    // Write a field with its length, so that no value can be mistaken for
+    // another (e.g. two arguments for one with a space in it).
+    void write_field(std::ostream &os, const char *kind,
+                     const std::string &value) {
+      os << kind << ' ' << value.size() << ':' << value << '\n';
+    }
+
+    void make_dir(const std::string &dir) {
+#ifndef _WIN32
+      mkdir(dir.c_str(), 0777);
+#else
+      _mkdir(dir.c_str());
+#endif
+    }
+
+    int process_id() {
+#ifndef _WIN32
+      return getpid();
+#else
+      return _getpid();
+#endif
+    }
+  }
+
+  const std::vector<std::string> result_cache::default_env = {
+    "LD_LIBRARY_PATH", "LD_PRELOAD"
+  };
+
+  result_cache::result_cache(std::string dir, std::vector<std::string> env)
+    : dir_(std::move(dir)), env_(default_env) {
+    env_.insert(env_.end(), env.begin(), env.end());
+  }
+
+  std::string result_cache::manifest(const std::vector<std::string> &args) {
+    std::ostringstream ss;
+    write_field(ss, "mettle", METTLE_VERSION);
+    for(const auto &i : args)
+      write_field(ss, "arg", i);
+
+    if(!args.empty()) {
+      auto exe = find_executable(args[0]);
+      write_field(ss, "file", exe + " " + file_digest(exe));
+#ifndef _WIN32
+      for(const auto &i : posix::shared_libraries(exe))
+        write_field(ss, "file", i + " " + file_digest(i));
+#endif
+    }
+
+    for(const auto &i : env_) {
+      const char *value = std::getenv(i.c_str());
+      write_field(ss, value ? "env" : "unset", value ? i + "=" + value : i);
+    }
+    return ss.str();
+  }
+
+  std::optional<std::string>
+  result_cache::find(const std::string &manifest) const {
+    auto found = memory_.find(manifest);
+    if(found != memory_.end())
+      return found->second;
+    if(dir_.empty())
+      return std::nullopt;
+
+    std::ifstream is(entry_path(manifest), std::ios::binary);
+    std::string line;
+    if(!std::getline(is, line) || line != file_header)
+      return std::nullopt;
+
+    // Make sure this is really the entry for our manifest, and not just one
+    // whose hash happens to collide.
+    std::size_t size;
+    if(!(is >> size) || is.get() != '\n' || size != manifest.size())
+      return std::nullopt;
+    std::string stored(size, '\0');
+    if(!is.read(stored.data(), size) || stored != manifest)
+      return std::nullopt;
+
+    std::ostringstream events;
+    if(is.peek() != EOF && !(events << is.rdbuf()))
+      return std::nullopt;
+    return memory_.emplace(manifest, events.str()).first->second;
+  }
+
+  void result_cache::store(const std::string &manifest,
+                           const std::string &events) const {
+    memory_[manifest] = events;
+    if(dir_.empty())
+      return;
+
+    make_dir(dir_);
+
+    // Write to a temporary file and rename it into place, so that anyone
+    // else using the cache at the same time never sees a partial entry.
+    auto path = entry_path(manifest);
+    auto temp = path + "." + std::to_string(process_id()) + ".tmp";
+    {
+      std::ofstream os(temp, std::ios::binary);
+      os << file_header << '\n' << manifest.size() << '\n' << manifest
+         << events;
+      if(!os.flush()) {
+        os.close();
+        std::remove(temp.c_str());
+        return;
+      }
+    }
+
+#ifdef _WIN32
+    // Windows won't rename a file over an existing one.
+    std::remove(path.c_str());
+#endif
+    if(std::rename(temp.c_str(), path.c_str()) != 0)
+      std::remove(temp.c_str());
+  }
+
+  std::string result_cache::entry_path(const std::string &manifest) const {
+    sha256 hash;
+    hash.update(manifest);
+    return dir_ + "/" + hash.hex();
+  }
+
+  const std::string & result_cache::file_digest(const std::string &path) {
+    // Only trust a digest we computed earlier if the file doesn't look like
+    // it's changed since, since a cache can outlive a single run (e.g. with
+    // `--watch`).
+    std::string stamp;
+#ifndef _WIN32
+    struct stat st;
+    if(stat(path.c_str(), &st) == 0) {
+      std::ostringstream ss;
+      ss << st.st_dev << ':' << st.st_ino << ':' << st.st_size << ':'
+#ifdef __linux__
+         << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+#else
+         << st.st_mtime;
+#endif
+      stamp = ss.str();
+    }
+#endif
+
+    auto found = digests_.find(path);
+    if(found != digests_.end() && found->second.stamp == stamp)
+      return found->second.digest;
+
+    std::ifstream is(path, std::ios::binary);
+    std::string digest = "missing";
+    if(is) {
+      sha256 hash;
+      std::uint64_t size = 0;
+      char buf[64 * 1024];
+      while(is.read(buf, sizeof(buf)) || is.gcount()) {
+        hash.update(buf, is.gcount());
+        size += is.gcount();
+      }
+      digest = std::to_string(size) + " " + hash.hex();
+    }
+    auto &entry = digests_[path];
+    entry = {std::move(stamp), std::move(digest)};
+    return entry.digest;
+  }
+
+} // namespace mettle
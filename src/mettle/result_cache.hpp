@@ -0,0 +1,58 @@
+#ifndef INC_METTLE_SRC_METTLE_RESULT_CACHE_HPP
+#define INC_METTLE_SRC_METTLE_RESULT_CACHE_HPP
+
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mettle {
+
+  // A cache of the raw event streams from test files that passed, stored in
+  // a directory and keyed by a manifest of everything that could change the
+  // result: the file's arguments, the contents of the executable and the
+  // shared libraries it loads, and a set of environment variables. If none of
+  // those have changed, the stored events can be replayed instead of running
+  // the file again. Entries are also kept in memory, so a cache with no
+  // directory lives only as long as the object does.
+  class result_cache {
+  public:
+    // The environment variables that are always part of the manifest, since
+    // they change which code gets loaded.
+    static const std::vector<std::string> default_env;
+
+    result_cache(std::string dir = "", std::vector<std::string> env = {});
+    result_cache(const result_cache &) = delete;
+    result_cache & operator =(const result_cache &) = delete;
+
+    // Build the manifest for running a test file with `args` (whose first
+    // element is the executable).
+    std::string manifest(const std::vector<std::string> &args);
+
+    // Get the events stored for `manifest`, if any.
+    std::optional<std::string> find(const std::string &manifest) const;
+    // Store the events for `manifest`. This is best-effort: if the cache
+    // can't be written to, the events just aren't stored.
+    void store(const std::string &manifest, const std::string &events) const;
+  private:
+    struct file_digest_entry {
+      // The file's identity and modification time when we hashed it.
+      std::string stamp;
+      std::string digest;
+    };
+
+    std::string entry_path(const std::string &manifest) const;
+    const std::string & file_digest(const std::string &path);
+
+    std::string dir_;
+    std::vector<std::string> env_;
+    // Digests of the files we've hashed so far; many test files share the
+    // same libraries, so we only hash each once.
+    std::map<std::string, file_digest_entry> digests_;
+    mutable std::unordered_map<std::string, std::string> memory_;
+  };
+
+} // namespace mettle
+
+#endif
@@ -1,5 +1,15 @@
 #include "run_test_files.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <streambuf>
+
+#include <bencode.hpp>
+
 #include "log_pipe.hpp"
 
 #ifndef _WIN32
@@ -12,30 +22,545 @@ namespace platform = mettle::windows;
 
 namespace mettle {
 
-  void run_test_files(
+  namespace {
+    std::vector<std::string>
+    file_args(const test_command &command,
+              const std::vector<std::string> &args) {
+      std::vector<std::string> final_args = command.args();
+      final_args.insert(final_args.end(), args.begin(), args.end());
+      return final_args;
+    }
+
+    // Counts failing tests and files towards a `failure_limit`, forwarding
+    // every event on to another logger (if there is one).
+    class failure_counter : public log::file_logger {
+    public:
+      failure_counter(log::file_logger *log, failure_limit &limit)
+        : log_(log), limit_(limit) {}
+
+      void started_run() override {
+        if(log_) log_->started_run();
+      }
+      void ended_run() override {
+        if(log_) log_->ended_run();
+      }
+
+      void started_suite(const std::vector<std::string> &suites) override {
+        if(log_) log_->started_suite(suites);
+      }
+      void ended_suite(const std::vector<std::string> &suites) override {
+        if(log_) log_->ended_suite(suites);
+      }
+
+      void started_test(const test_name &test) override {
+        if(log_) log_->started_test(test);
+      }
+      void passed_test(const test_name &test, const log::test_output &output,
+                       log::test_duration duration) override {
+        if(log_) log_->passed_test(test, output, duration);
+      }
+      void failed_test(const test_name &test, const std::string &message,
+                       const log::test_output &output,
+                       log::test_duration duration) override {
+        if(log_) log_->failed_test(test, message, output, duration);
+        limit_.add();
+      }
+      void skipped_test(const test_name &test,
+                        const std::string &message) override {
+        if(log_) log_->skipped_test(test, message);
+      }
+      void cancelled_test(const test_name &test) override {
+        if(log_) log_->cancelled_test(test);
+      }
+
+      void started_file(const test_file &file) override {
+        if(log_) log_->started_file(file);
+      }
+      void ended_file(const test_file &file) override {
+        if(log_) log_->ended_file(file);
+      }
+      void failed_file(const test_file &file,
+                       const std::string &message) override {
+        if(log_) log_->failed_file(file, message);
+        limit_.add();
+      }
+    private:
+      log::file_logger *log_;
+      failure_limit &limit_;
+    };
+
+    struct buffered_file {
+      std::string events;
+      file_result result;
+      // The number of failures in `events`, once we've counted them.
+      std::size_t failures = 0;
+    };
+
+    // Replay the buffered events from a finished test file into our logger
+    // all at once.
+    void replay_test_file(const test_file &file, buffered_file &buffered,
+                          log::file_logger &logger) {
+      std::istringstream ss(std::move(buffered.events));
+      replay_test_file(file, ss, std::move(buffered.result), logger);
+    }
+
+    void record_test_file(event_recorder &recorder, const test_file &file,
+                          const buffered_file &buffered) {
+      recorder.add(file.name, buffered.events, buffered.result.passed,
+                   buffered.result.message);
+    }
+
+    // Count the failures in a finished test file's events. We do this as soon
+    // as the file finishes, rather than when it's replayed, so that a slow
+    // file early in the list doesn't delay us from stopping.
+    void count_failures(buffered_file &buffered) {
+      failure_limit failures;
+      failure_counter counter(nullptr, failures);
+      try {
+        log::pipe pipe(counter, 0);
+        std::istringstream ss(buffered.events);
+        while(ss.peek() != EOF)
+          pipe(ss);
+      } catch(...) {
+        // Any errors will be reported when we replay the file.
+      }
+      buffered.failures = failures.failures();
+    }
+
+    // Store a test file's events in the cache, once its failures have been
+    // counted. Only files where every test passed are stored, so that
+    // failures are always rerun.
+    void cache_result(result_cache &cache, const std::string &manifest,
+                      const buffered_file &buffered) {
+      if(buffered.result.passed && buffered.failures == 0)
+        cache.store(manifest, buffered.events);
+    }
+
+    // Passes everything read from another stream buffer through, keeping a
+    // copy of it. To avoid blocking on data that hasn't arrived yet, it only
+    // reads ahead as far as the source has already buffered; callers should
+    // keep reading until `in_avail()` is 0 so that nothing is left behind.
+    class recording_streambuf : public std::streambuf {
+    public:
+      recording_streambuf(std::streambuf *source, std::string &recorded)
+        : source_(source), recorded_(recorded) {}
+    protected:
+      int_type underflow() override {
+        // If the source has nothing buffered, just wait for one character.
+        auto want = std::min<std::streamsize>(
+          std::max<std::streamsize>(source_->in_avail(), 1), sizeof(buf_)
+        );
+        auto got = source_->sgetn(buf_, want);
+        if(got <= 0)
+          return traits_type::eof();
+
+        recorded_.append(buf_, static_cast<std::size_t>(got));
+        setg(buf_, buf_, buf_ + got);
+        return traits_type::to_int_type(*gptr());
+      }
+    private:
+      std::streambuf *source_;
+      std::string &recorded_;
+      char buf_[4096];
+    };
+
+    // Reads the `listed_test` events that a test file sends in `--list` mode.
+    class listing_reader {
+    public:
+      listing_reader(const test_command &file, const listing_callback &callback,
+                     file_result &result)
+        : file_(file), callback_(callback), result_(result) {}
+
+      void operator ()(std::istream &s) {
+        auto tmp = bencode::decode(s, bencode::no_check_eof);
+        auto &data = boost::get<bencode::dict>(tmp);
+        auto &event = boost::get<bencode::string>(data.at("event"));
+
+        if(event == "listed_test") {
+          auto &test = boost::get<bencode::dict>(data.at("test"));
+          test_listing listing{
+            {read_suites(test.at("suites")), read_string(test.at("test")),
+             static_cast<test_uid>(
+               boost::get<bencode::integer>(test.at("id"))
+             )},
+            read_attrs(data.at("attrs")),
+            read_string(data.at("action")) == "skip" ? test_action::skip :
+                                                       test_action::run,
+            read_string(data.at("message")),
+            file_
+          };
+          callback_(std::move(listing));
+        } else if(event == "failed_file") {
+          result_ = {false, read_string(data.at("message"))};
+        }
+      }
+    private:
+      static std::vector<std::string> read_suites(bencode::data &suites) {
+        std::vector<std::string> result;
+        for(auto &&i : boost::get<bencode::list>(suites))
+          result.push_back(read_string(i));
+        return result;
+      }
+
+      static test_listing::attr_list read_attrs(bencode::data &attrs) {
+        test_listing::attr_list result;
+        for(auto &&i : boost::get<bencode::dict>(attrs))
+          result.emplace_back(i.first, read_suites(i.second));
+        return result;
+      }
+
+      static std::string read_string(bencode::data &value) {
+        return std::move(boost::get<bencode::string>(value));
+      }
+
+      const test_command &file_;
+      const listing_callback &callback_;
+      file_result &result_;
+    };
+
+    void read_listing(const test_command &file, std::string &&events,
+                      file_result result, const listing_callback &callback,
+                      const list_failure_callback &failed) {
+      try {
+        listing_reader reader(file, callback, result);
+        std::istringstream ss(std::move(events));
+        while(ss.peek() != EOF)
+          reader(ss);
+      } catch(const std::exception &e) {
+        if(result.passed)
+          result = {false, e.what()};
+      }
+
+      if(!result.passed)
+        failed(file, result.message);
+    }
+
+#ifndef _WIN32
+    // Get the order to start the files in, longest first according to their
+    // history. Files with no history are assumed to take the average time.
+    std::vector<std::size_t>
+    start_order(const std::vector<test_command> &commands,
+                const test_history *history) {
+      std::vector<std::size_t> order(commands.size());
+      std::iota(order.begin(), order.end(), 0);
+      if(!history || history->files().empty())
+        return order;
+
+      std::vector<const test_record *> records;
+      std::chrono::milliseconds total(0);
+      std::size_t known = 0;
+      for(const auto &command : commands) {
+        records.push_back(history->find_file(command));
+        if(records.back()) {
+          total += records.back()->mean();
+          known++;
+        }
+      }
+      std::chrono::milliseconds average(0);
+      if(known)
+        average = total / static_cast<std::chrono::milliseconds::rep>(known);
+
+      auto estimate = [&](std::size_t i) {
+        return records[i] ? records[i]->mean() : average;
+      };
+      std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return estimate(a) > estimate(b);
+      });
+      return order;
+    }
+
+    std::size_t run_test_files_parallel(
+      const std::vector<test_command> &commands, log::file_logger &logger,
+      const std::vector<std::string> &args, std::size_t jobs,
+      test_history *history, failure_limit *limit, result_cache *cache,
+      event_recorder *recorder
+    ) {
+      detail::file_uid_maker uid;
+      std::vector<test_file> files;
+      for(const auto &command : commands)
+        files.emplace_back(command, uid.make_file_uid());
+
+      // Log each file in the order it was specified, even though they may
+      // finish in any order. Files that we never start are just skipped.
+      std::vector<std::optional<buffered_file>> finished(files.size());
+      std::vector<bool> unstarted(files.size());
+      std::size_t next = 0, unstarted_count = 0;
+      auto flush = [&]() {
+        for(; next != files.size() && (finished[next] || unstarted[next]);
+            next++) {
+          if(finished[next]) {
+            if(recorder)
+              record_test_file(*recorder, files[next], *finished[next]);
+            replay_test_file(files[next], *finished[next], logger);
+            finished[next].reset();
+          }
+        }
+      };
+
+      posix::parallel_file_runner runner(jobs);
+      for(auto i : start_order(commands, history)) {
+        auto final_args = file_args(commands[i], args);
+        std::string manifest;
+        if(cache && !(limit && limit->reached())) {
+          manifest = cache->manifest(final_args);
+          if(auto events = cache->find(manifest)) {
+            finished[i] = buffered_file{std::move(*events), {true, ""}};
+            flush();
+            continue;
+          }
+        }
+
+        runner.wait_for_slot();
+        if(limit && limit->reached()) {
+          runner.cancel();
+          unstarted[i] = true;
+          unstarted_count++;
+          continue;
+        }
+
+        runner.run(std::move(final_args), [&, i, manifest](
+          std::string &&events, const file_result &result
+        ) {
+          // A cancelled file's duration and partial results mean nothing, so
+          // just log it as cancelled.
+          if(history && !result.cancelled)
+            history->add_file(commands[i], result.duration, result.passed);
+
+          finished[i] = buffered_file{std::move(events), result};
+          if((limit || cache) && !result.cancelled) {
+            count_failures(*finished[i]);
+            if(limit)
+              limit->add(finished[i]->failures + !result.passed);
+            if(cache)
+              cache_result(*cache, manifest, *finished[i]);
+          }
+          flush();
+        });
+      }
+      flush();
+
+      // Once we've reached the limit, stop any files still running instead of
+      // waiting for them.
+      while(!runner.empty()) {
+        if(limit && limit->reached())
+          runner.cancel();
+        else
+          runner.wait_any();
+      }
+      assert(next == files.size());
+      return unstarted_count;
+    }
+#endif
+  }
+
+  void replay_test_file(const test_file &file, std::istream &events,
+                        file_result result, log::file_logger &logger) {
+    logger.started_file(file);
+
+    try {
+      log::pipe pipe(logger, file.id);
+      while(events.peek() != EOF)
+        pipe(events);
+    } catch(const std::exception &e) {
+      if(result.passed)
+        result = {false, e.what()};
+    }
+
+    if(result.passed)
+      logger.ended_file(file);
+    else
+      logger.failed_file(file, result.message);
+  }
+
+  std::size_t run_test_files(
     const std::vector<test_command> &commands, log::file_logger &logger,
-    const std::vector<std::string> &args
+    const std::vector<std::string> &args, std::size_t jobs,
+    test_history *history, failure_limit *limit, result_cache *cache,
+    event_recorder *recorder
   ) {
     using namespace platform;
     logger.started_run();
 
+#ifndef _WIN32
+    if(jobs > 1) {
+      auto unstarted = run_test_files_parallel(commands, logger, args, jobs,
+                                               history, limit, cache,
+                                               recorder);
+      logger.ended_run();
+      return unstarted;
+    }
+#else
+    assert(jobs == 1 && "parallel test files not supported");
+#endif
+
+    std::optional<failure_counter> counter;
+    if(limit)
+      counter.emplace(&logger, *limit);
+    log::file_logger &target = counter ? *counter : logger;
+
     detail::file_uid_maker uid;
-    for(const auto &command : commands) {
+    for(std::size_t i = 0; i != commands.size(); i++) {
+      if(limit && limit->reached()) {
+        logger.ended_run();
+        return commands.size() - i;
+      }
+
+      const auto &command = commands[i];
       test_file file = {command, uid.make_file_uid()};
-      logger.started_file(file);
+      auto final_args = file_args(command, args);
 
-      std::vector<std::string> final_args = command.args();
-      final_args.insert(final_args.end(), args.begin(), args.end());
-      auto result = run_test_file(std::move(final_args),
-                                  log::pipe(logger, file.id));
+      std::string manifest;
+      if(cache) {
+        manifest = cache->manifest(final_args);
+        if(auto events = cache->find(manifest)) {
+          buffered_file cached = {std::move(*events), {true, ""}};
+          if(recorder)
+            record_test_file(*recorder, file, cached);
+          replay_test_file(file, cached, target);
+          continue;
+        }
+      }
+
+      target.started_file(file);
+
+      auto start = std::chrono::steady_clock::now();
+
+      // The file only stops itself once *its* failures reach the limit, so if
+      // earlier files' failures take us past it, stop the file ourselves.
+      std::size_t earlier_failures = limit ? limit->failures() : 0;
+      auto check_limit = [&]() {
+        if(limit && limit->reached() &&
+           limit->failures() - earlier_failures < limit->max())
+          throw file_cancelled();
+      };
+
+      file_result result;
+      if(cache || recorder) {
+        // Record the events as we log them, so we can cache or record them
+        // afterwards. Count this file's failures along the way too, so we
+        // don't need to read the events again to decide whether to cache them.
+        buffered_file recorded;
+        failure_limit file_failures;
+        failure_counter file_counter(&target, file_failures);
+        log::pipe recorded_pipe(file_counter, file.id);
+        result = run_test_file(std::move(final_args), [&](std::istream &s) {
+          recording_streambuf buf(s.rdbuf(), recorded.events);
+          std::istream recording(&buf);
+          do {
+            recorded_pipe(recording);
+            check_limit();
+          } while(buf.in_avail() > 0);
+        });
+        recorded.result = result;
+        recorded.failures = file_failures.failures();
+        if(cache && !result.cancelled)
+          cache_result(*cache, manifest, recorded);
+        if(recorder)
+          record_test_file(*recorder, file, recorded);
+      } else {
+        log::pipe pipe(target, file.id);
+        result = run_test_file(std::move(final_args), [&](std::istream &s) {
+          pipe(s);
+          check_limit();
+        });
+      }
+
+      if(history && !result.cancelled) {
+        history->add_file(
+          command, std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start
+          ), result.passed
+        );
+      }
 
       if(result.passed)
-        logger.ended_file(file);
+        target.ended_file(file);
       else
-        logger.failed_file(file, result.message);
+        target.failed_file(file, result.message);
     }
 
     logger.ended_run();
+    return 0;
+  }
+
+  void list_test_files(
+    const std::vector<test_command> &commands,
+    const listing_callback &callback, const list_failure_callback &failed,
+    const std::vector<std::string> &args, std::size_t jobs,
+    result_cache *cache
+  ) {
+    using namespace platform;
+
+    // Listings are just another event stream, so they can be cached the
+    // same way as results. Unlike results, every listing that succeeded is
+    // worth keeping.
+    std::vector<std::string> manifests(commands.size());
+    auto cached = [&](std::size_t i) -> std::optional<std::string> {
+      if(!cache)
+        return std::nullopt;
+      manifests[i] = cache->manifest(file_args(commands[i], args));
+      return cache->find(manifests[i]);
+    };
+    auto store = [&](std::size_t i, const buffered_file &buffered) {
+      if(cache && buffered.result.passed)
+        cache->store(manifests[i], buffered.events);
+    };
+
+#ifndef _WIN32
+    if(jobs > 1) {
+      std::vector<std::optional<buffered_file>> finished(commands.size());
+      std::size_t next = 0;
+      auto flush = [&]() {
+        for(; next != commands.size() && finished[next]; next++) {
+          read_listing(commands[next], std::move(finished[next]->events),
+                       std::move(finished[next]->result), callback, failed);
+          finished[next].reset();
+        }
+      };
+
+      posix::parallel_file_runner runner(jobs);
+      for(std::size_t i = 0; i != commands.size(); i++) {
+        if(auto events = cached(i)) {
+          finished[i] = buffered_file{std::move(*events), {true, ""}};
+          flush();
+          continue;
+        }
+
+        runner.run(file_args(commands[i], args), [&, i](
+          std::string &&events, const file_result &result
+        ) {
+          finished[i] = buffered_file{std::move(events), result};
+          store(i, *finished[i]);
+          flush();
+        });
+      }
+      runner.wait();
+      assert(next == commands.size());
+      return;
+    }
+#else
+    assert(jobs == 1 && "parallel test files not supported");
+#endif
+
+    for(std::size_t i = 0; i != commands.size(); i++) {
+      // Decode the listing once the file finishes, just like we do when
+      // running files in parallel.
+      buffered_file buffered;
+      if(auto events = cached(i)) {
+        buffered = {std::move(*events), {true, ""}};
+      } else {
+        buffered.result = run_test_file(
+          file_args(commands[i], args), [&buffered](std::istream &s) {
+            std::ostringstream ss;
+            ss << s.rdbuf();
+            buffered.events += ss.str();
+          }
+        );
+        store(i, buffered);
+      }
+      read_listing(commands[i], std::move(buffered.events),
+                   std::move(buffered.result), callback, failed);
+    }
   }
 
 } // namespace mettle
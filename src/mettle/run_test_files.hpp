@@ -1,11 +1,19 @@
 #ifndef INC_METTLE_SRC_METTLE_RUN_TEST_FILES_HPP
 #define INC_METTLE_SRC_METTLE_RUN_TEST_FILES_HPP
 
+#include <chrono>
+#include <functional>
+#include <istream>
 #include <string>
 #include <vector>
 
+#include <mettle/driver/failure_limit.hpp>
+#include <mettle/driver/list_tests.hpp>
+#include <mettle/driver/test_history.hpp>
 #include <mettle/driver/log/core.hpp>
 
+#include "event_record.hpp"
+#include "result_cache.hpp"
 #include "test_command.hpp"
 
 namespace mettle {
@@ -13,11 +21,57 @@ namespace mettle {
   struct file_result {
     bool passed;
     std::string message;
+    std::chrono::milliseconds duration = {};
+    // True if we stopped the file before it finished.
+    bool cancelled = false;
   };
 
-  void run_test_files(
+  inline file_result cancelled_file() {
+    return {false, "Cancelled", {}, true};
+  }
+
+  using event_reader = std::function<void(std::istream &)>;
+
+  // Thrown by an `event_reader` to stop the file it's reading from. The file
+  // is killed, and its result is `cancelled_file()`.
+  struct file_cancelled {};
+
+  // Run each test file, logging the results to `logger`. If `history` is
+  // set, the duration of each file is recorded there, and when running files
+  // in parallel, the files that took the longest last time are started first.
+  // If `limit` is set, no more files are started once it's been reached, and
+  // any files still running are killed and logged as cancelled (without
+  // replaying their partial results); this returns the number of files that
+  // weren't started as a result. If `cache` is set, files
+  // with a stored result are replayed from it instead of being run, and the
+  // results of files that pass are stored there. If `recorder` is set, each
+  // file's events are recorded there as they're logged.
+  std::size_t run_test_files(
     const std::vector<test_command> &commands, log::file_logger &logger,
-    const std::vector<std::string> &args = {}
+    const std::vector<std::string> &args = {}, std::size_t jobs = 1,
+    test_history *history = nullptr, failure_limit *limit = nullptr,
+    result_cache *cache = nullptr, event_recorder *recorder = nullptr
+  );
+
+  // Replay the events from a finished test file into `logger`, just as if it
+  // were running. If the events can't be read, the file is logged as failed.
+  void replay_test_file(const test_file &file, std::istream &events,
+                        file_result result, log::file_logger &logger);
+
+  using listing_callback = std::function<void(test_listing &&)>;
+  using list_failure_callback = std::function<
+    void(const test_command &file, const std::string &message)
+  >;
+
+  // Collect the tests in each file (via `--list`, which should be in `args`)
+  // without running them. Tests are passed to `callback` in the order their
+  // files were specified. If `cache` is set, listings are reused from it when
+  // possible, and stored there otherwise.
+  void list_test_files(
+    const std::vector<test_command> &commands,
+    const listing_callback &callback, const list_failure_callback &failed,
+    const std::vector<std::string> &args = {}, std::size_t jobs = 1,
+    result_cache *cache = nullptr
   );
 
 } // namespace mettle
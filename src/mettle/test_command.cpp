@@ -2,9 +2,14 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <iterator>
 #include <stdexcept>
 
+#ifndef _WIN32
+#  include <unistd.h>
+#endif
+
 #include <boost/program_options.hpp>
 #include <boost/tokenizer.hpp>
 
@@ -33,6 +38,29 @@ namespace mettle {
     }
   }
 
+  std::string find_executable(const std::string &name) {
+#ifndef _WIN32
+    if(name.find('/') != std::string::npos)
+      return name;
+
+    const char *path = std::getenv("PATH");
+    std::string dirs = path ? path : "/bin:/usr/bin";
+    std::size_t start = 0;
+    while(true) {
+      auto end = dirs.find(':', start);
+      auto dir = dirs.substr(start, end - start);
+      auto file = (dir.empty() ? "." : dir) + "/" + name;
+      if(access(file.c_str(), X_OK) == 0)
+        return file;
+      if(end == std::string::npos)
+        return name;
+      start = end + 1;
+    }
+#else
+    return name;
+#endif
+  }
+
   void validate(boost::any &v, const std::vector<std::string> &values,
                 test_command*, int) {
     using namespace boost::program_options;
@@ -24,11 +24,21 @@ namespace mettle {
     const std::vector<std::string> & args() const {
       return args_;
     }
+
+    // Add arguments for just this file. This doesn't change `command()`, so
+    // the file is still recognized as the same one (e.g. in the history).
+    void add_args(const std::vector<std::string> &args) {
+      args_.insert(args_.end(), args.begin(), args.end());
+    }
   private:
     std::string command_;
     std::vector<std::string> args_;
   };
 
+  // Find the file that running `name` would execute, searching `PATH` like
+  // `execvp` does.
+  std::string find_executable(const std::string &name);
+
   void validate(boost::any &v, const std::vector<std::string> &values,
                 test_command*, int);
 
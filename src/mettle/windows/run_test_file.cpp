@@ -67,7 +67,8 @@ namespace mettle::windows {
     }
   }
 
-  file_result run_test_file(std::vector<std::string> args, log::pipe &logger) {
+  file_result run_test_file(std::vector<std::string> args,
+                            const event_reader &read) {
     scoped_pipe message_pipe;
     if(!message_pipe.open())
       return METTLE_FAILED();
@@ -79,6 +80,15 @@ namespace mettle::windows {
     args.insert(args.end(), { "--output-fd", ss.str() });
     std::string command = make_command(args);
 
+    // Tell the file which event protocol we understand via its environment,
+    // since test files built against older versions of mettle reject unknown
+    // command-line options.
+    if(!SetEnvironmentVariableA(log::protocol_env, std::to_string(
+         static_cast<unsigned>(log::latest_protocol)
+       ).c_str())) {
+      return METTLE_FAILED();
+    }
+
     STARTUPINFOA startup_info = { sizeof(STARTUPINFOA) };
     PROCESS_INFORMATION proc_info;
 
@@ -102,7 +112,11 @@ namespace mettle::windows {
         message_pipe.read_handle.handle(), io::never_close_handle
       );
       while(fds.peek() != EOF)
-        logger(fds);
+        read(fds);
+    } catch(const file_cancelled &) {
+      TerminateProcess(proc_info.hProcess, 1);
+      WaitForSingleObject(proc_info.hProcess, INFINITE);
+      return cancelled_file();
     } catch(...) {
       except = std::current_exception();
     }
@@ -1,6 +1,7 @@
 #ifndef INC_METTLE_SRC_WINDOWS_RUN_TEST_FILE_HPP
 #define INC_METTLE_SRC_WINDOWS_RUN_TEST_FILE_HPP
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -9,7 +10,15 @@
 
 namespace mettle::windows {
 
-  file_result run_test_file(std::vector<std::string> args, log::pipe &logger);
+  // Run a test file, passing the stream of events it sends back to `read`
+  // until the file closes it.
+  file_result run_test_file(std::vector<std::string> args,
+                            const event_reader &read);
+
+  inline file_result
+  run_test_file(std::vector<std::string> args, log::pipe &logger) {
+    return run_test_file(std::move(args), event_reader(std::ref(logger)));
+  }
 
   inline file_result
   run_test_file(std::vector<std::string> args, log::pipe &&logger) {
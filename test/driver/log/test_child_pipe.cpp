@@ -60,6 +60,10 @@ struct recording_logger : log::file_logger {
     test = actual_test;
     message = actual_message;
   }
+  void cancelled_test(const test_name &actual_test) override {
+    called = "cancelled_test";
+    test = actual_test;
+  }
 
   std::string called;
   std::vector<std::string> suites;
@@ -82,8 +86,20 @@ auto equal_test_name(const test_name &expected) {
   );
 }
 
+// Counts how many times the stream is flushed, i.e. how many writes a
+// `log::child` would make to a pipe.
+struct flush_counter : std::stringbuf {
+  int sync() override {
+    flushes++;
+    return std::stringbuf::sync();
+  }
+
+  std::size_t flushes = 0;
+};
+
 struct fixture {
-  fixture() : pipe(parent, test_uid(1) << 32), child(stream) {}
+  fixture(log::protocol proto)
+    : pipe(parent, test_uid(1) << 32), child(stream, proto) {}
 
   recording_logger parent;
   log::pipe pipe;
@@ -91,7 +107,7 @@ struct fixture {
   std::stringstream stream;
 };
 
-suite<fixture> test_child("child/pipe loggers", [](auto &_) {
+auto child_pipe_tests = [](auto &_) {
 
   _.test("started_run()", [](fixture &f) {
     f.child.started_run();
@@ -179,4 +195,151 @@ suite<fixture> test_child("child/pipe loggers", [](auto &_) {
     expect(f.parent.test, equal_test_name(test));
   });
 
-});
+  _.test("cancelled_test()", [](fixture &f) {
+    test_name test = {{"suite", "subsuite"}, "test", 1};
+    f.child.cancelled_test(test);
+    f.pipe(f.stream);
+
+    expect(f.parent.called, equal_to("cancelled_test"));
+    expect(f.parent.test, equal_test_name(test));
+  });
+
+  _.test("multiple events", [](fixture &f) {
+    test_name test = {{"suite"}, "test", 1};
+    log::test_output output = {"stdout", "stderr"};
+    f.child.started_test(test);
+    f.child.passed_test(test, output, log::test_duration(10));
+
+    f.pipe(f.stream);
+    expect(f.parent.called, equal_to("started_test"));
+    f.pipe(f.stream);
+    expect(f.parent.called, equal_to("passed_test"));
+    expect(f.parent.output.stdout_log, equal_to(output.stdout_log));
+    expect(f.stream.peek(), equal_to(EOF));
+  });
+
+};
+
+suite<fixture> test_child_bencode(
+  "child/pipe loggers (bencode)", bind_factory(log::protocol::bencode),
+  child_pipe_tests
+);
+
+suite<fixture> test_child_binary(
+  "child/pipe loggers (binary)", bind_factory(log::protocol::binary_v1),
+  [](auto &_) {
+    child_pipe_tests(_);
+
+    _.test("mixed with bencode", [](fixture &f) {
+      test_name test = {{"suite"}, "test", 1};
+      log::child bencode_child(f.stream);
+      f.child.started_test(test);
+      bencode_child.skipped_test(test, "message");
+
+      f.pipe(f.stream);
+      expect(f.parent.called, equal_to("started_test"));
+      f.pipe(f.stream);
+      expect(f.parent.called, equal_to("skipped_test"));
+      expect(f.parent.message, equal_to("message"));
+    });
+
+    _.test("suites declared once", [](fixture &f) {
+      suite_path suites = {"a long suite name", "subsuite"};
+      f.child.started_test({suites, "test 1", 1});
+      f.child.started_test({suites, "test 2", 2});
+      f.child.started_test({{"a long suite name", "subsuite"}, "test 3", 3});
+
+      auto data = f.stream.str();
+      expect(data.find("a long suite name"), not_equal_to(std::string::npos));
+      expect(data.find("a long suite name", data.find("a long suite name") + 1),
+             equal_to(std::string::npos));
+
+      f.pipe(f.stream);
+      auto first = f.parent.test.suites;
+      expect(first, equal_to(suites));
+      f.pipe(f.stream);
+      expect(f.parent.test.suites.identity(), equal_to(first.identity()));
+      f.pipe(f.stream);
+      expect(f.parent.test.suites.identity(), equal_to(first.identity()));
+      expect(f.parent.test, equal_test_name({suites, "test 3", 3}));
+    });
+
+    _.test("buffered events", [](fixture &f) {
+      test_name test = {{"suite"}, "test", 1};
+      std::stringstream stream;
+      log::child child(stream, log::protocol::binary_v1, {1024});
+
+      child.started_suite({"suite"});
+      child.skipped_test(test, "message");
+      expect(stream.str(), equal_to(""));
+
+      // Starting a test should flush everything before it.
+      child.started_test(test);
+      f.pipe(stream);
+      expect(f.parent.called, equal_to("started_suite"));
+      f.pipe(stream);
+      expect(f.parent.called, equal_to("skipped_test"));
+      f.pipe(stream);
+      expect(f.parent.called, equal_to("started_test"));
+      expect(stream.peek(), equal_to(EOF));
+      stream.clear();
+
+      // Once enough data is buffered, it should be flushed too.
+      log::test_output output = {std::string(1024, 'x'), ""};
+      child.passed_test(test, output, log::test_duration(10));
+      f.pipe(stream);
+      expect(f.parent.called, equal_to("passed_test"));
+      expect(f.parent.output.stdout_log, equal_to(output.stdout_log));
+    });
+
+    _.test("buffered started_test", [](fixture &f) {
+      test_name test = {{"suite"}, "test", 1};
+      auto run = [&test](log::child &child) {
+        child.started_run();
+        for(std::size_t i = 0; i != 10; i++) {
+          child.started_test(test);
+          child.passed_test(test, {}, log::test_duration(10));
+        }
+        child.ended_run();
+      };
+
+      flush_counter eager_buf;
+      std::ostream eager_stream(&eager_buf);
+      log::child eager(eager_stream, log::protocol::binary_v1, {1024});
+      run(eager);
+      expect(eager_buf.flushes, equal_to(11));
+
+      flush_counter lazy_buf;
+      std::iostream lazy_stream(&lazy_buf);
+      log::child lazy(lazy_stream, log::protocol::binary_v1,
+                      {1024, std::chrono::milliseconds(0), false});
+      run(lazy);
+      expect(lazy_buf.flushes, equal_to(1));
+
+      // started_run, then each test's started_test and passed_test.
+      for(std::size_t i = 0; i != 21; i++)
+        f.pipe(lazy_stream);
+      expect(f.parent.called, equal_to("passed_test"));
+      expect(f.parent.test, equal_test_name(test));
+    });
+
+    _.test("truncated event", [](fixture &f) {
+      f.child.started_test({{"suite"}, "test", 1});
+      auto data = f.stream.str();
+      std::stringstream truncated(data.substr(0, data.size() - 1));
+
+      expect([&f, &truncated]() { f.pipe(truncated); },
+             thrown<log::binary::protocol_error>("truncated event"));
+    });
+
+    _.test("oversized event", [](fixture &f) {
+      std::stringstream oversized(std::string{
+        static_cast<char>(log::binary::frame_marker), '\xff', '\xff', '\xff',
+        '\xff'
+      });
+
+      expect([&f, &oversized]() { f.pipe(oversized); },
+             thrown<log::binary::protocol_error>("event too large"));
+    });
+  }
+);
@@ -0,0 +1,86 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <sstream>
+
+#include <mettle/driver/log/output_capture.hpp>
+
+suite<> test_output_capture("output_capture", [](auto &_) {
+
+  _.test("unlimited", []() {
+    log::output_capture capture;
+    capture.append("hello ", 6);
+    capture.append("world", 5);
+
+    expect(capture.size(), equal_to(11u));
+    expect(capture.elided(), equal_to(0u));
+    expect(capture.spilled(), equal_to(false));
+    expect(capture.str(), equal_to("hello world"));
+    expect(capture.release(), equal_to("hello world"));
+    expect(capture.size(), equal_to(0u));
+  });
+
+  _.test("within limit", []() {
+    log::output_capture capture({8});
+    capture.append("hello", 5);
+
+    expect(capture.elided(), equal_to(0u));
+    expect(capture.str(), equal_to("hello"));
+  });
+
+  _.test("elided", []() {
+    log::output_capture capture({8});
+    for(char c = 'a'; c <= 'z'; c++)
+      capture.append(&c, 1);
+
+    expect(capture.size(), equal_to(26u));
+    expect(capture.elided(), equal_to(18u));
+    expect(capture.spilled(), equal_to(false));
+    expect(capture.str(), equal_to("abcd\n[... 18 bytes elided ...]\nwxyz"));
+
+    std::ostringstream ss;
+    capture.stream(ss);
+    expect(ss.str(), equal_to(capture.str()));
+  });
+
+  _.test("spilled", []() {
+    log::output_capture capture({8, true});
+    std::string alphabet = "abcdefghijklmnopqrstuvwxyz";
+    capture.append(alphabet.data(), alphabet.size());
+    capture.append(alphabet.data(), alphabet.size());
+
+    expect(capture.spilled(), equal_to(true));
+    expect(capture.str(), equal_to("abcd\n[... 44 bytes elided ...]\nwxyz"));
+
+    std::ostringstream ss;
+    capture.stream(ss);
+    expect(ss.str(), equal_to(alphabet + alphabet));
+
+    // Streaming shouldn't disturb any further appends.
+    capture.append(alphabet.data(), alphabet.size());
+    ss.str("");
+    capture.stream(ss);
+    expect(ss.str(), equal_to(alphabet + alphabet + alphabet));
+  });
+
+  _.test("collect_output()", []() {
+    log::output_capture out({8, true}), err({8});
+    std::string alphabet = "abcdefghijklmnopqrstuvwxyz";
+    out.append(alphabet.data(), alphabet.size());
+    err.append("error", 5);
+
+    auto output = log::collect_output(out, err);
+    expect(output.stdout_log, equal_to("abcd\n[... 18 bytes elided ...]\nwxyz"));
+    expect(output.stderr_log, equal_to("error"));
+    expect(output.stderr_capture, equal_to(nullptr));
+
+    std::ostringstream ss;
+    log::stream_log(ss, output.stdout_log, output.stdout_capture);
+    expect(ss.str(), equal_to(alphabet));
+
+    expect(out.size(), equal_to(0u));
+    expect(out.limit().spill, equal_to(true));
+    expect(err.size(), equal_to(0u));
+  });
+
+});
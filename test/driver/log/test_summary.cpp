@@ -44,6 +44,32 @@ suite<> test_summary("summary logger", [](auto &_) {
       ));
     });
 
+    _.test("stopped run", [](logger_factory &f) {
+      using namespace std::literals::chrono_literals;
+      std::vector<std::string> suites = {"suite"};
+
+      f.logger.started_run();
+      f.logger.started_suite(suites);
+      f.logger.started_test({suites, "test 1", 1});
+      f.logger.passed_test({suites, "test 1", 1}, {}, 100ms);
+      f.logger.started_test({suites, "test 2", 2});
+      f.logger.failed_test({suites, "test 2", 2}, "error", {}, 100ms);
+      f.logger.started_test({suites, "test 3", 3});
+      f.logger.cancelled_test({suites, "test 3", 3});
+      f.logger.ended_suite(suites);
+      f.logger.ended_run();
+      f.logger.stopped_early(2);
+
+      f.logger.summarize();
+      expect(f.logger.good(), equal_to(false));
+      expect(f.ss.str(), equal_to(
+        "1/3 tests passed (1 cancelled) [stopped early, 2 files not run]\n"
+        "  suite > test 2 FAILED\n"
+        "    error\n"
+        "  suite > test 3 CANCELLED\n"
+      ));
+    });
+
     _.test("failing file run", [](logger_factory &f) {
       failing_file_run(f.logger);
       f.logger.summarize();
@@ -147,6 +147,62 @@ suite<> test_parse_attr("parse_attr()", [](auto &_) {
            equal_filter_result( {test_action::hide, "2"} ));
   });
 
+  _.test("attr1|attr2", []() {
+    bool_attr attr1("attr1");
+    bool_attr attr2("attr2");
+    bool_attr attr3("attr3");
+
+    auto filter = parse_attr("attr1|attr2");
+    expect(filter.size(), equal_to(1u));
+    expect(filter(test_name(), {attr1}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr2}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr3}),
+           equal_filter_result( {test_action::hide, ""} ));
+  });
+
+  _.test("attr1,!(attr2=2|attr3)", []() {
+    bool_attr attr1("attr1");
+    string_attr attr2("attr2");
+    bool_attr attr3("attr3");
+
+    auto filter = parse_attr("attr1,!(attr2=2|attr3)");
+    expect(filter.size(), equal_to(2u));
+    expect(filter(test_name(), {attr1}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr1, attr2("1")}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr1, attr2("2")}),
+           equal_filter_result( {test_action::hide, ""} ));
+    expect(filter(test_name(), {attr1, attr3}),
+           equal_filter_result( {test_action::hide, ""} ));
+    expect(filter(test_name(), {attr3}),
+           equal_filter_result( {test_action::hide, ""} ));
+  });
+
+  _.test("escaped characters", []() {
+    bool_attr attr1("a|b");
+    string_attr attr2("(attr!)");
+    bool_attr attr3("a");
+
+    auto filter = parse_attr("a\\|b");
+    expect(filter.size(), equal_to(1u));
+    expect(filter(test_name(), {attr1}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr3}),
+           equal_filter_result( {test_action::hide, ""} ));
+
+    filter = parse_attr("\\(attr\\!\\)=x\\,y\\)|a");
+    expect(filter.size(), equal_to(1u));
+    expect(filter(test_name(), {attr2("x,y)")}),
+           equal_filter_result( {test_action::run, ""} ));
+    expect(filter(test_name(), {attr2("x")}),
+           equal_filter_result( {test_action::hide, ""} ));
+    expect(filter(test_name(), {attr3}),
+           equal_filter_result( {test_action::run, ""} ));
+  });
+
   _.test("parse failures", []() {
     expect([]() { parse_attr(""); },
            thrown<std::invalid_argument>("unexpected end of string"));
@@ -162,6 +218,53 @@ suite<> test_parse_attr("parse_attr()", [](auto &_) {
            thrown<std::invalid_argument>("expected attribute name"));
     expect([]() { parse_attr("attr,="); },
            thrown<std::invalid_argument>("expected attribute name"));
+    expect([]() { parse_attr("attr|"); },
+           thrown<std::invalid_argument>("unexpected end of string"));
+    expect([]() { parse_attr("()"); },
+           thrown<std::invalid_argument>("expected attribute name"));
+    expect([]() { parse_attr("(attr"); },
+           thrown<std::invalid_argument>("expected ')'"));
+    expect([]() { parse_attr("attr)"); },
+           thrown<std::invalid_argument>("unexpected ')'"));
+    expect([]() { parse_attr("(attr)x"); },
+           thrown<std::invalid_argument>("unexpected 'x'"));
+    expect([]() { parse_attr("attr\\"); },
+           thrown<std::invalid_argument>("unexpected end of string"));
+  });
+});
+
+suite<> test_output_capture_limit("output_capture_limit()", [](auto &_) {
+  _.test("no limit", []() {
+    driver_options opts;
+    for(bool child : {false, true}) {
+      auto limit = output_capture_limit(opts, child);
+      expect(limit.size, equal_to(0));
+      expect(limit.spill, equal_to(false));
+    }
+  });
+
+  _.test("limit", []() {
+    driver_options opts;
+    opts.output_limit = 64;
+    for(bool child : {false, true}) {
+      auto limit = output_capture_limit(opts, child);
+      expect(limit.size, equal_to(64));
+      expect(limit.spill, equal_to(false));
+    }
+  });
+
+  _.test("limit and spill", []() {
+    driver_options opts;
+    opts.output_limit = 64;
+    opts.spill_output = true;
+
+    auto limit = output_capture_limit(opts, false);
+    expect(limit.size, equal_to(64));
+    expect(limit.spill, equal_to(true));
+
+    limit = output_capture_limit(opts, true);
+    expect(limit.size, equal_to(64));
+    expect(limit.spill, equal_to(false));
   });
 });
 
@@ -252,6 +355,26 @@ suite<> test_program_options("program_options utilities", [](auto &_) {
       );
     });
 
+    _.test("isolation_level", []() {
+      using namespace boost::program_options;
+      for(auto level : {isolation_level::none, isolation_level::test,
+                        isolation_level::suite, isolation_level::file}) {
+        boost::any value;
+        std::vector<std::string> input{isolation_name(level)};
+        validate(value, input, static_cast<isolation_level*>(nullptr), 0);
+        expect(value, any_equal(level));
+      }
+
+      expect(
+        []() {
+          boost::any value;
+          std::vector<std::string> input{"invalid"};
+          validate(value, input, static_cast<isolation_level*>(nullptr), 0);
+        },
+        thrown<std::exception>("the argument ('invalid') for option is invalid")
+      );
+    });
+
     _.test("attr_filter_set", []() {
       using namespace boost::program_options;
 
@@ -302,6 +425,49 @@ suite<> test_program_options("program_options utilities", [](auto &_) {
       );
     });
 
+    _.test("exact_name_filter", []() {
+      boost::any value;
+      std::vector<std::string> input{"suite > test"};
+      validate(value, input, static_cast<exact_name_filter*>(nullptr), 0);
+      input = {"suite > other test"};
+      validate(value, input, static_cast<exact_name_filter*>(nullptr), 0);
+      auto filter = boost::any_cast<exact_name_filter>(value);
+
+      expect(filter.size(), equal_to(2u));
+      expect(
+        filter({{"suite"}, "other test", 1}, {}),
+        equal_filter_result({test_action::indeterminate, ""})
+      );
+      expect(
+        filter({{"suite"}, "mismatch", 2}, {}),
+        equal_filter_result({test_action::hide, ""})
+      );
+    });
+
+    _.test("shard_filter", []() {
+      using namespace boost::program_options;
+
+      boost::any value;
+      std::vector<std::string> input{"2/3"};
+      validate(value, input, static_cast<shard_filter*>(nullptr), 0);
+      auto filter = boost::any_cast<shard_filter>(value);
+      expect(filter.index(), equal_to(1u));
+      expect(filter.count(), equal_to(3u));
+
+      for(std::string bad : {"0/3", "4/3", "1/0", "1", "a/b"}) {
+        expect(
+          [bad]() {
+            boost::any value;
+            std::vector<std::string> input{bad};
+            validate(value, input, static_cast<shard_filter*>(nullptr), 0);
+          },
+          thrown<std::exception>(
+            "the argument ('" + bad + "') for option is invalid"
+          )
+        );
+      }
+    });
+
     _.test("std::chrono::milliseconds", []() {
       using ms = std::chrono::milliseconds;
       using namespace boost::program_options;
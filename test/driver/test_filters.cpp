@@ -110,6 +110,123 @@ suite<> test_name_filters("name filters", [](auto &_) {
       equal_filter_result({test_action::run, ""})
     );
   });
+
+  _.test("string patterns", []() {
+    test_name name{{"suite", "subsuite"}, "test", 1};
+    auto run = [&name](std::initializer_list<name_filter> filters) {
+      return name_filter_set(filters)(name, {}).action == test_action::run;
+    };
+
+    expect(run({"subsuite > te"}), equal_to(true));
+    expect(run({"^suite > "}), equal_to(true));
+    expect(run({"^subsuite"}), equal_to(false));
+    expect(run({"> test$"}), equal_to(true));
+    expect(run({"> tes$"}), equal_to(false));
+    expect(run({"^suite > subsuite > test$"}), equal_to(true));
+    expect(run({"^suite > subsuite > tes$"}), equal_to(false));
+    expect(run({"^suite.*sub.*test$"}), equal_to(true));
+    expect(run({"^suite.*test.*sub"}), equal_to(false));
+    expect(run({R"(\bsubsuite\b)"}), equal_to(true));
+    expect(run({"mismatch", "bad", "sub(suite|way)"}), equal_to(true));
+    expect(run({"mismatch", R"((s)\1)", "bad"}), equal_to(false));
+    expect(run({"mismatch", R"((su)b\1)"}), equal_to(true));
+  });
+
+  _.test("may_match()", []() {
+    suite_path suites = {"suite", "subsuite"};
+
+    expect(name_filter_set{}.may_match(suites), equal_to(true));
+    expect(name_filter_set{"^suite > sub"}.may_match(suites), equal_to(true));
+    expect(name_filter_set{"^suite > subsuite > sub-subsuite > test"}
+           .may_match(suites), equal_to(true));
+    expect(name_filter_set{"^suite$"}.may_match(suites), equal_to(true));
+    expect(name_filter_set{"^other"}.may_match(suites), equal_to(false));
+    expect(name_filter_set{"^suite > other"}.may_match(suites),
+           equal_to(false));
+    expect(name_filter_set{"^other", "test"}.may_match(suites),
+           equal_to(true));
+    expect(name_filter_set{"^other|suite"}.may_match(suites), equal_to(true));
+    expect(filter_set{ {"^other"}, {} }.may_match(suites), equal_to(false));
+  });
+
+  _.test("simple patterns", []() {
+    expect(name_filter("test").is_simple(), equal_to(true));
+    expect(name_filter("^suite.*test$").is_simple(), equal_to(true));
+    expect(name_filter(R"(a\.b\$)").is_simple(), equal_to(true));
+    expect(name_filter(R"(a\.b\$)")("a.b$"), equal_to(true));
+    expect(name_filter(R"(a\.b\$)")("axb"), equal_to(false));
+    expect(name_filter("a.b").is_simple(), equal_to(false));
+    expect(name_filter(R"(\bsuite)").is_simple(), equal_to(false));
+    expect(name_filter(std::regex("test")).is_simple(), equal_to(false));
+    expect([]() { name_filter("["); }, thrown<std::regex_error>());
+  });
+
+  _.test("line terminators", []() {
+    expect(name_filter("a.*b")("a-b"), equal_to(true));
+    expect(name_filter("a.*b")("a\nb"), equal_to(false));
+    expect(name_filter("a.*b")("a\rb"), equal_to(false));
+    expect(name_filter("a.*b")("a\rb"),
+           equal_to(std::regex_search("a\rb", std::regex("a.*b"))));
+    expect(name_filter("a")("a\r"), equal_to(true));
+  });
+
+  _.test("insert after filtering", []() {
+    test_name name{{"suite"}, "test", 1};
+    name_filter_set filters;
+    filters.insert(name_filter("mismatch"));
+    filters.insert(name_filter("(bad|wrong)"));
+    expect(filters(name, {}), equal_filter_result({test_action::hide, ""}));
+
+    filters.insert(name_filter("t(e|a)st"));
+    expect(filters(name, {}), equal_filter_result({test_action::run, ""}));
+  });
+
+  subsuite<>(_, "exact_name_filter", [](auto &_) {
+    _.test("empty", []() {
+      exact_name_filter filter;
+      expect(filter.empty(), equal_to(true));
+      expect(
+        filter({{"suite", "subsuite"}, "test", 1}, {}),
+        equal_filter_result({test_action::indeterminate, ""})
+      );
+      expect(filter.may_match({"suite"}), equal_to(true));
+    });
+
+    _.test("match", []() {
+      exact_name_filter filter;
+      filter.insert("suite > subsuite > test");
+      filter.insert("suite > other");
+      expect(filter.size(), equal_to(2u));
+
+      expect(
+        filter({{"suite", "subsuite"}, "test", 1}, {}),
+        equal_filter_result({test_action::indeterminate, ""})
+      );
+      expect(
+        filter({{"suite"}, "other", 2}, {}),
+        equal_filter_result({test_action::indeterminate, ""})
+      );
+      expect(
+        filter({{"suite", "subsuite"}, "tes", 3}, {}),
+        equal_filter_result({test_action::hide, ""})
+      );
+      expect(
+        filter({{"suite"}, "subsuite > test", 4}, {}),
+        equal_filter_result({test_action::indeterminate, ""})
+      );
+    });
+
+    _.test("may_match()", []() {
+      exact_name_filter filter;
+      filter.insert("suite > subsuite > test");
+
+      expect(filter.may_match({"suite"}), equal_to(true));
+      expect(filter.may_match({"suite", "subsuite"}), equal_to(true));
+      expect(filter.may_match({"suite", "other"}), equal_to(false));
+      expect(filter.may_match({"subsuite"}), equal_to(false));
+      expect(filter.may_match({"suite", "subsuite", "test"}), equal_to(false));
+    });
+  });
 });
 
 struct attr_filter_fixture {
@@ -480,6 +597,99 @@ suite<> test_attr_filters("attribute filters", [](auto &_) {
         );
       });
     });
+
+    subsuite<>(_, "groups", [](auto &_) {
+      _.test("attr_any_of", []() {
+        bool_attr attr1("first");
+        string_attr attr2("second");
+        bool_attr attr3("third");
+
+        attr_filter filter{ attr_any_of({
+          {has_attr("first")}, {has_attr("second", "2"), has_attr("third")}
+        }) };
+        expect(filter(test_name(), {attr1}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {attr2("2"), attr3}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {attr2("1"), attr3}),
+               equal_filter_result({test_action::hide, ""}));
+        expect(filter(test_name(), {attr3}),
+               equal_filter_result({test_action::hide, ""}));
+      });
+
+      _.test("!attr_any_of", []() {
+        bool_attr attr1("first");
+        bool_attr attr2("second");
+
+        attr_filter filter{ has_attr("first"), !attr_any_of({
+          {has_attr("second")}, {has_attr("third")}
+        }) };
+        expect(filter(test_name(), {attr1}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {attr1, attr2}),
+               equal_filter_result({test_action::hide, ""}));
+      });
+
+      _.test("skipped attr", []() {
+        bool_attr attr1("first", test_action::skip);
+        bool_attr attr2("second");
+
+        attr_filter filter{ attr_any_of({
+          {has_attr("first")}, {has_attr("second")}
+        }) };
+        expect(filter(test_name(), {attr1("message")}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {attr1("message"), attr2}),
+               equal_filter_result({test_action::run, ""}));
+
+        attr_filter other{ attr_any_of({ {has_attr("second")} }) };
+        expect(other(test_name(), {attr1("message"), attr2}),
+               equal_filter_result({test_action::skip, "message"}));
+      });
+
+      _.test("skipped attr in another alternative", []() {
+        string_attr attr1("first");
+        bool_attr attr2("second", test_action::skip);
+
+        // Only the alternative that matched shows its attributes explicitly.
+        attr_filter filter{ attr_any_of({
+          {has_attr("first")}, {has_attr("second")}
+        }) };
+        expect(filter(test_name(), {attr1("1"), attr2("message")}),
+               equal_filter_result({test_action::skip, "message"}));
+        expect(filter(test_name(), {attr2("message")}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {}),
+               equal_filter_result({test_action::hide, ""}));
+
+        attr_filter values{ attr_any_of({
+          {has_attr("second", "other")}, {has_attr("first", "1")}
+        }) };
+        expect(values(test_name(), {attr1("1"), attr2("message")}),
+               equal_filter_result({test_action::skip, "message"}));
+        expect(values(test_name(), {attr1("2"), attr2("message")}),
+               equal_filter_result({test_action::hide, ""}));
+
+        // Negated groups depend on every alternative, so they all count.
+        attr_filter negated{ !attr_any_of({
+          {has_attr("second", "other")}, {has_attr("first", "2")}
+        }) };
+        expect(negated(test_name(), {attr1("1"), attr2("message")}),
+               equal_filter_result({test_action::run, ""}));
+      });
+
+      _.test("custom items", []() {
+        string_attr attr("attr");
+
+        attr_filter filter{ {"attr", [](const attr_instance *attr) {
+          return attr && attr->value.size() == 1;
+        }} };
+        expect(filter(test_name(), {attr("value")}),
+               equal_filter_result({test_action::run, ""}));
+        expect(filter(test_name(), {}),
+               equal_filter_result({test_action::hide, ""}));
+      });
+    });
   });
 
   subsuite<>(_, "attr_filter_set", [](auto &_) {
@@ -638,6 +848,25 @@ suite<> test_combined_filters("combined filters", [](auto &_) {
     );
   });
 
+  _.test("shard filter", []() {
+    std::size_t shown = 0;
+    for(test_uid i = 0; i != 20; i++) {
+      test_name name = {{"suite"}, "test " + std::to_string(i), i};
+      auto result = filter_set{ {}, {}, {0, 2} }(name, {});
+      if(result.action == test_action::indeterminate)
+        shown++;
+      else
+        expect(result, equal_filter_result({test_action::hide, ""}));
+
+      // Name filters take precedence over sharding.
+      expect(
+        filter_set{ {std::regex("mismatch")}, {}, {0, 2} }(name, {}),
+        equal_filter_result({test_action::hide, ""})
+      );
+    }
+    expect(shown, all(greater(0u), less(20u)));
+  });
+
   _.test("name and attr filters", []() {
     bool_attr attr1("first", test_action::skip);
     bool_attr attr2("second");
@@ -690,4 +919,26 @@ suite<> test_combined_filters("combined filters", [](auto &_) {
       equal_filter_result({test_action::run, ""})
     );
   });
+
+  _.test("exact name filter", []() {
+    exact_name_filter exact;
+    exact.insert("suite > subsuite > test");
+
+    expect(
+      filter_set{ {}, {}, {}, exact }({{"suite", "subsuite"}, "test", 1}, {}),
+      equal_filter_result({test_action::indeterminate, ""})
+    );
+    expect(
+      filter_set{ {}, {}, {}, exact }({{"suite", "subsuite"}, "other", 2}, {}),
+      equal_filter_result({test_action::hide, ""})
+    );
+    expect(
+      filter_set{ {std::regex("mismatch")}, {}, {}, exact }(
+        {{"suite", "subsuite"}, "test", 1}, {}
+      ),
+      equal_filter_result({test_action::hide, ""})
+    );
+    expect(filter_set{ {}, {}, {}, exact }.may_match({"other"}),
+           equal_to(false));
+  });
 });
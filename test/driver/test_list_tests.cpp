@@ -0,0 +1,142 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <sstream>
+
+#include <bencode.hpp>
+#include <mettle/driver/filters.hpp>
+#include <mettle/driver/list_tests.hpp>
+
+template<typename Suites>
+std::vector<std::string> list_names(const Suites &suites,
+                                    const filter_set &filter = {}) {
+  std::vector<std::string> result;
+  list_tests(suites, filter, [&result](const test_listing &test) {
+    result.push_back(test.name.full_name());
+  });
+  return result;
+}
+
+suite<> test_list_tests("list_tests", [](auto &_) {
+
+  _.test("all tests", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", {skip}, []() {});
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("sub-test 1", []() {});
+      });
+    });
+
+    expect(list_names(s), array(
+      "inner > test 1", "inner > test 2", "inner > subsuite > sub-test 1"
+    ));
+  });
+
+  _.test("actions", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", {skip("broken")}, []() {});
+    });
+
+    std::vector<test_listing> listed;
+    list_tests(s, filter_set{}, [&listed](const test_listing &test) {
+      listed.push_back(test);
+    });
+
+    expect(listed.size(), equal_to(2u));
+    expect(listed[0].action, equal_to(test_action::run));
+    expect(listed[0].attrs.size(), equal_to(0u));
+    expect(listed[1].action, equal_to(test_action::skip));
+    expect(listed[1].message, equal_to("broken"));
+    expect(listed[1].attrs.size(), equal_to(1u));
+    expect(listed[1].attrs[0].first, equal_to("skip"));
+    expect(listed[1].attrs[0].second, array("broken"));
+  });
+
+  _.test("filtered", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", []() {});
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("test 1", []() {});
+      });
+    });
+
+    expect(list_names(s, filter_set{ {"test 1$"}, {} }), array(
+      "inner > test 1", "inner > subsuite > test 1"
+    ));
+  });
+
+  _.test("lazy suites aren't built when filtered out", []() {
+    static bool built_skipped = false;
+    built_skipped = false;
+
+    suites_list s;
+    lazy_suite<>(s, "inner", [](auto &_){
+      _.test("test 1", []() {});
+    });
+    lazy_suite<>(s, "skipped", [](auto &_){
+      built_skipped = true;
+      _.test("test 1", []() {});
+    });
+
+    expect(list_names(s, filter_set{ {"^inner > "}, {} }),
+           array("inner > test 1"));
+    expect(built_skipped, equal_to(false));
+  });
+
+  subsuite<>(_, "write_listing_json()", [](auto &_) {
+    _.test("basic", []() {
+      std::ostringstream ss;
+      write_listing_json(ss, {{{"suite", "sub"}, "test", 1}, {}});
+      expect(ss.str(), equal_to(
+        R"({"id": 1, "suites": ["suite", "sub"], "name": "test", )"
+        R"("attrs": {}, "action": "run"})" "\n"
+      ));
+    });
+
+    _.test("skipped with attributes", []() {
+      std::ostringstream ss;
+      write_listing_json(ss, {
+        {{"suite"}, "test", 2}, {{"skip", {"slow"}}, {"tag", {"a", "b"}}},
+        test_action::skip, "slow", "file"
+      });
+      expect(ss.str(), equal_to(
+        R"({"file": "file", "id": 2, "suites": ["suite"], "name": "test", )"
+        R"("attrs": {"skip": ["slow"], "tag": ["a", "b"]}, "action": "skip", )"
+        R"("message": "slow"})" "\n"
+      ));
+    });
+
+    _.test("escaping", []() {
+      std::ostringstream ss;
+      write_listing_json(ss, {{{"\"quoted\""}, "a\\b\n\x01", 3}, {}});
+      expect(ss.str(), equal_to(
+        R"({"id": 3, "suites": ["\"quoted\""], "name": "a\\b\n\u0001", )"
+        R"("attrs": {}, "action": "run"})" "\n"
+      ));
+    });
+  });
+
+  _.test("write_listing_event()", []() {
+    std::ostringstream ss;
+    write_listing_event(ss, {
+      {{"suite"}, "test", 2}, {{"tag", {"a", "b"}}}, test_action::skip, "msg"
+    });
+
+    auto data = boost::get<bencode::dict>(bencode::decode(ss.str()));
+    expect(boost::get<bencode::string>(data.at("event")),
+           equal_to("listed_test"));
+    expect(boost::get<bencode::string>(data.at("action")), equal_to("skip"));
+    expect(boost::get<bencode::string>(data.at("message")), equal_to("msg"));
+
+    auto &test = boost::get<bencode::dict>(data.at("test"));
+    expect(boost::get<bencode::integer>(test.at("id")), equal_to(2));
+    expect(boost::get<bencode::string>(test.at("test")), equal_to("test"));
+
+    auto &attrs = boost::get<bencode::dict>(data.at("attrs"));
+    expect(boost::get<bencode::list>(attrs.at("tag")).size(), equal_to(2u));
+  });
+
+});
@@ -1,12 +1,21 @@
 #include <mettle.hpp>
 using namespace mettle;
 
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <sstream>
 
+#include "../../src/mettle/event_record.hpp"
 #include "../../src/mettle/log_pipe.hpp"
 #include "../../src/mettle/run_test_files.hpp"
 
 #ifndef _WIN32
+#  include <dirent.h>
+#  include <signal.h>
+#  include <unistd.h>
+#  include <csignal>
+#  include <thread>
 #  include "../../src/mettle/posix/run_test_file.hpp"
 namespace platform = mettle::posix;
 std::string pathsep = "/";
@@ -34,6 +43,31 @@ std::string test_data(const std::string &file) {
   return result;
 }
 
+#ifndef _WIN32
+struct temp_dir {
+  temp_dir() {
+    char name[] = "/tmp/mettle-XXXXXX";
+    if(!mkdtemp(name))
+      throw std::runtime_error("unable to create temporary directory");
+    path = name;
+  }
+
+  ~temp_dir() {
+    if(DIR *dir = opendir(path.c_str())) {
+      while(auto *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if(name != "." && name != "..")
+          unlink((path + "/" + name).c_str());
+      }
+      closedir(dir);
+    }
+    rmdir(path.c_str());
+  }
+
+  std::string path;
+};
+#endif
+
 auto passed(bool expected) {
   return filter([](auto &&x) { return x.passed; }, equal_to(expected),
                 "passed: ");
@@ -61,6 +95,78 @@ suite<> test_run_file("run files", [](auto &_) {
       expect(run_test_file({test_data("test_abort")}, f.pipe), passed(false));
       expect(f.logger.events, array());
     });
+
+    _.test("file from an older version", [](logger_factory &f) {
+      expect(run_test_file({test_data("test_old_driver")}, f.pipe),
+             passed(true));
+      expect(f.logger.events, array(
+        "started_suite", "started_test", "passed_test", "ended_suite"
+      ));
+    });
+
+#ifndef _WIN32
+    _.test("missing file", [](logger_factory &f) {
+      expect(run_test_file({test_data("nonexist")}, f.pipe), passed(true));
+      expect(f.logger.events, array("failed_file"));
+    });
+
+    _.test("test module", [](logger_factory &f) {
+#  ifdef __APPLE__
+      auto module = test_data("libtest_pass_module.dylib");
+#  else
+      auto module = test_data("libtest_pass_module.so");
+#  endif
+      expect(run_test_file({module}, f.pipe), passed(true));
+      expect(f.logger.events, array(
+        "started_suite", "started_test", "passed_test", "ended_suite"
+      ));
+    });
+
+    _.test("missing test module", [](logger_factory &f) {
+      expect(run_test_file({test_data("nonexist.so")}, f.pipe), passed(true));
+      expect(f.logger.events, array("failed_file"));
+    });
+
+    subsuite<>(_, "interrupted file", [](auto &_) {
+      static volatile std::sig_atomic_t caught;
+      auto run_interrupted = [](logger_factory &f) {
+        // Handle SIGINT like a `--serve` server does.
+        caught = 0;
+        struct sigaction act = {};
+        sigemptyset(&act.sa_mask);
+        act.sa_flags = SA_RESTART;
+        act.sa_handler = [](int) { caught = 1; };
+        sigaction(SIGINT, &act, nullptr);
+
+        std::thread interrupt([]() {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          kill(getpid(), SIGINT);
+        });
+        auto result = run_test_file({
+          test_data("test_slow"), "--timeout", "500"
+        }, f.pipe);
+        interrupt.join();
+        return result;
+      };
+
+      _.test("forwarded", [run_interrupted](logger_factory &f) {
+        expect(run_interrupted(f), passed(false));
+        expect(caught, equal_to(1));
+      });
+
+      _.test("not forwarded", [run_interrupted](logger_factory &f) {
+        forward_signals_to_files(false);
+        expect(run_interrupted(f), passed(true));
+        expect(caught, equal_to(1));
+        expect(f.logger.events, array(
+          "started_suite",
+            "started_test", "failed_test",
+            "started_test", "failed_test",
+          "ended_suite"
+        ));
+      });
+    });
+#endif
   });
 
   subsuite<test_event_logger>(_, "run_test_files()", [](auto &_) {
@@ -135,5 +241,320 @@ suite<> test_run_file("run files", [](auto &_) {
       expect(logger.files.size(), equal_to(3));
       expect(logger.tests.size(), equal_to(2));
     });
+
+    _.test("max failures", [](test_event_logger &logger) {
+      failure_limit limit(1);
+      auto unstarted = run_test_files({
+        test_data("test_pass"), test_data("test_fail"), test_data("test_pass"),
+        test_data("test_abort")
+      }, logger, {}, 1, nullptr, &limit);
+
+      expect(unstarted, equal_to(2u));
+      expect(limit.failures(), equal_to(1u));
+      expect(logger.events, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+        "ended_run"
+      ));
+    });
+
+    _.test("max failures across files", [](test_event_logger &logger) {
+      using namespace std::literals::chrono_literals;
+      failure_limit limit(2);
+
+      auto then = std::chrono::steady_clock::now();
+      auto unstarted = run_test_files({
+        test_data("test_fail"), test_data("test_slow"), test_data("test_pass")
+      }, logger, {}, 1, nullptr, &limit);
+      auto now = std::chrono::steady_clock::now();
+
+      // test_slow is stopped as soon as its first failure reaches the limit,
+      // rather than waiting for its slow test.
+      expect(unstarted, equal_to(1u));
+      expect(logger.events, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+          "started_file",
+            "started_suite", "started_test", "failed_test",
+          "failed_file",
+        "ended_run"
+      ));
+      expect(now - then, less(5s));
+    });
+
+#ifndef _WIN32
+    _.test("multiple files in parallel", [](test_event_logger &logger) {
+      run_test_files({
+        test_data("test_pass"), test_data("test_fail"), test_data("test_abort"),
+        test_data("test_pass")
+      }, logger, {}, 3);
+      expect(logger.events, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+          "started_file", "failed_file",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+        "ended_run"
+      ));
+      expect(logger.files.size(), equal_to(4));
+      expect(logger.tests.size(), equal_to(3));
+    });
+
+    _.test("missing files in parallel", [](test_event_logger &logger) {
+      run_test_files({
+        test_data("nonexist"), test_data("test_pass"), test_data("nonexist.so")
+      }, logger, {}, 2);
+      expect(logger.events, array(
+        "started_run",
+          "started_file", "failed_file", "ended_file",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+          "started_file", "failed_file", "ended_file",
+        "ended_run"
+      ));
+    });
+
+    _.test("multiple files in parallel with history",
+           [](test_event_logger &logger) {
+      using namespace std::literals::chrono_literals;
+      test_history history;
+      history.add_file(test_data("test_fail"), 1000ms, true);
+
+      run_test_files({
+        test_data("test_pass"), test_data("test_fail"), test_data("test_abort")
+      }, logger, {}, 2, &history);
+      // Files are still logged in the order they were specified.
+      expect(logger.events, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+          "started_file", "failed_file",
+        "ended_run"
+      ));
+
+      expect(history.files().size(), equal_to(3u));
+      expect(history.find_file(test_data("test_fail"))->runs, equal_to(2u));
+      expect(history.find_file(test_data("test_abort"))->last_passed,
+             equal_to(false));
+    });
+
+    _.test("max failures in parallel", [](test_event_logger &logger) {
+      using namespace std::literals::chrono_literals;
+      failure_limit limit(1);
+      test_history history;
+
+      auto then = std::chrono::steady_clock::now();
+      auto unstarted = run_test_files({
+        test_data("test_fail"), test_data("test_slow")
+      }, logger, {}, 2, &history, &limit);
+      auto now = std::chrono::steady_clock::now();
+
+      // test_slow is killed once test_fail finishes, and none of its partial
+      // results are logged.
+      expect(unstarted, equal_to(0u));
+      expect(limit.failures(), equal_to(1u));
+      expect(logger.events, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+          "started_file", "failed_file",
+        "ended_run"
+      ));
+      expect(now - then, less(5s));
+      expect(history.find_file(test_data("test_slow")), equal_to(nullptr));
+    });
+
+    _.test("multiple files in parallel after max failures",
+           [](test_event_logger &logger) {
+      failure_limit limit(1);
+      limit.add();
+
+      auto unstarted = run_test_files({
+        test_data("test_pass"), test_data("test_fail"), test_data("test_abort")
+      }, logger, {}, 2, nullptr, &limit);
+      expect(unstarted, equal_to(3u));
+      expect(logger.events, array("started_run", "ended_run"));
+    });
+
+    _.test("cached files", [](test_event_logger &logger) {
+      temp_dir dir;
+      result_cache cache(dir.path);
+      std::vector<test_command> files = {
+        test_data("test_pass"), test_data("test_fail")
+      };
+
+      run_test_files(files, logger, {}, 1, nullptr, nullptr, &cache);
+      auto expected = logger.events;
+      expect(expected, array(
+        "started_run",
+          "started_file",
+            "started_suite", "started_test", "passed_test", "ended_suite",
+          "ended_file",
+          "started_file",
+            "started_suite", "started_test", "failed_test", "ended_suite",
+          "ended_file",
+        "ended_run"
+      ));
+
+      // Only the passing file should have been stored.
+      auto pass_manifest = cache.manifest({test_data("test_pass")});
+      expect(cache.find(pass_manifest), is_not(std::nullopt));
+      expect(cache.find(cache.manifest({test_data("test_fail")})),
+             equal_to(std::nullopt));
+
+      for(std::size_t jobs : {1, 2}) {
+        test_event_logger cached;
+        run_test_files(files, cached, {}, jobs, nullptr, nullptr, &cache);
+        expect(cached.events, equal_to(expected));
+      }
+
+      // Make sure we're really replaying the stored events.
+      cache.store(pass_manifest, "");
+      for(std::size_t jobs : {1, 2}) {
+        test_event_logger cached;
+        run_test_files({test_data("test_pass")}, cached, {}, jobs, nullptr,
+                       nullptr, &cache);
+        expect(cached.events, array(
+          "started_run", "started_file", "ended_file", "ended_run"
+        ));
+      }
+
+      // Changing the arguments changes the manifest.
+      expect(cache.find(cache.manifest({test_data("test_pass"), "--arg"})),
+             equal_to(std::nullopt));
+    });
+
+    _.test("recorded files", [](test_event_logger &logger) {
+      temp_dir dir;
+      std::vector<test_command> files = {
+        test_data("test_pass"), test_data("test_fail"), test_data("test_abort")
+      };
+      for(std::size_t jobs : {1, 2}) {
+        event_recorder recorder(dir.path + "/" + std::to_string(jobs));
+        run_test_files(files, logger, {}, jobs, nullptr, nullptr, nullptr,
+                       &recorder);
+      }
+
+      std::vector<std::string> expected;
+      for(const auto &i : logger.events) {
+        if(i != "started_run" && i != "ended_run")
+          expected.push_back(i);
+      }
+
+      // Replaying both records should log every file again, without any of
+      // the tests from one record colliding with the other.
+      test_event_logger replayed;
+      detail::file_uid_maker uid;
+      for(std::size_t jobs : {1, 2}) {
+        std::ifstream is(dir.path + "/" + std::to_string(jobs),
+                         std::ios::binary);
+        replay_event_record(is, replayed, uid);
+      }
+      expect(replayed.events, equal_to(expected));
+      expect(replayed.files.size(), equal_to(6));
+      expect(replayed.tests.size(), equal_to(4));
+    });
+#endif
+  });
+
+  subsuite<test_event_logger>(_, "replay_event_record()", [](auto &_) {
+    auto header = std::string(event_recorder::file_header) + "\n";
+
+    _.test("empty record", [header](test_event_logger &logger) {
+      std::istringstream is(header);
+      detail::file_uid_maker uid;
+      replay_event_record(is, logger, uid);
+      expect(logger.events, array());
+    });
+
+    _.test("failed file", [header](test_event_logger &logger) {
+      std::istringstream is(
+        header + "d4:file4:test7:message4:oops6:passedi0e4:sizei0ee"
+      );
+      detail::file_uid_maker uid;
+      replay_event_record(is, logger, uid);
+      expect(logger.events, array("started_file", "failed_file"));
+    });
+
+    _.test("unrecognized record", [](test_event_logger &logger) {
+      std::istringstream is("not a record\n");
+      detail::file_uid_maker uid;
+      expect([&]() { replay_event_record(is, logger, uid); },
+             thrown<std::invalid_argument>("unrecognized event record"));
+    });
+
+    _.test("invalid record", [header](test_event_logger &logger) {
+      std::istringstream is(header + "d4:file4:teste");
+      detail::file_uid_maker uid;
+      expect([&]() { replay_event_record(is, logger, uid); },
+             thrown<std::invalid_argument>("invalid event record"));
+    });
+
+    _.test("truncated record", [header](test_event_logger &logger) {
+      std::istringstream is(
+        header + "d4:file4:test7:message0:6:passedi1e4:sizei10ee" + "abc"
+      );
+      detail::file_uid_maker uid;
+      expect([&]() { replay_event_record(is, logger, uid); },
+             thrown<std::invalid_argument>("truncated event record"));
+    });
+  });
+
+  subsuite<>(_, "list_test_files()", [](auto &_) {
+    auto list = [](const std::vector<test_command> &files,
+                   std::size_t jobs = 1) {
+      std::vector<std::string> result;
+      list_test_files(files, [&result](test_listing &&test) {
+        result.push_back(test.file + ": " + test.name.full_name());
+      }, [&result](const test_command &file, const std::string &) {
+        result.push_back(file.command() + ": failed");
+      }, {"--list"}, jobs);
+      return result;
+    };
+
+    _.test("single file", [list]() {
+      expect(list({test_data("test_pass")}), array(
+        test_data("test_pass") + ": suite > test"
+      ));
+    });
+
+    _.test("multiple files", [list]() {
+      expect(list({test_data("test_pass"), test_data("test_abort"),
+                   test_data("test_fail")}), array(
+        test_data("test_pass") + ": suite > test",
+        test_data("test_abort") + ": failed",
+        test_data("test_fail") + ": suite > test"
+      ));
+    });
+
+#ifndef _WIN32
+    _.test("multiple files in parallel", [list]() {
+      expect(list({test_data("test_pass"), test_data("test_abort"),
+                   test_data("test_fail")}, 3), array(
+        test_data("test_pass") + ": suite > test",
+        test_data("test_abort") + ": failed",
+        test_data("test_fail") + ": suite > test"
+      ));
+    });
+#endif
   });
 });
@@ -1,9 +1,27 @@
 #include <mettle.hpp>
 using namespace mettle;
 
+#include <mettle/driver/filters.hpp>
 #include <mettle/driver/run_tests.hpp>
 #include "../test_event_logger.hpp"
 
+// Run tests inline, but only report their results when `wait()` is called,
+// and in reverse order.
+struct reversed_test_runner : async_test_runner {
+  void run(const test_name &, const test_info &test,
+           callback_type done) override {
+    pending.push_back({test.function(), std::move(done)});
+  }
+
+  void wait() override {
+    for(auto i = pending.rbegin(); i != pending.rend(); ++i)
+      i->second(i->first, {}, {});
+    pending.clear();
+  }
+
+  std::vector<std::pair<test_result, callback_type>> pending;
+};
+
 suite<test_event_logger> test_run_tests("run_tests", [](auto &_) {
 
   _.test("single suite", [](test_event_logger &logger) {
@@ -133,4 +151,184 @@ suite<test_event_logger> test_run_tests("run_tests", [](auto &_) {
     expect(logger.events, equal_to(expected));
   });
 
+  _.test("filtered lazy suites", [](test_event_logger &logger) {
+    static bool built_skipped = false;
+    built_skipped = false;
+
+    suites_list s;
+    lazy_suite<>(s, "inner", [](auto &_){
+      _.test("test 1", []() {});
+    });
+    lazy_suite<>(s, "skipped", [](auto &_){
+      built_skipped = true;
+      _.test("test 1", []() {});
+    });
+
+    std::vector<std::string> expected = {
+      "started_run",
+      "started_suite",
+        "started_test",
+        "passed_test",
+      "ended_suite",
+      "ended_run"
+    };
+
+    run_tests(s, logger, inline_test_runner,
+              filter_set{ {"^inner > "}, {} });
+    expect(logger.events, equal_to(expected));
+    expect(built_skipped, equal_to(false));
+    expect(s[0].is_expanded(), equal_to(true));
+    expect(s[1].is_expanded(), equal_to(false));
+  });
+
+  _.test("async runner", [](test_event_logger &logger) {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", []() { expect(true, equal_to(false)); });
+      _.test("test 3", {skip}, []() {});
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("sub-test 1", []() {});
+      });
+    });
+
+    std::vector<std::string> expected = {
+      "started_run",
+      "started_suite",
+        "started_test",
+        "passed_test",
+        "started_test",
+        "failed_test",
+        "started_test",
+        "skipped_test",
+        "started_suite",
+          "started_test",
+          "passed_test",
+        "ended_suite",
+      "ended_suite",
+      "ended_run"
+    };
+
+    reversed_test_runner runner;
+    run_tests(s, logger, runner);
+    expect(logger.events, equal_to(expected));
+  });
+
+  _.test("async runner, longest first", [](test_event_logger &logger) {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", []() {});
+      _.test("test 3", []() {});
+    });
+
+    struct recording_runner : reversed_test_runner {
+      void run(const test_name &name, const test_info &test,
+               callback_type done) override {
+        started.push_back(name.name);
+        reversed_test_runner::run(name, test, std::move(done));
+      }
+
+      std::vector<std::string> started;
+    } runner;
+
+    auto estimate = [](const test_name &name) {
+      return name.name == "test 2" ? std::chrono::milliseconds(100) :
+                                     std::chrono::milliseconds(10);
+    };
+    run_tests(s, logger, runner, default_filter(), {estimate});
+    expect(runner.started, array("test 2", "test 1", "test 3"));
+
+    std::vector<std::string> names;
+    for(const auto &i : logger.tests)
+      names.push_back(i.name);
+    expect(names, array("test 1", "test 2", "test 3"));
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+  });
+
+  _.test("max failures", [](test_event_logger &logger) {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() { expect(true, equal_to(false)); });
+      _.test("test 2", []() {});
+      _.test("test 3", []() { expect(true, equal_to(false)); });
+      _.test("test 4", []() {});
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("sub-test 1", []() {});
+      });
+    });
+
+    failure_limit limit(2);
+    run_tests(s, logger, inline_test_runner, default_filter(), {{}, &limit});
+    expect(limit.failures(), equal_to(2u));
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "passed_test",
+        "started_test", "failed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+  });
+
+  _.test("async runner, max failures", [](test_event_logger &logger) {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() { expect(true, equal_to(false)); });
+      _.test("test 2", []() {});
+      _.test("test 3", []() {});
+      _.test("test 4", []() {});
+    });
+
+    // Keep up to two tests in flight, finishing the oldest one when a third
+    // is started. Once cancelled, every test in flight fails.
+    struct cancellable_test_runner : async_test_runner {
+      void run(const test_name &, const test_info &test,
+               callback_type done) override {
+        if(cancelled)
+          return done({false, "cancelled"}, {}, {});
+
+        pending.push_back({test.function(), std::move(done)});
+        if(pending.size() > 1) {
+          auto next = std::move(pending.front());
+          pending.erase(pending.begin());
+          next.second(next.first, {}, {});
+        }
+      }
+
+      void wait() override {
+        for(auto &i : pending) {
+          i.second(cancelled ? test_result{false, "cancelled"} : i.first,
+                   {}, {});
+        }
+        pending.clear();
+      }
+
+      void cancel() override {
+        cancelled = true;
+      }
+
+      std::vector<std::pair<test_result, callback_type>> pending;
+      bool cancelled = false;
+    } runner;
+
+    failure_limit limit(1);
+    run_tests(s, logger, runner, default_filter(), {{}, &limit});
+    expect(runner.cancelled, equal_to(true));
+    expect(limit.failures(), equal_to(1u));
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "cancelled_test",
+      "ended_suite",
+      "ended_run"
+    ));
+  });
+
 });
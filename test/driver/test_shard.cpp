@@ -0,0 +1,117 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <sstream>
+
+#include <mettle/driver/shard.hpp>
+#include "../helpers.hpp"
+
+using ms = std::chrono::milliseconds;
+
+suite<> test_shard("sharding", [](auto &_) {
+  subsuite<>(_, "shard_filter", [](auto &_) {
+    _.test("by hash", []() {
+      std::vector<std::size_t> counts(3);
+      for(test_uid i = 0; i != 30; i++) {
+        test_name name = {{"suite"}, "test " + std::to_string(i), i};
+        std::size_t shown = 0;
+        for(std::size_t shard = 0; shard != 3; shard++) {
+          if(shard_filter(shard, 3)(name, {}).action != test_action::hide) {
+            counts[shard]++;
+            shown++;
+          }
+        }
+        expect(shown, equal_to(1u));
+      }
+      expect(counts, each(greater(0u)));
+    });
+
+    _.test("stable", []() {
+      test_name name = {{"suite", "subsuite"}, "test", 1};
+      auto expected = stable_hash("suite > subsuite > test") % 4;
+      for(std::size_t shard = 0; shard != 4; shard++) {
+        expect(shard_filter(shard, 4)(name, {}), equal_filter_result({
+          shard == expected ? test_action::indeterminate : test_action::hide, ""
+        }));
+      }
+    });
+
+    _.test("assigned", []() {
+      shard_filter filter(0, 2);
+      filter.assign({3, 1});
+      expect(filter({{"suite"}, "test", 1}, {}),
+             equal_filter_result({test_action::indeterminate, ""}));
+      expect(filter({{"suite"}, "test", 2}, {}),
+             equal_filter_result({test_action::hide, ""}));
+      expect(filter({{"suite"}, "test", 3}, {}),
+             equal_filter_result({test_action::indeterminate, ""}));
+    });
+
+    _.test("invalid", []() {
+      expect([]() { shard_filter(0, 0); }, thrown<std::invalid_argument>());
+      expect([]() { shard_filter(2, 2); }, thrown<std::invalid_argument>());
+    });
+  });
+
+  subsuite<>(_, "read_test_timings()", [](auto &_) {
+    _.test("valid", []() {
+      std::istringstream ss("# comment\n100 suite > test 1\n\n"
+                            "25 suite > test 2\r\n");
+      auto timings = read_test_timings(ss);
+      expect(timings.size(), equal_to(2u));
+      expect(timings.at("suite > test 1"), equal_to(ms(100)));
+      expect(timings.at("suite > test 2"), equal_to(ms(25)));
+    });
+
+    _.test("invalid", []() {
+      std::istringstream ss("100 suite > test 1\nsuite > test 2\n");
+      expect([&ss]() { read_test_timings(ss); },
+             thrown<std::invalid_argument>("invalid timing on line 2"));
+    });
+  });
+
+  _.test("pick_shard()", []() {
+    std::vector<weighted_test> tests = {
+      {1, 1, ms(50)}, {2, 2, ms(40)}, {3, 3, ms(30)}, {4, 4, ms(20)},
+      {5, 5, ms(10)}
+    };
+    // 50 | 40 => 50 | 70 => 70 | 70 => 80 | 70
+    expect(pick_shard(tests, 0, 2), array(1u, 4u, 5u));
+    expect(pick_shard(tests, 1, 2), array(2u, 3u));
+
+    std::vector<weighted_test> instant = {
+      {1, 1, ms(0)}, {2, 2, ms(0)}, {3, 3, ms(0)}, {4, 4, ms(0)}
+    };
+    expect(pick_shard(instant, 0, 2), array(1u, 3u));
+    expect(pick_shard(instant, 1, 2), array(2u, 4u));
+  });
+
+  _.test("balance_shards()", []() {
+    auto s = make_suites<>("suite", [](auto &_){
+      _.test("slow", []() {});
+      _.test("fast 1", []() {});
+      _.test("fast 2", []() {});
+      _.test("unknown", []() {});
+      _.test("hidden", []() {});
+    });
+    test_timings timings = {
+      {"suite > slow", ms(90)}, {"suite > fast 1", ms(10)},
+      {"suite > fast 2", ms(20)}, {"suite > hidden", ms(1000)}
+    };
+
+    std::vector<std::string> shards[2];
+    for(std::size_t i = 0; i != 2; i++) {
+      filter_set filter = { {"^suite > [^h]"}, {}, {i, 2} };
+      balance_shards(filter, s, timings);
+      for(const auto &test : s[0].tests()) {
+        test_name name = {{"suite"}, test.name, test.id};
+        if(filter(name, test.attrs).action != test_action::hide)
+          shards[i].push_back(test.name);
+      }
+    }
+
+    // "unknown" is assumed to take the average of 40ms.
+    expect(shards[0], array("slow"));
+    expect(shards[1], array("fast 1", "fast 2", "unknown"));
+  });
+});
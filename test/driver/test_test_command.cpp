@@ -38,6 +38,13 @@ suite<> test_test_file("test_command", [](auto &_) {
     });
   });
 
+  _.test("add_args()", []() {
+    test_command command("file arg1");
+    command.add_args({"arg2", "arg 3"});
+    expect(command.command(), equal_to("file arg1"));
+    expect(command.args(), array("file", "arg1", "arg2", "arg 3"));
+  });
+
   _.test("program_options validate()", []() {
     boost::any value;
     validate(value, {"arg1 arg2"}, static_cast<test_command*>(nullptr), 0);
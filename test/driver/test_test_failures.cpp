@@ -0,0 +1,88 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <sstream>
+
+#include <mettle/driver/test_failures.hpp>
+#include <mettle/driver/log/failures.hpp>
+#include "../test_event_logger.hpp"
+
+using namespace std::literals::chrono_literals;
+
+suite<> test_failures_suite("test failures", [](auto &_) {
+  _.test("read() and write()", []() {
+    test_failures failures;
+    failures.add_test("", "suite > test");
+    failures.add_test("test_file --arg", "suite > tab\tand\\slash");
+    failures.add_test("test_file --arg", "suite > another");
+    failures.add_file("crashing_file");
+
+    std::ostringstream os;
+    failures.write(os);
+    expect(os.str(), equal_to(
+      "# mettle test failures v1\n"
+      "test\t\tsuite > test\n"
+      "file\tcrashing_file\n"
+      "test\ttest_file --arg\tsuite > another\n"
+      "test\ttest_file --arg\tsuite > tab\\tand\\\\slash\n"
+    ));
+
+    test_failures loaded;
+    std::istringstream is(os.str());
+    loaded.read(is);
+    expect(loaded.files().size(), equal_to(3u));
+
+    auto *record = loaded.find("test_file --arg");
+    expect(record, is_not(nullptr));
+    expect(record->failed, equal_to(false));
+    expect(record->tests.size(), equal_to(2u));
+    expect(record->tests.count("suite > tab\tand\\slash"), equal_to(1u));
+
+    expect(loaded.find("")->tests.count("suite > test"), equal_to(1u));
+    expect(loaded.find("crashing_file")->failed, equal_to(true));
+    expect(loaded.find("missing"), equal_to(nullptr));
+  });
+
+  _.test("read() invalid", []() {
+    expect([]() {
+      std::istringstream is("not a failures file\n");
+      test_failures().read(is);
+    }, thrown<std::invalid_argument>("unrecognized failures file"));
+
+    expect([]() {
+      std::istringstream is("# mettle test failures v1\n"
+                            "test\t\tname\n"
+                            "test\tname\n");
+      test_failures().read(is);
+    }, thrown<std::invalid_argument>("invalid failures on line 3"));
+  });
+
+  _.test("log::failures", []() {
+    test_failures failures;
+    test_event_logger logger;
+    log::failures recorder(failures, logger);
+
+    recorder.started_run();
+    recorder.passed_test({{"suite"}, "passed", 1}, {}, 10ms);
+    recorder.failed_test({{"suite"}, "failed", 2}, "message", {}, 20ms);
+    recorder.started_file({"file", 3});
+    recorder.failed_test({{"suite"}, "failed", 4}, "message", {}, 20ms);
+    recorder.cancelled_test({{"suite"}, "cancelled", 5});
+    recorder.ended_file({"file", 3});
+    recorder.started_file({"crashed", 6});
+    recorder.failed_file({"crashed", 6}, "message");
+    recorder.ended_run();
+
+    expect(logger.events, array(
+      "started_run", "passed_test", "failed_test", "started_file",
+      "failed_test", "cancelled_test", "ended_file", "started_file",
+      "failed_file", "ended_run"
+    ));
+    expect(failures.files().size(), equal_to(3u));
+    expect(failures.find("")->tests.size(), equal_to(1u));
+    expect(failures.find("")->tests.count("suite > failed"), equal_to(1u));
+    expect(failures.find("file")->tests.size(), equal_to(1u));
+    expect(failures.find("file")->failed, equal_to(false));
+    expect(failures.find("crashed")->failed, equal_to(true));
+  });
+});
@@ -0,0 +1,198 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <sstream>
+
+#include <mettle/driver/test_history.hpp>
+#include <mettle/driver/log/history.hpp>
+#include "../test_event_logger.hpp"
+
+using namespace std::literals::chrono_literals;
+
+suite<> test_history_suite("test history", [](auto &_) {
+  subsuite<>(_, "test_record", [](auto &_) {
+    _.test("empty", []() {
+      test_record record;
+      expect(record.runs, equal_to(0u));
+      expect(record.mean(), equal_to(0ms));
+      expect(record.percentile(50), equal_to(0ms));
+    });
+
+    _.test("add()", []() {
+      test_record record;
+      record.add(10ms, true);
+      record.add(30ms, false);
+      record.add(20ms, true);
+
+      expect(record.runs, equal_to(3u));
+      expect(record.failures, equal_to(1u));
+      expect(record.last_passed, equal_to(true));
+      expect(record.samples, array(10ms, 30ms, 20ms));
+      expect(record.mean(), equal_to(20ms));
+      expect(record.percentile(0), equal_to(10ms));
+      expect(record.percentile(50), equal_to(20ms));
+      expect(record.percentile(90), equal_to(30ms));
+      expect(record.percentile(100), equal_to(30ms));
+    });
+
+    _.test("rolling window", []() {
+      test_record record;
+      for(std::size_t i = 0; i != test_record::max_samples + 4; i++)
+        record.add(std::chrono::milliseconds(i), true);
+
+      expect(record.runs, equal_to(test_record::max_samples + 4));
+      expect(record.samples.size(), equal_to(test_record::max_samples));
+      expect(record.samples.front(), equal_to(4ms));
+    });
+  });
+
+  subsuite<>(_, "test_history", [](auto &_) {
+    _.test("read() and write()", []() {
+      test_history history;
+      history.add_test("", "suite > test", 10ms, true);
+      history.add_test("", "suite > test", 20ms, false);
+      history.add_test("", "suite > tab\tand\\slash", 5ms, true);
+      history.add_test("test_file --arg", "suite > test", 30ms, true);
+      history.add_file("test_file --arg", 100ms, true);
+
+      std::ostringstream os;
+      history.write(os);
+      expect(os.str(), equal_to(
+        "# mettle test history v1\n"
+        "file\ttest_file --arg\t1\t0\tpass\t100\n"
+        "test\t\tsuite > tab\\tand\\\\slash\t1\t0\tpass\t5\n"
+        "test\t\tsuite > test\t2\t1\tfail\t10,20\n"
+        "test\ttest_file --arg\tsuite > test\t1\t0\tpass\t30\n"
+      ));
+
+      test_history loaded;
+      std::istringstream is(os.str());
+      loaded.read(is);
+      expect(loaded.tests().size(), equal_to(2u));
+      expect(loaded.find_tests("")->size(), equal_to(2u));
+      expect(loaded.find_tests("test_file --arg")->size(), equal_to(1u));
+      expect(loaded.files().size(), equal_to(1u));
+
+      auto *record = loaded.find_test("", "suite > test");
+      expect(record, is_not(nullptr));
+      expect(record->runs, equal_to(2u));
+      expect(record->failures, equal_to(1u));
+      expect(record->last_passed, equal_to(false));
+      expect(record->samples, array(10ms, 20ms));
+
+      record = loaded.find_test("test_file --arg", "suite > test");
+      expect(record, is_not(nullptr));
+      expect(record->samples, array(30ms));
+
+      expect(loaded.find_test("", "suite > tab\tand\\slash"),
+             is_not(nullptr));
+      expect(loaded.find_file("test_file --arg")->mean(), equal_to(100ms));
+      expect(loaded.find_test("", "missing"), equal_to(nullptr));
+      expect(loaded.find_test("missing", "suite > test"), equal_to(nullptr));
+    });
+
+    _.test("read() invalid", []() {
+      expect([]() {
+        std::istringstream is("not a history file\n");
+        test_history().read(is);
+      }, thrown<std::invalid_argument>("unrecognized history file"));
+
+      expect([]() {
+        std::istringstream is("# mettle test history v1\n"
+                              "test\t\tname\t1\t0\tpass\t10\n"
+                              "test\tname\t1\t0\tpass\t10\n");
+        test_history().read(is);
+      }, thrown<std::invalid_argument>("invalid history on line 3"));
+    });
+
+    _.test("timings()", []() {
+      test_history history;
+      history.add_test("", "suite > test 1", 10ms, true);
+      history.add_test("", "suite > test 1", 30ms, true);
+      history.add_test("", "suite > test 2", 5ms, true);
+      history.add_test("file", "suite > test 1", 50ms, true);
+
+      auto timings = history.timings();
+      expect(timings.size(), equal_to(2u));
+      expect(timings.at("suite > test 1"), equal_to(20ms));
+      expect(timings.at("suite > test 2"), equal_to(5ms));
+
+      auto file_timings = history.timings("file");
+      expect(file_timings.size(), equal_to(1u));
+      expect(file_timings.at("suite > test 1"), equal_to(50ms));
+      expect(history.timings("missing").size(), equal_to(0u));
+
+      std::stringstream ss;
+      history.write(ss);
+      expect(read_test_timings(ss), equal_to(timings));
+      ss.clear();
+      ss.seekg(0);
+      expect(read_test_timings(ss, "file"), equal_to(file_timings));
+    });
+  });
+
+  _.test("history_estimator", []() {
+    test_history history;
+    history.add_test("", "suite > slow", 100ms, true);
+    history.add_test("", "suite > fast", 20ms, true);
+    history.add_test("file", "suite > slow", 10ms, true);
+
+    history_estimator estimate(history);
+    expect(estimate({{"suite"}, "slow", 1}), equal_to(100ms));
+    expect(estimate({{"suite"}, "fast", 2}), equal_to(20ms));
+    expect(estimate({{"suite"}, "new", 3}), equal_to(60ms));
+
+    history_estimator file_estimate(history, "file");
+    expect(file_estimate({{"suite"}, "slow", 1}), equal_to(10ms));
+    expect(file_estimate({{"suite"}, "fast", 2}), equal_to(10ms));
+
+    history_estimator missing_estimate(history, "missing");
+    expect(missing_estimate({{"suite"}, "slow", 1}), equal_to(1ms));
+  });
+
+  _.test("log::history", []() {
+    test_history history;
+    test_event_logger logger;
+    log::history recorder(history, logger);
+
+    recorder.started_run();
+    recorder.passed_test({{"suite"}, "passed", 1}, {}, 10ms);
+    recorder.failed_test({{"suite"}, "failed", 2}, "message", {}, 20ms);
+    recorder.skipped_test({{"suite"}, "skipped", 3}, "message");
+    recorder.ended_run();
+
+    expect(logger.events, array(
+      "started_run", "passed_test", "failed_test", "skipped_test", "ended_run"
+    ));
+    expect(history.tests().size(), equal_to(1u));
+    expect(history.find_tests("")->size(), equal_to(2u));
+    expect(history.find_test("", "suite > passed")->last_passed,
+           equal_to(true));
+    expect(history.find_test("", "suite > failed")->last_passed,
+           equal_to(false));
+    expect(history.find_test("", "suite > failed")->mean(), equal_to(20ms));
+  });
+
+  _.test("log::history with files", []() {
+    test_history history;
+    test_event_logger logger;
+    log::history recorder(history, logger);
+
+    test_file file1 = {"file1", 1}, file2 = {"file2", 2};
+    recorder.started_run();
+    recorder.started_file(file1);
+    recorder.passed_test({{"suite"}, "test", 1}, {}, 10ms);
+    recorder.ended_file(file1);
+    recorder.started_file(file2);
+    recorder.failed_test({{"suite"}, "test", 2}, "message", {}, 20ms);
+    recorder.failed_file(file2, "message");
+    recorder.ended_run();
+
+    expect(history.tests().size(), equal_to(2u));
+    expect(history.find_test("", "suite > test"), equal_to(nullptr));
+    expect(history.find_test("file1", "suite > test")->mean(),
+           equal_to(10ms));
+    expect(history.find_test("file2", "suite > test")->last_passed,
+           equal_to(false));
+  });
+});
@@ -0,0 +1,84 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <mettle/driver/posix/event_loop.hpp>
+#include <mettle/driver/posix/scoped_pipe.hpp>
+using namespace mettle::posix;
+
+struct event_loop_fixture {
+  event_loop loop;
+  scoped_pipe pipe;
+  std::string result;
+  readfd reader = {-1, &result};
+};
+
+suite<event_loop_fixture> test_event_loop("posix event loop", [](auto &_) {
+  _.setup([](event_loop_fixture &f) {
+    expect("open pipe", f.pipe.open(), equal_to(0));
+    f.reader.fd = f.pipe.read_fd;
+  });
+
+  _.test("read until fd closes", [](event_loop_fixture &f) {
+    expect(f.loop.watch(f.reader), equal_to(0));
+
+    std::thread t([&f]() {
+      write(f.pipe.write_fd, "hello ", 6);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      write(f.pipe.write_fd, "world", 5);
+      f.pipe.close_write();
+    });
+
+    while(f.reader.fd >= 0)
+      expect(f.loop.wait(), greater_equal(0));
+    t.join();
+
+    expect(f.result, equal_to("hello world"));
+    expect(f.reader.fd, equal_to(-f.pipe.read_fd));
+  });
+
+  _.test("wait until deadline", [](event_loop_fixture &f) {
+    expect(f.loop.watch(f.reader), equal_to(0));
+
+    auto start = event_loop::clock::now();
+    auto deadline = start + std::chrono::milliseconds(50);
+    expect(f.loop.wait(deadline), equal_to(0));
+    expect(event_loop::clock::now(), greater_equal(deadline));
+    expect(f.reader.fd, equal_to(f.pipe.read_fd));
+
+    expect(f.loop.unwatch(f.reader), equal_to(0));
+    write(f.pipe.write_fd, "data", 4);
+    expect(f.loop.wait_nonblocking(), equal_to(0));
+    expect(f.result, equal_to(""));
+  });
+
+#ifdef __linux__
+  // Without pidfds, we'd need a SIGCHLD pipe to notice the child exiting.
+  _.test("reap child", [](event_loop_fixture &f) {
+    pid_t pid;
+    if((pid = fork()) < 0)
+      throw std::system_error(errno, std::system_category());
+    if(pid == 0) {
+      f.pipe.close_read();
+      write(f.pipe.write_fd, "child", 5);
+      _exit(3);
+    }
+
+    f.pipe.close_write();
+    std::optional<int> status;
+    expect(f.loop.watch(f.reader), equal_to(0));
+    expect(f.loop.watch_child(pid, status), equal_to(0));
+
+    while(f.reader.fd >= 0 || !status)
+      expect(f.loop.wait(), greater_equal(0));
+
+    expect(f.result, equal_to("child"));
+    expect(WIFEXITED(*status), equal_to(true));
+    expect(WEXITSTATUS(*status), equal_to(3));
+  });
+#endif
+});
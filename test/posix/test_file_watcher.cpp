@@ -0,0 +1,85 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#ifdef __linux__
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include "../../src/mettle/posix/file_watcher.hpp"
+using namespace mettle::posix;
+
+using namespace std::literals::chrono_literals;
+
+struct watcher_fixture {
+  watcher_fixture() {
+    char name[] = "/tmp/mettle-XXXXXX";
+    if(!mkdtemp(name))
+      throw std::runtime_error("unable to create temporary directory");
+    dir = name;
+    for(const char *i : {"first", "second", "other"})
+      touch(dir + "/" + i);
+  }
+
+  ~watcher_fixture() {
+    for(const char *i : {"first", "second", "other", "new"})
+      std::remove((dir + "/" + i).c_str());
+    rmdir(dir.c_str());
+  }
+
+  static void touch(const std::string &file) {
+    std::ofstream(file) << "data";
+  }
+
+  std::string dir;
+};
+
+suite<watcher_fixture> test_file_watcher("posix file watcher", [](auto &_) {
+  _.test("write to a file", [](watcher_fixture &f) {
+    file_watcher watcher({f.dir + "/first", f.dir + "/second"});
+
+    std::thread t([&f]() {
+      std::this_thread::sleep_for(10ms);
+      f.touch(f.dir + "/other");
+      f.touch(f.dir + "/second");
+    });
+    expect(watcher.wait(50ms), array(1u));
+    t.join();
+  });
+
+  _.test("replace a file", [](watcher_fixture &f) {
+    file_watcher watcher({f.dir + "/first", f.dir + "/second"});
+
+    std::thread t([&f]() {
+      std::this_thread::sleep_for(10ms);
+      f.touch(f.dir + "/new");
+      std::rename((f.dir + "/new").c_str(), (f.dir + "/first").c_str());
+    });
+    expect(watcher.wait(50ms), array(0u));
+    t.join();
+  });
+
+  _.test("debounce changes", [](watcher_fixture &f) {
+    file_watcher watcher({f.dir + "/first", f.dir + "/second"});
+
+    std::thread t([&f]() {
+      std::this_thread::sleep_for(10ms);
+      f.touch(f.dir + "/first");
+      std::this_thread::sleep_for(20ms);
+      f.touch(f.dir + "/second");
+    });
+    expect(watcher.wait(100ms), array(0u, 1u));
+    t.join();
+  });
+
+  _.test("same file twice", [](watcher_fixture &f) {
+    file_watcher watcher({f.dir + "/first", f.dir + "/first"});
+    f.touch(f.dir + "/first");
+    expect(watcher.wait(10ms), array(0u, 1u));
+  });
+});
+
+#endif
@@ -0,0 +1,206 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#ifndef _WIN32
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mettle/driver/posix/scoped_pipe.hpp>
+#include "../../src/mettle/posix/server.hpp"
+using namespace mettle::posix;
+
+extern char **environ;
+
+struct server_fixture {
+  server_fixture() {
+    char name[] = "/tmp/mettle-XXXXXX";
+    if(!mkdtemp(name))
+      throw std::runtime_error("unable to create temporary directory");
+    dir = name;
+  }
+
+  ~server_fixture() {
+    std::remove(socket().c_str());
+    rmdir(dir.c_str());
+  }
+
+  std::string socket() const {
+    return dir + "/socket";
+  }
+
+  server_request request(std::vector<std::string> args) const {
+    server_request req{std::move(args), dir, {}};
+    for(char **i = environ; *i; i++)
+      req.env.emplace_back(*i);
+    req.env.emplace_back("METTLE_SERVER_TEST=1");
+    return req;
+  }
+
+  std::string dir;
+};
+
+// Stands in for a client's stdout and stderr.
+struct client_output {
+  client_output() {
+    if(out.open(O_CLOEXEC) < 0 || err.open(O_CLOEXEC) < 0)
+      throw std::system_error(errno, std::system_category());
+  }
+
+  int send(const std::string &path, const server_request &request) {
+    int code = send_request(path, request, out.write_fd, err.write_fd);
+    out.close_write();
+    err.close_write();
+    return code;
+  }
+
+  // Only call these once the server is done with the request.
+  std::string out_str() {
+    return read_all(out.read_fd);
+  }
+
+  std::string err_str() {
+    return read_all(err.read_fd);
+  }
+
+  scoped_pipe out, err;
+private:
+  static std::string read_all(int fd) {
+    std::string result;
+    char buf[1024];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      result.append(buf, n);
+    return result;
+  }
+};
+
+suite<server_fixture> test_server("posix server", [](auto &_) {
+  _.test("handle a request", [](server_fixture &f) {
+    server s(f.socket());
+    server_request seen;
+    std::string cwd, env;
+    std::thread t([&]() {
+      s.handle_one([&](const server_request &req) {
+        seen = req;
+        char buf[4096];
+        cwd = getcwd(buf, sizeof(buf));
+        env = std::getenv("METTLE_SERVER_TEST");
+        std::cout << "out" << std::flush;
+        std::cerr << "err" << std::endl;
+        std::cout << "put" << std::endl;
+        return 3;
+      });
+    });
+
+    client_output output;
+    expect(output.send(f.socket(), f.request({"--foo", "bar"})), equal_to(3));
+    t.join();
+
+    expect(seen.args, array("--foo", "bar"));
+    expect(cwd, equal_to(f.dir));
+    expect(env, equal_to("1"));
+    expect(std::getenv("METTLE_SERVER_TEST"), equal_to(nullptr));
+    expect(output.out_str(), equal_to("output\n"));
+    expect(output.err_str(), equal_to("err\n"));
+  });
+
+  _.test("child process output", [](server_fixture &f) {
+    server s(f.socket());
+    std::thread t([&]() {
+      s.handle_one([](const server_request &) {
+        return std::system("echo out; echo err >&2") == 0 ? 0 : 1;
+      });
+    });
+
+    client_output output;
+    expect(output.send(f.socket(), f.request({})), equal_to(0));
+    t.join();
+
+    expect(output.out_str(), equal_to("out\n"));
+    expect(output.err_str(), equal_to("err\n"));
+  });
+
+  _.test("handler throws", [](server_fixture &f) {
+    server s(f.socket());
+    std::thread t([&]() {
+      s.handle_one([](const server_request &) -> int {
+        throw std::runtime_error("oops");
+      });
+    });
+
+    client_output output;
+    expect(output.send(f.socket(), f.request({})), greater(0));
+    t.join();
+
+    expect(output.out_str(), equal_to(""));
+    expect(output.err_str(), regex_search("oops"));
+  });
+
+  _.test("failed request restores state", [](server_fixture &f) {
+    char buf[4096];
+    std::string cwd = getcwd(buf, sizeof(buf));
+    server s(f.socket());
+
+    auto run = [&](server_request req, const request_handler &handle) {
+      std::thread t([&]() { s.handle_one(handle); });
+      client_output output;
+      auto code = output.send(f.socket(), req);
+      t.join();
+      return code;
+    };
+
+    expect(run(f.request({}), [](const server_request &) -> int {
+      throw std::runtime_error("oops");
+    }), greater(0));
+    expect(getcwd(buf, sizeof(buf)), equal_to(cwd));
+    expect(std::getenv("METTLE_SERVER_TEST"), equal_to(nullptr));
+
+    auto req = f.request({});
+    req.cwd = f.dir + "/nonexist";
+    bool called = false;
+    expect(run(req, [&](const server_request &) {
+      called = true;
+      return 0;
+    }), greater(0));
+    expect(called, equal_to(false));
+    expect(getcwd(buf, sizeof(buf)), equal_to(cwd));
+    expect(std::getenv("METTLE_SERVER_TEST"), equal_to(nullptr));
+  });
+
+  _.test("socket permissions", [](server_fixture &f) {
+    server s(f.socket());
+    struct stat st;
+    expect(stat(f.socket().c_str(), &st), equal_to(0));
+    expect(st.st_mode & 0777, equal_to(0600u));
+  });
+
+  _.test("socket already in use", [](server_fixture &f) {
+    server s(f.socket());
+    expect([&f]() { server other(f.socket()); },
+           thrown<std::runtime_error>());
+  });
+
+  _.test("stop", [](server_fixture &f) {
+    server s(f.socket());
+    s.stop();
+    bool called = false;
+    expect(s.handle_one([&](const server_request &) {
+      called = true;
+      return 0;
+    }), equal_to(false));
+    expect(called, equal_to(false));
+  });
+
+  _.test("no server", [](server_fixture &f) {
+    client_output output;
+    expect([&]() { output.send(f.socket(), f.request({})); },
+           thrown<std::system_error>());
+  });
+});
+
+#endif
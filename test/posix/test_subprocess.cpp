@@ -5,7 +5,6 @@ using namespace mettle;
 
 #include <fcntl.h>
 
-#include <mettle/driver/exit_code.hpp>
 #include <mettle/driver/posix/scoped_pipe.hpp>
 #include <mettle/driver/posix/scoped_signal.hpp>
 #include <mettle/driver/posix/subprocess.hpp>
@@ -22,23 +21,6 @@ struct read_into_fixture {
 void sighandler(int) {}
 
 suite<> test_subprocess("posix subprocess utilities", [](auto &_) {
-  subsuite<>(_, "make_timeout_monitor()", [](auto &_) {
-    _.test("test process exits first", []() {
-      expect([]() {
-        make_timeout_monitor(std::chrono::milliseconds(100));
-        _exit(0);
-      }, exited(0));
-    });
-
-    _.test("timer process exits first", []() {
-      expect([]() {
-        make_timeout_monitor(std::chrono::milliseconds(100));
-        std::this_thread::sleep_for(std::chrono::milliseconds(250));
-        _exit(0);
-      }, exited(exit_code::timeout));
-    });
-  });
-
   subsuite<read_into_fixture>(_, "read_into()", [](auto &_) {
     _.setup([](read_into_fixture &f) {
       expect("open pipe 1", f.pipe[0].open(), equal_to(0));
@@ -80,6 +62,23 @@ suite<> test_subprocess("posix subprocess utilities", [](auto &_) {
       expect(f.results[1], equal_to(""));
     });
 
+    _.test("timeout covers the whole call", [](read_into_fixture &f) {
+      std::thread t([&f]() {
+        for(int i = 0; i != 10; i++) {
+          write(f.pipe[0].write_fd, ".", 1);
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+      });
+
+      auto then = std::chrono::steady_clock::now();
+      timespec timeout = {0, 100*1000*1000 /* 100 ms */};
+      expect(read_into(f.readfds, &timeout, nullptr), equal_to(0));
+      auto now = std::chrono::steady_clock::now();
+      t.join();
+
+      expect(now - then, less(std::chrono::milliseconds(250)));
+    });
+
     attributes sigtest_attrs;
 #ifdef __APPLE__
     sigtest_attrs.insert(skip("pselect(2) is buggy on OS X"));
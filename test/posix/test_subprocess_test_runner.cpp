@@ -87,6 +87,25 @@ test_fork("posix::subprocess_test_runner", bind_factory(250ms), [](auto &_) {
       expect(now - then, less(1s));
     });
 
+    _.test("timed out test with closed pipes",
+           [](subprocess_test_runner &runner, log::test_output &output) {
+      auto s = make_suite<>("inner", [](auto &_){
+        _.test("test", []() {
+          for(int fd = 0; fd != 256; fd++)
+            close(fd);
+          std::this_thread::sleep_for(2s);
+        });
+      });
+
+      auto then = std::chrono::steady_clock::now();
+      auto result = runner(s.tests()[0], output);
+      auto now = std::chrono::steady_clock::now();
+
+      expect(result.passed, equal_to(false));
+      expect(result.message, equal_to("Timed out after 250 ms"));
+      expect(now - then, less(1s));
+    });
+
     _.test("test with timed out child", [](subprocess_test_runner &runner,
                                            log::test_output &output) {
       scoped_pipe block;
@@ -187,6 +206,22 @@ test_fork("posix::subprocess_test_runner", bind_factory(250ms), [](auto &_) {
       expect(output.stderr_log, equal_to("stderr"));
     });
 
+    _.test("test with limited stdout", [](subprocess_test_runner &,
+                                          log::test_output &output) {
+      subprocess_test_runner runner(250ms, log::capture_limit{8});
+      auto s = make_suite<>("inner", [](auto &_){
+        _.test("test", []() {
+          std::cout << "head" << std::string(100000, '.') << "tail";
+        });
+      });
+
+      auto result = runner(s.tests()[0], output);
+      expect(result.passed, equal_to(true));
+      expect(output.stdout_log,
+             equal_to("head\n[... 100000 bytes elided ...]\ntail"));
+      expect(output.stdout_capture, equal_to(nullptr));
+    });
+
   });
 
   subsuite<test_event_logger>(_, "run_tests()", [](auto &_) {
@@ -243,6 +278,576 @@ test_fork("posix::subprocess_test_runner", bind_factory(250ms), [](auto &_) {
 
 });
 
+suite<> test_parallel("posix::parallel_test_runner", [](auto &_) {
+
+  _.test("run tests in parallel", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      for(int i = 0; i != 4; i++) {
+        _.test("test " + std::to_string(i), []() {
+          std::this_thread::sleep_for(250ms);
+        });
+      }
+    });
+
+    test_event_logger logger;
+    parallel_test_runner runner(4);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(now - then, less(750ms));
+  });
+
+  _.test("log results in order", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("slow test", []() {
+        std::this_thread::sleep_for(250ms);
+        std::cout << "slow";
+      });
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("failing test", []() {
+          std::cout << "failing";
+          expect(true, equal_to(false));
+        });
+        _.test("aborting test", []() {
+          abort();
+        });
+      });
+    });
+
+    struct output_logger : test_event_logger {
+      void passed_test(const test_name &test, const log::test_output &output,
+                       log::test_duration duration) override {
+        test_event_logger::passed_test(test, output, duration);
+        outputs.push_back(output.stdout_log);
+      }
+      void failed_test(const test_name &test, const std::string &message,
+                       const log::test_output &output,
+                       log::test_duration duration) override {
+        test_event_logger::failed_test(test, message, output, duration);
+        outputs.push_back(output.stdout_log);
+        messages.push_back(message);
+      }
+
+      std::vector<std::string> outputs, messages;
+    } logger;
+    parallel_test_runner runner(3);
+    run_tests(s, logger, runner);
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_suite",
+          "started_test", "failed_test",
+          "started_test", "failed_test",
+        "ended_suite",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.outputs, array("slow", "failing", ""));
+    expect(logger.messages, array(anything(), strsignal(SIGABRT)));
+  });
+
+  _.test("timed out test", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        std::this_thread::sleep_for(2s);
+      });
+      _.test("test 2", []() {});
+    });
+
+    struct message_logger : test_event_logger {
+      void failed_test(const test_name &test, const std::string &message,
+                       const log::test_output &output,
+                       log::test_duration duration) override {
+        test_event_logger::failed_test(test, message, output, duration);
+        messages.push_back(message);
+      }
+
+      std::vector<std::string> messages;
+    } logger;
+    parallel_test_runner runner(2, 250ms);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.messages, array("Timed out after 250 ms"));
+    expect(now - then, less(1s));
+  });
+
+  _.test("on_wait", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("fast test", []() {});
+      _.test("slow test", []() {
+        std::this_thread::sleep_for(250ms);
+      });
+    });
+
+    // By the time we're waiting on just the slow test, the fast test should
+    // have been logged.
+    test_event_logger logger;
+    std::vector<std::size_t> seen;
+    parallel_test_runner runner(2);
+    runner.on_wait([&]() { seen.push_back(logger.events.size()); });
+    run_tests(s, logger, runner);
+
+    expect(seen.empty(), equal_to(false));
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(seen.back(), equal_to(4));
+  });
+
+  _.test("timed out test with closed pipes", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        for(int fd = 0; fd != 256; fd++)
+          close(fd);
+        std::this_thread::sleep_for(2s);
+      });
+      _.test("test 2", []() {});
+    });
+
+    struct message_logger : test_event_logger {
+      void failed_test(const test_name &test, const std::string &message,
+                       const log::test_output &output,
+                       log::test_duration duration) override {
+        test_event_logger::failed_test(test, message, output, duration);
+        messages.push_back(message);
+      }
+
+      std::vector<std::string> messages;
+    } logger;
+    parallel_test_runner runner(2, 250ms);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.messages, array("Timed out after 250 ms"));
+    expect(now - then, less(1s));
+  });
+
+  _.test("cancel after max failures", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("slow test", []() {
+        std::this_thread::sleep_for(5s);
+      });
+      _.test("failing test", []() {
+        expect(true, equal_to(false));
+      });
+      _.test("later test", []() {});
+    });
+
+    test_event_logger logger;
+    parallel_test_runner runner(2);
+    failure_limit limit(1);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner, default_filter(), {{}, &limit});
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "cancelled_test",
+        "started_test", "failed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(limit.failures(), equal_to(1u));
+    expect(now - then, less(2s));
+  });
+
+});
+
+suite<> test_worker("posix::worker_test_runner", [](auto &_) {
+
+  struct result_logger : test_event_logger {
+    void passed_test(const test_name &test, const log::test_output &output,
+                     log::test_duration duration) override {
+      test_event_logger::passed_test(test, output, duration);
+      outputs.push_back(output.stdout_log);
+    }
+    void failed_test(const test_name &test, const std::string &message,
+                     const log::test_output &output,
+                     log::test_duration duration) override {
+      test_event_logger::failed_test(test, message, output, duration);
+      outputs.push_back(output.stdout_log);
+      messages.push_back(message);
+    }
+
+    std::vector<std::string> outputs, messages;
+  };
+
+  _.test("run tests in one worker", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      for(int i = 0; i != 3; i++) {
+        _.test("test " + std::to_string(i), []() {
+          std::cout << getpid();
+        });
+      }
+    });
+
+    result_logger logger;
+    worker_test_runner runner;
+    run_tests(s, logger, runner);
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.outputs, each(
+      all(not_equal_to(std::to_string(getpid())), logger.outputs[0])
+    ));
+  });
+
+  _.test("run tests in parallel", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      for(int i = 0; i != 4; i++) {
+        _.test("test " + std::to_string(i), []() {
+          std::this_thread::sleep_for(250ms);
+        });
+      }
+    });
+
+    test_event_logger logger;
+    worker_test_runner runner(4);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(now - then, less(750ms));
+  });
+
+  _.test("replace crashed worker", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("failing test", []() {
+        std::cout << "failing";
+        expect(true, equal_to(false));
+      });
+      _.test("aborting test", []() {
+        std::cout << "aborting" << std::flush;
+        abort();
+      });
+      _.test("passing test", []() {
+        std::cout << "passing";
+      });
+    });
+
+    result_logger logger;
+    worker_test_runner runner;
+    run_tests(s, logger, runner);
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "failed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.outputs, array("failing", "aborting", "passing"));
+    expect(logger.messages, array(anything(), strsignal(SIGABRT)));
+  });
+
+  _.test("suite isolation", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        std::cout << getpid();
+      });
+      _.test("test 2", []() {
+        std::cout << getpid() << std::flush;
+        abort();
+      });
+      _.test("test 3", []() {
+        std::cout << getpid();
+      });
+
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("test 4", []() {
+          std::cout << getpid();
+        });
+        _.test("test 5", []() {
+          std::cout << getpid();
+        });
+      });
+    });
+
+    result_logger logger;
+    worker_test_runner runner(2, {}, isolation_level::suite);
+    run_tests(s, logger, runner);
+
+    expect(logger.messages, array(strsignal(SIGABRT)));
+    auto &pids = logger.outputs;
+    expect(pids.size(), equal_to(5));
+    expect(pids[1], equal_to(pids[0]));
+    expect(pids[2], all(not_equal_to(pids[0]), not_equal_to(pids[3])));
+    expect(pids[3], not_equal_to(pids[0]));
+    expect(pids[4], equal_to(pids[3]));
+  });
+
+  _.test("isolation attribute", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        std::cout << getpid();
+      });
+      _.test("test 2", {isolation(isolation_level::none)}, []() {
+        std::cout << getpid();
+      });
+      _.test("test 3", []() {
+        std::cout << getpid();
+      });
+
+      subsuite<>(_, "subsuite", {isolation(isolation_level::test)},
+                 [](auto &_) {
+        _.test("test 4", []() {
+          std::cout << getpid();
+        });
+        _.test("test 5", []() {
+          std::cout << getpid();
+        });
+      });
+    });
+
+    result_logger logger;
+    worker_test_runner runner;
+    run_tests(s, logger, runner);
+
+    auto &pids = logger.outputs;
+    expect(pids.size(), equal_to(5));
+    expect(pids[1], all(not_equal_to(std::to_string(getpid())),
+                        not_equal_to(pids[0])));
+    expect(pids[2], equal_to(pids[0]));
+    expect(pids[3], all(not_equal_to(pids[0]), not_equal_to(pids[4])));
+    expect(pids[4], not_equal_to(pids[0]));
+  });
+
+  _.test("invalid isolation attribute", []() {
+    string_attr misspelled("isolation");
+    auto s = make_suites<>("inner", [&misspelled](auto &_){
+      _.test("test 1", {misspelled("sutie")}, []() {});
+      _.test("test 2", []() {});
+    });
+
+    result_logger logger;
+    worker_test_runner runner;
+    run_tests(s, logger, runner);
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.messages, array("invalid isolation level \"sutie\""));
+  });
+
+  _.test("timed out test", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        std::this_thread::sleep_for(2s);
+      });
+      _.test("test 2", []() {});
+    });
+
+    result_logger logger;
+    worker_test_runner runner(1, 250ms);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.messages, array("Timed out after 250 ms"));
+    expect(now - then, less(1s));
+  });
+
+  _.test("timed out test with closed pipes", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {
+        for(int fd = 0; fd != 256; fd++)
+          close(fd);
+        std::this_thread::sleep_for(2s);
+      });
+      _.test("test 2", []() {});
+    });
+
+    result_logger logger;
+    worker_test_runner runner(2, 250ms);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "failed_test",
+        "started_test", "passed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(logger.messages, array("Timed out after 250 ms"));
+    expect(now - then, less(1s));
+  });
+
+  _.test("no isolation", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", {isolation(isolation_level::none)}, []() {
+        std::cout << getpid();
+      });
+      _.test("test 2", []() {});
+      _.test("test 3", {isolation(isolation_level::none)}, []() {
+        std::cout << getpid();
+      });
+      _.test("test 4", {isolation(isolation_level::none)}, []() {
+        std::this_thread::sleep_for(2s);
+      });
+    });
+
+    result_logger logger;
+    worker_test_runner runner(2, 250ms);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner);
+    auto now = std::chrono::steady_clock::now();
+
+    auto &pids = logger.outputs;
+    expect(pids.size(), equal_to(4));
+    expect(pids[0], not_equal_to(std::to_string(getpid())));
+    expect(pids[2], equal_to(pids[0]));
+    expect(logger.messages, array("Timed out after 250 ms"));
+    expect(now - then, less(1s));
+  });
+
+  _.test("cancel after max failures", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("slow test", []() {
+        std::this_thread::sleep_for(5s);
+      });
+      _.test("failing test", []() {
+        expect(true, equal_to(false));
+      });
+      _.test("later test", []() {});
+    });
+
+    result_logger logger;
+    worker_test_runner runner(2);
+    failure_limit limit(1);
+
+    auto then = std::chrono::steady_clock::now();
+    run_tests(s, logger, runner, default_filter(), {{}, &limit});
+    auto now = std::chrono::steady_clock::now();
+
+    expect(logger.events, array(
+      "started_run",
+      "started_suite",
+        "started_test", "cancelled_test",
+        "started_test", "failed_test",
+      "ended_suite",
+      "ended_run"
+    ));
+    expect(limit.failures(), equal_to(1u));
+    expect(now - then, less(2s));
+  });
+
+});
+
+suite<> test_max_failures("max failures", [](auto &_) {
+
+  _.test("same tests logged by every runner", []() {
+    auto s = make_suites<>("inner", [](auto &_){
+      _.test("test 1", []() {});
+      _.test("test 2", []() { expect(true, equal_to(false)); });
+      _.test("test 3", []() {});
+      subsuite<>(_, "subsuite", {isolation(isolation_level::suite)},
+                 [](auto &_) {
+        _.test("sub-test 1", []() {});
+      });
+    });
+
+    std::vector<std::string> expected = {
+      "started_run",
+      "started_suite",
+        "started_test", "passed_test",
+        "started_test", "failed_test",
+      "ended_suite",
+      "ended_run"
+    };
+
+    {
+      test_event_logger logger;
+      failure_limit limit(1);
+      run_tests(s, logger, subprocess_test_runner(), default_filter(),
+                {{}, &limit});
+      expect("serial", logger.events, equal_to(expected));
+    }
+
+    {
+      test_event_logger logger;
+      parallel_test_runner runner(1);
+      failure_limit limit(1);
+      run_tests(s, logger, runner, default_filter(), {{}, &limit});
+      expect("parallel", logger.events, equal_to(expected));
+    }
+
+    for(auto level : {isolation_level::test, isolation_level::suite,
+                      isolation_level::file}) {
+      test_event_logger logger;
+      worker_test_runner runner(1, {}, level);
+      failure_limit limit(1);
+      run_tests(s, logger, runner, default_filter(), {{}, &limit});
+      expect("worker", logger.events, equal_to(expected));
+    }
+  });
+
+});
+
 suite<> test_make_fd_private("make_fd_private", [](auto &_) {
 
   _.test("make_fd_private()", []() {
@@ -65,6 +65,24 @@ suite<> test_attr("attributes", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "isolation_attr", [](auto &_) {
+    _.test("with value", []() {
+      isolation_attr attr("attribute");
+      attr_instance a = attr(isolation_level::suite);
+
+      expect(&a.attribute, equal_to(&attr));
+      expect(a.value, array("suite"));
+    });
+
+    _.test("parse_isolation()", []() {
+      expect(parse_isolation("none"), equal_to(isolation_level::none));
+      expect(parse_isolation("test"), equal_to(isolation_level::test));
+      expect(parse_isolation("suite"), equal_to(isolation_level::suite));
+      expect(parse_isolation("file"), equal_to(isolation_level::file));
+      expect(parse_isolation("invalid"), equal_to(std::nullopt));
+    });
+  });
+
   subsuite<>(_, "list_attr", [](auto &_) {
     _.test("single value", []() {
       list_attr attr("attribute");
@@ -137,5 +155,96 @@ suite<> test_attr("attributes", [](auto &_) {
         attr1("a"), attr2("a", "b"), attr3("b")
       }));
     });
+
+    _.test("shared storage", []() {
+      string_attr attr1("1");
+      string_attr attr2("2");
+
+      attributes attrs = {attr1("a"), attr2("b")};
+      expect(unite(attrs, {}).shares(attrs), equal_to(true));
+      expect(unite({}, attrs).shares(attrs), equal_to(true));
+      expect(unite(attrs, attrs).shares(attrs), equal_to(true));
+      expect(unite(attrs, {attr1("c")}).shares(attrs), equal_to(false));
+    });
+  });
+
+  subsuite<>(_, "attributes", [](auto &_) {
+    _.test("sorted and unique", []() {
+      string_attr attr1("1");
+      string_attr attr2("2");
+      string_attr attr3("3");
+
+      attributes attrs = {attr3("c"), attr1("a"), attr2("b"), attr1("d")};
+      expect(attrs, equal_attributes({attr1("a"), attr2("b"), attr3("c")}));
+      expect(attrs.size(), equal_to(3u));
+    });
+
+    _.test("find()", []() {
+      string_attr attr1("1");
+      string_attr attr2("2");
+
+      attributes attrs = {attr1("a"), attr2("b")};
+      expect(attrs.find("2"), not_equal_to(attrs.end()));
+      expect(attrs.find("2")->value, array("b"));
+      expect(attrs.find("3"), equal_to(attrs.end()));
+      expect(attributes().find("1"), equal_to(attributes().end()));
+      expect(attrs.count("1"), equal_to(1u));
+    });
+
+    _.test("insert()", []() {
+      string_attr attr1("1");
+      string_attr attr2("2");
+      string_attr attr3("3");
+
+      attributes attrs = {attr1("a"), attr3("c")};
+      attributes copy = attrs;
+
+      auto result = attrs.insert(attr2("b"));
+      expect(result.second, equal_to(true));
+      expect(result.first->attribute.name(), equal_to("2"));
+      expect(attrs, equal_attributes({attr1("a"), attr2("b"), attr3("c")}));
+      expect(copy, equal_attributes({attr1("a"), attr3("c")}));
+
+      result = attrs.insert(attr2("x"));
+      expect(result.second, equal_to(false));
+      expect(result.first->value, array("b"));
+    });
+
+    _.test("std::set<std::string> compatibility", []() {
+      struct set_attr : attr_base {
+        set_attr() : attr_base("attribute") {}
+
+        attr_instance operator ()(std::set<std::string> values) const {
+          return attr_instance{*this, values};
+        }
+
+        const attr_instance
+        compose(const attr_instance &lhs,
+                const attr_instance &rhs) const override {
+          std::set<std::string> merged = lhs.value;
+          std::set<std::string> other = rhs.value;
+          merged.insert(other.begin(), other.end());
+          return attr_instance{*this, merged};
+        }
+      } attr;
+
+      auto a = unite(attr({"b", "a"}), attr({"c", "a"}));
+      expect(a.value, array("a", "b", "c"));
+      expect(std::set<std::string>(a.value),
+             equal_to(std::set<std::string>{"a", "b", "c"}));
+    });
+
+    _.test("interned values", []() {
+      list_attr attr("attribute");
+
+      std::string value = "value";
+      attr_instance a1 = attr(value, "other", "value");
+      attr_instance a2 = attr("value");
+
+      expect(a1.value, array("other", "value"));
+      expect(a1.value.count("value"), equal_to(1u));
+      expect(a1.value.count("missing"), equal_to(0u));
+      expect(a1.value.begin()[1].data(), equal_to(a2.value.begin()->data()));
+    });
   });
 });
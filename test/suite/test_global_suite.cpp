@@ -97,4 +97,52 @@ suite<suites_list> test_global_suite("global suite declaration", [](auto &_) {
     expect(suites.size(), equal_to(0));
   });
 
+  _.test("create a lazy test suite", [](suites_list &suites) {
+    static int built = 0;
+    built = 0;
+    lazy_suite<>(suites, "inner test suite", [](auto &_){
+      built++;
+      _.test("inner test", []() {});
+      _.test("skipped test", {skip}, []() {});
+    });
+
+    expect(suites.size(), equal_to(1));
+    expect(built, equal_to(0));
+
+    auto &inner = suites[0];
+    expect(inner.name(), equal_to("inner test suite"));
+    expect(inner.is_expanded(), equal_to(false));
+    expect(inner.tests().size(), equal_to(2));
+    expect(inner.subsuites().size(), equal_to(0));
+    expect(inner.is_expanded(), equal_to(true));
+    expect(built, equal_to(1));
+  });
+
+  _.test("create a lazy test suite with parameterized fixtures",
+         [](suites_list &suites) {
+    static int built = 0;
+    built = 0;
+    lazy_suite<int, float>(suites, "inner test suite", {skip}, [](auto &_){
+      built++;
+      _.test("inner test", [](auto &) {});
+      subsuite<>(_, "subsuite", [](auto &_) {
+        _.test("inner test", [](auto &) {});
+      });
+    });
+
+    expect(suites.size(), equal_to(2));
+    expect(built, equal_to(0));
+
+    auto &int_suite = suites[0];
+    expect(int_suite.name(), equal_to("inner test suite (int)"));
+    expect(int_suite.tests().size(), equal_to(1));
+    expect(int_suite.tests()[0].attrs.count("skip"), equal_to(1u));
+    expect(int_suite.subsuites().size(), equal_to(1));
+    expect(built, equal_to(1));
+
+    auto &float_suite = suites[1];
+    expect(float_suite.tests().size(), equal_to(1));
+    expect(built, equal_to(2));
+  });
+
 });
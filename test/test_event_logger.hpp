@@ -42,6 +42,10 @@ struct test_event_logger : log::file_logger {
     events.push_back("skipped_test");
     tests.insert(test);
   }
+  void cancelled_test(const test_name &test) override {
+    events.push_back("cancelled_test");
+    tests.insert(test);
+  }
 
   void started_file(const test_file &file) override {
     events.push_back("started_file");
@@ -0,0 +1,55 @@
+// Behaves like a test binary built against an older version of mettle: it
+// rejects any command-line options it doesn't know about, and only sends events
+// in the original bencode format.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#  include <unistd.h>
+#else
+#  include <windows.h>
+#endif
+
+#include <mettle/driver/exit_code.hpp>
+
+int main(int argc, const char *argv[]) {
+  const char *output_fd = nullptr;
+  for(int i = 1; i != argc; i++) {
+    if(std::strcmp(argv[i], "--output-fd") == 0 && i + 1 != argc) {
+      output_fd = argv[++i];
+    } else {
+      std::cerr << argv[0] << ": unrecognised option '" << argv[i] << "'"
+                << std::endl;
+      return mettle::exit_code::bad_args;
+    }
+  }
+  if(!output_fd)
+    return mettle::exit_code::bad_args;
+
+  std::string events =
+    "d5:event13:started_suite6:suitesl10:old driveree"
+    "d5:event12:started_test4:testd2:idi0e6:suitesl10:old drivere"
+    "4:test4:testee"
+    "d8:durationi0e5:event11:passed_test"
+    "6:outputd10:stderr_log0:10:stdout_log0:e"
+    "4:testd2:idi0e6:suitesl10:old drivere4:test4:testee"
+    "d5:event11:ended_suite6:suitesl10:old driveree";
+
+#ifndef _WIN32
+  int fd = std::atoi(output_fd);
+  if(write(fd, events.data(), events.size()) !=
+     static_cast<ssize_t>(events.size()))
+    return mettle::exit_code::fatal;
+#else
+  HANDLE handle = reinterpret_cast<HANDLE>(std::strtoull(output_fd, nullptr,
+                                                         16));
+  DWORD written;
+  if(!WriteFile(handle, events.data(), static_cast<DWORD>(events.size()),
+                &written, nullptr) || written != events.size())
+    return mettle::exit_code::fatal;
+#endif
+  return mettle::exit_code::success;
+}
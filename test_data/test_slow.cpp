@@ -0,0 +1,15 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <chrono>
+#include <thread>
+
+suite<> test_suite("suite", [](auto &_) {
+  _.test("failing test", []() {
+    expect(true, equal_to(false));
+  });
+
+  _.test("slow test", []() {
+    std::this_thread::sleep_for(std::chrono::seconds(10));
+  });
+});